@@ -0,0 +1,422 @@
+/* dither_bench: times each stage of dithering a PNG on its own, over the example images and
+ *   over synthetic images of any size and depth, and prints one record per image and stage
+ *   as CSV or JSON lines. Every stage runs the same code as the dither executable. */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "BayerMatrix.h"
+#include "ColorPalette.h"
+#include "Dither.h"
+#include "ErrorDiffusion.h"
+#include "PNG_Compression.h"
+#include "PNG_Decoder.h"
+#include "PNG_Grey.h"
+#include "PNG_IO.h"
+#include "PNG_Indexed.h"
+#include "PNG_RGB.h"
+#include "ThreadPool.h"
+#include "ThresholdKernel.h"
+
+#ifndef DITHER_EXAMPLES_DIRECTORY
+#define DITHER_EXAMPLES_DIRECTORY "examples/input"
+#endif
+
+// Settings supplied on the command line.
+struct BenchOptions {
+    unsigned int nIterations = 5;
+    std::string examplesDirectory = DITHER_EXAMPLES_DIRECTORY; // Not benchmarked if empty.
+    std::vector<std::string> syntheticSpecs; // "WIDTHxHEIGHTxDEPTH" of each synthetic image.
+    bool json = false;
+    unsigned int nThreads = ThreadPool::getDefaultThreadCount();
+    unsigned int matrixSize = 4;
+    PNG_Compression compression = PNG_Compression::fromProfile("balanced");
+};
+
+// An image to benchmark: a file, or a synthetic image encoded in memory.
+struct BenchImage {
+    std::string name;
+    std::string filePath; // Empty for synthetic images.
+    std::vector<png_byte> encoded;
+
+    [[nodiscard]] PNG_Source getSource() const {
+        if (filePath.empty())
+            return PNG_Source(encoded.data(), encoded.size());
+        return PNG_Source(filePath);
+    }
+};
+
+// Prints the records of every stage in the chosen format.
+class BenchReport {
+public:
+    explicit BenchReport(bool json) : json(json) {}
+
+    // Prints the settings the run was made with, and the CSV header.
+    void printHeader(const BenchOptions &options) const {
+        std::string simd = ThresholdKernel::getInstructionSetName(ThresholdKernel::getInstructionSet());
+        if (json) {
+            std::cout << "{\"threads\":" << options.nThreads << ",\"simd\":\"" << simd << "\",\"matrix\":"
+                      << options.matrixSize << ",\"iterations\":" << options.nIterations << ",\"compression\":\""
+                      << options.compression.describe() << "\"}\n";
+        } else {
+            std::cout << "# threads=" << options.nThreads << " simd=" << simd << " matrix=" << options.matrixSize
+                      << " iterations=" << options.nIterations << " compression=" << options.compression.describe()
+                      << '\n' << "image,width,height,depth,stage,iterations,min_ms,median_ms,megapixels_per_s\n";
+        }
+    }
+
+    void printStage(const std::string &image, const PNG_Info &info, const std::string &stage,
+                    std::vector<double> times) const {
+        std::sort(times.begin(), times.end());
+        double minimum = times.front();
+        double median = times.at(times.size() / 2);
+        double megapixels = (double) info.width * (double) info.height / 1e6;
+        double rate = (median > 0) ? megapixels / (median / 1e3) : 0;
+
+        std::ostringstream record;
+        record << std::fixed << std::setprecision(4);
+        if (json) {
+            record << "{\"image\":\"" << escape(image) << "\",\"width\":" << info.width << ",\"height\":"
+                   << info.height << ",\"depth\":" << info.colorDepth << ",\"stage\":\"" << stage
+                   << "\",\"iterations\":" << times.size() << ",\"min_ms\":" << minimum << ",\"median_ms\":"
+                   << median << ",\"megapixels_per_s\":" << rate << "}\n";
+        } else {
+            record << image << ',' << info.width << ',' << info.height << ',' << info.colorDepth << ',' << stage
+                   << ',' << times.size() << ',' << minimum << ',' << median << ',' << rate << '\n';
+        }
+        std::cout << record.str() << std::flush;
+    }
+
+private:
+    // Escapes the quotes and backslashes of a JSON string.
+    static std::string escape(const std::string &text) {
+        std::string result;
+        for (char c : text) {
+            if ((c == '\"') || (c == '\\'))
+                result += '\\';
+            result += c;
+        }
+        return result;
+    }
+
+    bool json;
+};
+
+// Results that are otherwise unused are stored here, so that the work making them is not optimized away.
+volatile unsigned long int benchSink;
+
+/* Times nIterations runs of body, each after a run of setup, which is not timed.
+ *   Returns the time of each run in milliseconds. */
+template<typename Setup, typename Body>
+std::vector<double> timeStage(unsigned int nIterations, Setup &&setup, Body &&body) {
+    std::vector<double> times;
+    for (unsigned int i = 0; i < nIterations; i++) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return times;
+}
+
+/* Makes an image of gradients with some noise, so that it neither compresses
+ *   nor dithers to flat areas, and encodes it in memory. */
+template<typename Channel>
+std::vector<png_byte> makeSyntheticPNG(unsigned long int width, unsigned long int height, unsigned int colorDepth) {
+    BasicPNG_RGB<Channel> image(width, height, colorDepth);
+    unsigned int maxValue = (1U << colorDepth) - 1;
+    uint32_t state = 0x2545F491;
+    for (unsigned long int y = 0; y < height; y++) {
+        auto *row = image.getRow(y);
+        for (unsigned long int x = 0; x < width; x++) {
+            state = (state * 1664525U) + 1013904223U;
+            unsigned int noise = (state >> 24U) & 0x0FU;
+            unsigned int red = (unsigned int) ((double) x / (double) width * maxValue);
+            unsigned int green = (unsigned int) ((double) y / (double) height * maxValue);
+            unsigned int blue = (unsigned int) ((double) (x + y) / (double) (width + height) * maxValue);
+            row[x] = {(Channel) std::min(red + noise, maxValue), (Channel) std::min(green + noise, maxValue),
+                      (Channel) std::min(blue + noise, maxValue)};
+        }
+    }
+
+    std::vector<png_byte> encoded;
+    image.write_png_file(encoded, PNG_Compression::fromProfile("fast"));
+    return encoded;
+}
+
+// Parses a "WIDTHxHEIGHTxDEPTH" synthetic image. Throws std::invalid_argument if it is malformed.
+BenchImage makeSyntheticImage(const std::string &spec) {
+    unsigned long int width = 0, height = 0;
+    unsigned int colorDepth = 0;
+    char x1 = 0, x2 = 0;
+    std::istringstream stream(spec);
+    if (!(stream >> width >> x1 >> height >> x2 >> colorDepth) || !stream.eof() || (x1 != 'x') || (x2 != 'x') ||
+        (width == 0) || (height == 0) || ((colorDepth != 8) && (colorDepth != 16)))
+        throw std::invalid_argument('\"' + spec +
+                                    "\" is not a valid synthetic image(WIDTHxHEIGHTxDEPTH, depth 8 or 16)");
+
+    BenchImage image;
+    image.name = "synthetic-" + spec;
+    if (colorDepth == 16)
+        image.encoded = makeSyntheticPNG<uint16_t>(width, height, colorDepth);
+    else
+        image.encoded = makeSyntheticPNG<uint8_t>(width, height, colorDepth);
+    return image;
+}
+
+// Times every stage of the image, which has been loaded into loaded, and prints the results.
+template<typename Channel>
+void benchLoadedImage(const BenchImage &image, BasicPNG_RGB<Channel> &loaded, const PNG_Info &info,
+                      const BenchOptions &options, ThreadPool &pool, const BenchReport &report) {
+    auto none = [] {};
+    unsigned int n = options.nIterations;
+    unsigned int maxValue = (1U << info.colorDepth) - 1;
+    unsigned long int width = info.width, height = info.height;
+    const DiffusionKernel &kernel = DiffusionKernel::fromName("floyd-steinberg");
+
+    // Dithering.
+    BasicPNG_RGB<Channel> dithered;
+    withBayerMatrix(options.matrixSize, [&](auto map) {
+        report.printStage(image.name, info, "bayer_rgb", timeStage(n, [&] { dithered = loaded; }, [&] {
+            bayerRGBInPlace(dithered, map, maxValue, pool);
+        }));
+    });
+    PNG_Grey grey;
+    withBayerMatrix(options.matrixSize, [&](auto map) {
+        report.printStage(image.name, info, "bayer_grey", timeStage(n, none, [&] {
+            grey = bayerGrey(loaded, map, maxValue, pool);
+        }));
+    });
+    PNG_Grey grey4;
+    withBayerMatrix(options.matrixSize, [&](auto map) {
+        report.printStage(image.name, info, "bayer_grey4", timeStage(n, none, [&] {
+            grey4 = bayerGrey(loaded, map, maxValue, pool, 4);
+        }));
+    });
+    BasicPNG_RGB<Channel> diffused;
+    report.printStage(image.name, info, "diffuse_rgb", timeStage(n, [&] { diffused = loaded; }, [&] {
+        diffuseRGBInPlace(diffused, kernel, false, maxValue, pool);
+    }));
+    PNG_Grey diffusedGrey;
+    report.printStage(image.name, info, "diffuse_grey", timeStage(n, none, [&] {
+        diffusedGrey = diffuseGrey(loaded, kernel, false, maxValue, pool);
+    }));
+
+    // Nearest color lookups against the 3 bit palette, one pixel at a time.
+    ColorPalette palette;
+    for (const RGB_Pixel &color : get3BitPalette())
+        palette.addColor(color);
+    palette.finalize();
+    unsigned long int checksum = 0;
+    report.printStage(image.name, info, "palette_nearest", timeStage(n, none, [&] {
+        for (unsigned long int y = 0; y < height; y++) {
+            const auto *row = loaded.getRow(y);
+            for (unsigned long int x = 0; x < width; x++)
+                checksum += palette.getNearestIndex(RGB_Pixel{row[x].red, row[x].green, row[x].blue});
+        }
+    }));
+    benchSink = checksum;
+
+    // Packing dithered pixels into output rows.
+    PNG_Indexed indexed;
+    report.printStage(image.name, info, "pack_indexed", timeStage(n, none, [&] {
+        indexed = to3BitIndexed(dithered, pool);
+    }));
+    std::vector<GreyPixel> greyRows((std::size_t) width * height);
+    for (unsigned long int y = 0; y < height; y++) {
+        rowToGrey(loaded.getRow(y), greyRows.data() + (y * width), width);
+        for (unsigned long int x = 0; x < width; x++)
+            greyRows[(y * width) + x] = greyRows[(y * width) + x] > (maxValue / 2);
+    }
+    PNG_Grey packed(width, height, 1);
+    report.printStage(image.name, info, "pack_grey", timeStage(n, none, [&] {
+        for (unsigned long int y = 0; y < height; y++)
+            packed.setRow(y, greyRows.data() + (y * width));
+    }));
+
+    // Encoding the outputs in memory.
+    std::vector<png_byte> encoded;
+    report.printStage(image.name, info, "encode_grey", timeStage(n, [&] { encoded.clear(); }, [&] {
+        grey.write_png_file(encoded, options.compression);
+    }));
+    report.printStage(image.name, info, "encode_indexed", timeStage(n, [&] { encoded.clear(); }, [&] {
+        indexed.write_png_file(encoded, options.compression);
+    }));
+}
+
+// Times every stage of dithering the image, and prints the results.
+void benchImage(const BenchImage &image, const BenchOptions &options, ThreadPool &pool, const BenchReport &report) {
+    auto none = [] {};
+    unsigned int n = options.nIterations;
+    PNG_Decoder decoder(image.getSource());
+    PNG_Info info = decoder.getInfo();
+    decoder.reset();
+
+    // Opening the source and checking the signature.
+    PNG_InputStream input;
+    report.printStage(image.name, info, "signature", timeStage(n, none, [&] {
+        input.open(image.getSource());
+        input.close();
+    }));
+
+    // Opening the source and reading the header, as is done to identify a PNG.
+    report.printStage(image.name, info, "header", timeStage(n, [&] { decoder.reset(); }, [&] {
+        decoder.open(image.getSource());
+    }));
+
+    // Decoding every row in the LibPNG format, without storing them.
+    std::vector<png_byte> rows;
+    std::vector<png_bytep> rowPointers;
+    report.printStage(image.name, info, "decode_rows", timeStage(n, [&] { decoder.open(image.getSource()); }, [&] {
+        if (info.numberOfPasses > 1) {
+            // Interlaced images can only be decoded whole.
+            rows.resize(decoder.getRowBytes() * info.height);
+            rowPointers.resize(info.height);
+            for (unsigned long int y = 0; y < info.height; y++)
+                rowPointers[y] = rows.data() + (y * decoder.getRowBytes());
+            decoder.readImage(rowPointers.data());
+        } else {
+            rows.resize(decoder.getRowBytes());
+            for (unsigned long int y = 0; y < info.height; y++)
+                decoder.readRawRow(rows.data());
+        }
+    }));
+
+    // Decoding into an image, whose buffers are reused between iterations as between batch files.
+    if (info.colorDepth == 16) {
+        PNG_RGB16 loaded;
+        report.printStage(image.name, info, "load", timeStage(n, [&] { decoder.open(image.getSource()); }, [&] {
+            loaded.load(decoder);
+        }));
+        decoder.reset();
+        benchLoadedImage(image, loaded, info, options, pool, report);
+    } else {
+        PNG_RGB8 loaded;
+        report.printStage(image.name, info, "load", timeStage(n, [&] { decoder.open(image.getSource()); }, [&] {
+            loaded.load(decoder);
+        }));
+        decoder.reset();
+        benchLoadedImage(image, loaded, info, options, pool, report);
+    }
+}
+
+// Prints the help screen.
+void printHelp() {
+    std::cout << "Usage : dither_bench [Options]...\n"
+              << "Times each stage of dithering, over the example images and synthetic images, and prints\n"
+              << "one record per image and stage\n"
+              << "\n"
+              << "  --iterations          sets the number of times each stage is run. Default is 5\n"
+              << "  --examples            sets the directory of PNGs to benchmark. Default is\n"
+              << "                          " << DITHER_EXAMPLES_DIRECTORY << '\n'
+              << "  --no-examples         skips the directory of PNGs\n"
+              << "  --synthetic           adds a synthetic image of the size and depth, such as 1920x1080x16.\n"
+              << "                          May be given more than once. Default is 2048x2048x8 and\n"
+              << "                          2048x2048x16\n"
+              << "  --format              sets the output format(csv or json, one object per line).\n"
+              << "                          Default is csv\n"
+              << "  --compression         sets the compression profile of the encode stages(fast, balanced\n"
+              << "                          or small). Default is balanced\n"
+              << "  --matrix              sets the size of the Bayer matrix(2, 4, 8 or 16). Default is 4\n"
+              << "  -j                    sets the number of threads. Default is the number of hardware\n"
+              << "                          threads\n";
+}
+
+// Returns the argument following the option at argv[i]. Throws std::invalid_argument if there is none.
+std::string getOptionArgument(int argc, char *argv[], int i) {
+    if (i == (argc - 1))
+        throw std::invalid_argument("Operation \"" + std::string(argv[i]) + "\" requires argument");
+    return argv[i + 1];
+}
+
+// Returns the argument as a positive number. Throws std::invalid_argument if it is not one.
+unsigned int parsePositive(const std::string &argument) {
+    if (argument.empty() || (argument.size() > 6) || (argument.find_first_not_of("0123456789") != std::string::npos) ||
+        (std::stoul(argument) == 0))
+        throw std::invalid_argument('\"' + argument + "\" is not a positive number");
+    return (unsigned int) std::stoul(argument);
+}
+
+// Loads the command line into options. Throws std::invalid_argument if it is malformed.
+void processInputArgs(int argc, char *argv[], BenchOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--help") {
+            printHelp();
+            exit(0);
+        } else if (argument == "--no-examples") {
+            options.examplesDirectory.clear();
+            continue;
+        }
+
+        std::string argument2 = getOptionArgument(argc, argv, i++);
+        if (argument == "--iterations")
+            options.nIterations = parsePositive(argument2);
+        else if (argument == "--examples")
+            options.examplesDirectory = argument2;
+        else if (argument == "--synthetic")
+            options.syntheticSpecs.push_back(argument2);
+        else if ((argument == "--format") && ((argument2 == "csv") || (argument2 == "json")))
+            options.json = argument2 == "json";
+        else if (argument == "--compression")
+            options.compression = PNG_Compression::fromProfile(argument2);
+        else if ((argument == "--matrix") &&
+                 ((argument2 == "2") || (argument2 == "4") || (argument2 == "8") || (argument2 == "16")))
+            options.matrixSize = std::stoul(argument2);
+        else if (argument == "-j")
+            options.nThreads = parsePositive(argument2);
+        else
+            throw std::invalid_argument('\"' + argument + ' ' + argument2 + "\" not recognized");
+    }
+
+    if (options.syntheticSpecs.empty())
+        options.syntheticSpecs = {"2048x2048x8", "2048x2048x16"};
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options;
+    std::vector<BenchImage> images;
+    try {
+        processInputArgs(argc, argv, options);
+
+        // Collect the example images in name order, then make the synthetic ones.
+        if (!options.examplesDirectory.empty()) {
+            std::vector<std::filesystem::path> paths;
+            for (const auto &entry : std::filesystem::directory_iterator(options.examplesDirectory))
+                if (entry.is_regular_file() && (entry.path().extension() == ".png"))
+                    paths.push_back(entry.path());
+            std::sort(paths.begin(), paths.end());
+            for (const auto &path : paths)
+                images.push_back(BenchImage{path.filename().string(), path.string(), {}});
+        }
+        for (const std::string &spec : options.syntheticSpecs)
+            images.push_back(makeSyntheticImage(spec));
+    } catch (std::exception &e) {
+        std::cerr << e.what() << ".\nTry 'dither_bench --help' for more information.\n";
+        return 1;
+    }
+
+    ThreadPool pool(options.nThreads);
+    BenchReport report(options.json);
+    report.printHeader(options);
+
+    // An image that can not be benchmarked is reported and skipped.
+    int exitStatus = 0;
+    for (const BenchImage &image : images) {
+        try {
+            benchImage(image, options, pool, report);
+        } catch (std::exception &e) {
+            std::cerr << image.name << ": " << e.what() << '\n';
+            exitStatus = 1;
+        }
+    }
+    return exitStatus;
+}
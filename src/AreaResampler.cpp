@@ -0,0 +1,87 @@
+#include "AreaResampler.h"
+#include <algorithm>
+#include <cstring>
+
+AreaResampler::AreaResampler(const PixelRect &keptRect, unsigned long int width, unsigned long int height)
+        : keptRect(keptRect), width(width), height(height), firstColumns(width), lastColumns(width),
+          rowSums(3 * (std::size_t) width) {
+    /* Output pixel x covers [x * keptRect.width, (x + 1) * keptRect.width), and source pixel i
+     *   [i * width, (i + 1) * width). */
+    for (unsigned long int x = 0; x < width; x++) {
+        firstColumns[x] = (unsigned long int) (((std::uint64_t) x * keptRect.width) / width);
+        lastColumns[x] = (unsigned long int) ((((std::uint64_t) (x + 1) * keptRect.width) - 1) / width);
+    }
+    nOpenRows = (height / keptRect.height) + 2;
+    rowAccumulators.assign(nOpenRows * 3 * (std::size_t) width, 0);
+}
+
+bool AreaResampler::isComplete() const noexcept {
+    return nextOutputRow >= height;
+}
+
+// Returns channel i of a row in the LibPNG format, whose channels take nBytesPerColor bytes.
+static inline unsigned int getRawChannel(png_const_bytep row, std::size_t i, unsigned int nBytesPerColor) {
+    if (nBytesPerColor == 2)
+        return ((unsigned int) row[2 * i] << 8U) | row[(2 * i) + 1];
+    return row[i];
+}
+
+void AreaResampler::sumRow(png_const_bytep row, unsigned int nBytesPerColor) {
+    std::uint64_t pixelWidth = width, outputPixelWidth = keptRect.width;
+    for (unsigned long int x = 0; x < width; x++) {
+        std::uint64_t outputStart = x * outputPixelWidth, outputEnd = outputStart + outputPixelWidth;
+        std::uint64_t sums[3] = {0, 0, 0};
+        for (unsigned long int i = firstColumns[x]; i <= lastColumns[x]; i++) {
+            std::uint64_t start = i * pixelWidth;
+            std::uint64_t weight = std::min(start + pixelWidth, outputEnd) - std::max(start, outputStart);
+            std::size_t channel = 3 * ((std::size_t) keptRect.x + i);
+            for (unsigned int c = 0; c < 3; c++)
+                sums[c] += weight * getRawChannel(row, channel + c, nBytesPerColor);
+        }
+        std::memcpy(&rowSums[3 * (std::size_t) x], sums, sizeof(sums));
+    }
+}
+
+template<typename Channel>
+void AreaResampler::addRow(png_const_bytep row, unsigned int nBytesPerColor, BasicPNG_RGB<Channel> &output) {
+    unsigned long int y = nextSourceRow++;
+    if ((y < keptRect.y) || (y >= keptRect.y + keptRect.height) || isComplete())
+        return;
+    y -= keptRect.y;
+
+    // A crop that is not resized needs no averaging.
+    if ((width == keptRect.width) && (height == keptRect.height)) {
+        Channel *samples = reinterpret_cast<Channel *>(output.getRow(nextOutputRow++));
+        for (std::size_t i = 0; i < 3 * (std::size_t) width; i++)
+            samples[i] = (Channel) getRawChannel(row, (3 * (std::size_t) keptRect.x) + i, nBytesPerColor);
+        return;
+    }
+
+    /* Add the row to every output row that it covers, weighted by how much of it they cover. In
+     *   the units of the weights, output row r covers [r * keptRect.height, (r + 1) * keptRect.height),
+     *   and the source row [y * height, (y + 1) * height). Each output row is done once the last
+     *   source row that it covers has been added. */
+    sumRow(row, nBytesPerColor);
+    std::uint64_t start = (std::uint64_t) y * height, end = start + height;
+    std::uint64_t outputRowHeight = keptRect.height;
+    std::uint64_t area = (std::uint64_t) keptRect.width * keptRect.height;
+    for (unsigned long int r = start / outputRowHeight; (r < height) && (r * outputRowHeight < end); r++) {
+        std::uint64_t weight = std::min(end, (r + 1) * outputRowHeight) - std::max(start, r * outputRowHeight);
+        std::uint64_t *accumulator = &rowAccumulators[(r % nOpenRows) * 3 * (std::size_t) width];
+        for (std::size_t i = 0; i < 3 * (std::size_t) width; i++)
+            accumulator[i] += weight * rowSums[i];
+
+        if ((r + 1) * outputRowHeight <= end) {
+            Channel *samples = reinterpret_cast<Channel *>(output.getRow(r));
+            for (std::size_t i = 0; i < 3 * (std::size_t) width; i++) {
+                samples[i] = (Channel) ((accumulator[i] + (area / 2)) / area);
+                accumulator[i] = 0;
+            }
+            nextOutputRow = r + 1;
+        }
+    }
+}
+
+template void AreaResampler::addRow<uint8_t>(png_const_bytep, unsigned int, PNG_RGB8 &);
+
+template void AreaResampler::addRow<uint16_t>(png_const_bytep, unsigned int, PNG_RGB16 &);
@@ -0,0 +1,50 @@
+#ifndef DITHER_AREARESAMPLER_H
+#define DITHER_AREARESAMPLER_H
+
+#include <png.h>
+#include <cstdint>
+#include <vector>
+#include "ImageGeometry.h"
+#include "PNG_RGB.h"
+
+/* Crops an RGB image and resizes it by area averaging, fed one decoded row at a time, so the
+ *   image at its full size is never held. Each output pixel is the average of the part of the
+ *   crop that it covers, with source pixels that it only partly covers weighted by how much of
+ *   them it covers. The weights are exact integers, so the result does not depend on rounding
+ *   and a crop that is not resized is copied unchanged. Rows outside the crop are skipped
+ *   without being converted, and no rows are needed past its bottom. */
+class AreaResampler {
+public:
+    // Resamples keptRect, of an image whose rows are fed to addRow, to width x height pixels.
+    AreaResampler(const PixelRect &keptRect, unsigned long int width, unsigned long int height);
+
+    /* Adds the next row of the image, in the LibPNG format, with 3 channels of nBytesPerColor
+     *   bytes each. Output rows are written to output, which must be width x height pixels, as
+     *   soon as every row that they cover has been added. */
+    template<typename Channel>
+    void addRow(png_const_bytep row, unsigned int nBytesPerColor, BasicPNG_RGB<Channel> &output);
+
+    // Returns true once every row of the output has been written, after which no more rows are needed.
+    [[nodiscard]] bool isComplete() const noexcept;
+
+private:
+    // Sums the weighted channels of the row across the crop into rowSums, an output pixel at a time.
+    void sumRow(png_const_bytep row, unsigned int nBytesPerColor);
+
+    PixelRect keptRect;
+    unsigned long int width, height;
+    unsigned long int nextSourceRow = 0, nextOutputRow = 0;
+
+    /* The first source pixel covered by each output pixel, then the last. In the units that
+     *   weights are measured in, a source pixel is width wide and an output pixel keptRect.width wide. */
+    std::vector<unsigned long int> firstColumns, lastColumns;
+    std::vector<std::uint64_t> rowSums; // The weighted sums of the current row, 3 channels per output pixel.
+
+    /* The weighted sums of the output rows in progress. The rows that a source row covers are
+     *   held in a ring of nOpenRows rows, which is enough however much the image is enlarged. */
+    unsigned long int nOpenRows;
+    std::vector<std::uint64_t> rowAccumulators;
+};
+
+
+#endif //DITHER_AREARESAMPLER_H
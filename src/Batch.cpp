@@ -0,0 +1,126 @@
+#include "Batch.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "PNG_structs.h"
+
+// Splits a manifest line into fields, on tabs if it holds any and on runs of spaces otherwise.
+static std::vector<std::string> splitManifestLine(const std::string &line) {
+    std::vector<std::string> fields;
+    bool tabbed = line.find('\t') != std::string::npos;
+    std::string field;
+    for (char c : line) {
+        bool separator = tabbed ? (c == '\t') : ((c == ' ') || (c == '\t'));
+        if (!separator) {
+            field += c;
+            continue;
+        }
+        if (tabbed || !field.empty())
+            fields.push_back(field);
+        field.clear();
+    }
+    if (tabbed || !field.empty())
+        fields.push_back(field);
+    return fields;
+}
+
+std::vector<BatchJob> readBatchManifest(const std::string &manifestPath, bool using3Bit) {
+    std::ifstream manifest(manifestPath);
+    if (!manifest)
+        throw BadPath();
+
+    std::vector<BatchJob> jobs;
+    std::unordered_map<std::string, std::size_t> jobIndices; // The job of each input path.
+    std::string line;
+    for (unsigned long int lineNumber = 1; std::getline(manifest, line); lineNumber++) {
+        // Tolerate manifests with Windows line endings.
+        if (!line.empty() && (line.back() == '\r'))
+            line.pop_back();
+        if ((line.find_first_not_of(" \t") == std::string::npos) || (line.at(0) == '#'))
+            continue;
+
+        std::vector<std::string> fields = splitManifestLine(line);
+        std::string where = manifestPath + ':' + std::to_string(lineNumber) + ": ";
+        if ((fields.size() < 2) || (fields.size() > 3) || fields.at(0).empty() || fields.at(1).empty())
+            throw std::invalid_argument(where + "expected an input path, an output path and an optional mode");
+
+        BatchOutput output{fields.at(1), using3Bit};
+        if (fields.size() == 3) {
+            if (fields.at(2) == "3bit")
+                output.using3Bit = true;
+            else if (fields.at(2) == "greyscale")
+                output.using3Bit = false;
+            else
+                throw std::invalid_argument(where + '\"' + fields.at(2) + "\" not recognized as a valid mode");
+        }
+
+        auto found = jobIndices.find(fields.at(0));
+        if (found == jobIndices.end()) {
+            jobIndices.emplace(fields.at(0), jobs.size());
+            jobs.push_back(BatchJob{fields.at(0), {output}});
+        } else
+            jobs.at(found->second).outputs.push_back(output);
+    }
+
+    return jobs;
+}
+
+std::vector<BatchJob> listBatchDirectory(const std::string &inputDirectory, const std::string &outputDirectory,
+                                         bool using3Bit) {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    if (!fs::is_directory(inputDirectory, error))
+        throw BadPath();
+    fs::create_directories(outputDirectory, error);
+    if (!fs::is_directory(outputDirectory, error))
+        throw BadPath();
+
+    // Collect every file with a .png extension, in any case.
+    std::vector<fs::path> inputs;
+    for (const fs::directory_entry &entry : fs::directory_iterator(inputDirectory, error)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return (char) std::tolower(c); });
+        if ((extension == ".png") && entry.is_regular_file(error))
+            inputs.push_back(entry.path());
+    }
+    if (error)
+        throw BadPath();
+    std::sort(inputs.begin(), inputs.end());
+
+    std::vector<BatchJob> jobs;
+    for (const fs::path &input : inputs) {
+        BatchOutput output{(fs::path(outputDirectory) / input.filename()).string(), using3Bit};
+        jobs.push_back(BatchJob{input.string(), {output}});
+    }
+    return jobs;
+}
+
+std::vector<std::string> runBatch(const std::vector<BatchJob> &jobs, ThreadPool &pool,
+                                  const std::function<void(const BatchJob &, unsigned int)> &runJob) {
+    std::vector<std::string> errors(jobs.size());
+
+    /* Jobs are claimed one at a time rather than split into fixed bands, as
+     *   images differ in size and a band of large ones would hold up the batch. */
+    std::atomic<std::size_t> nextJob{0};
+    pool.parallelFor(0, pool.getThreadCount(), [&](unsigned long int firstWorker, unsigned long int lastWorker) {
+        for (unsigned long int worker = firstWorker; worker < lastWorker; worker++) {
+            for (std::size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+                // A failure must always leave a message, so that it is counted.
+                try {
+                    runJob(jobs.at(i), worker);
+                } catch (std::exception &e) {
+                    errors.at(i) = (*e.what() != '\0') ? e.what() : "Unknown error";
+                } catch (...) {
+                    errors.at(i) = "Unknown error";
+                }
+            }
+        }
+    });
+
+    return errors;
+}
@@ -0,0 +1,44 @@
+#ifndef DITHER_BATCH_H
+#define DITHER_BATCH_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+// One file written by a batch job.
+struct BatchOutput {
+    std::string filePath;
+    bool using3Bit;
+};
+
+/* One input file of a batch, and every file to be made from it. The input is
+ *   decoded once, however many outputs there are. */
+struct BatchJob {
+    std::string inputFilePath;
+    std::vector<BatchOutput> outputs;
+};
+
+/* Reads a manifest of jobs. Each line holds an input path, an output path and optionally a
+ *   mode(greyscale or 3bit), separated by tabs, or by spaces if the line holds no tab. Outputs
+ *   without a mode use the supplied default. Blank lines and lines starting with '#' are
+ *   skipped. Lines that name the same input are merged into one job. Throws BadPath if the
+ *   manifest can not be opened, and std::invalid_argument, naming the line, if a line is malformed. */
+std::vector<BatchJob> readBatchManifest(const std::string &manifestPath, bool using3Bit);
+
+/* Makes a job for every PNG in inputDirectory, written to a file of the same name in
+ *   outputDirectory, which is created if it does not exist. Jobs are sorted by name.
+ *   Throws BadPath if either directory can not be used. */
+std::vector<BatchJob> listBatchDirectory(const std::string &inputDirectory, const std::string &outputDirectory,
+                                         bool using3Bit);
+
+/* Runs every job, one job per thread of the pool at a time, with each thread taking the next
+ *   job as soon as it is done with the last. runJob(job, worker) is called with the index of
+ *   the thread running it, in [0, pool.getThreadCount()), so that each thread can keep state
+ *   to reuse between its jobs. A job fails by throwing. Failures do not stop the batch: the
+ *   message of each job's exception is returned at the index of the job, and empty if it succeeded. */
+std::vector<std::string> runBatch(const std::vector<BatchJob> &jobs, ThreadPool &pool,
+                                  const std::function<void(const BatchJob &, unsigned int)> &runJob);
+
+
+#endif //DITHER_BATCH_H
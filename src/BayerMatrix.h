@@ -0,0 +1,72 @@
+#ifndef DITHER_BAYERMATRIX_H
+#define DITHER_BAYERMATRIX_H
+
+#include <array>
+#include <stdexcept>
+
+/* Builds the N x N Bayer matrix. Each level of the recursive construction
+ *   M(2n) = [[4M(n), 4M(n) + 2], [4M(n) + 3, 4M(n) + 1]] contributes one bit of x
+ *   and y, so entry (x, y) can be computed directly from the bits of x and y. */
+template<unsigned int N>
+constexpr std::array<std::array<unsigned int, N>, N> makeBayerMatrix() {
+    constexpr unsigned int offsets[2][2] = {{0, 2},
+                                            {3, 1}};
+    std::array<std::array<unsigned int, N>, N> result{};
+    for (unsigned int x = 0; x < N; x++) {
+        for (unsigned int y = 0; y < N; y++) {
+            unsigned int value = 0;
+            for (unsigned int bit = N / 2; bit > 0; bit /= 2)
+                value = (value / 4) + (offsets[(x & bit) ? 1 : 0][(y & bit) ? 1 : 0] * (N * N / 4));
+            result[x][y] = value;
+        }
+    }
+    return result;
+}
+
+/* An N x N ordered dithering matrix, generated at compile time. N must be a power of two
+ *   from 2 to 16. As N is known at compile time, wrapping coordinates is a mask and
+ *   normalising by the number of levels is a constant. */
+template<unsigned int N>
+class BayerMatrix {
+    static_assert((N >= 2) && (N <= 16) && ((N & (N - 1)) == 0), "Bayer matrices must be 2, 4, 8 or 16 wide");
+
+public:
+    static constexpr unsigned int size = N;
+    static constexpr unsigned int nLevels = N * N;
+    static constexpr unsigned int mask = N - 1;
+    static constexpr std::array<std::array<unsigned int, N>, N> values = makeBayerMatrix<N>();
+
+    // Returns the matrix entry for the pixel at x and y, in [0, N * N).
+    static constexpr unsigned int at(unsigned long int x, unsigned long int y) noexcept {
+        return values[x & mask][y & mask];
+    }
+};
+
+static_assert(BayerMatrix<4>::values[0][1] == 8 && BayerMatrix<4>::values[1][0] == 12 &&
+              BayerMatrix<4>::values[3][3] == 5, "4 x 4 matrix must match the classic Bayer matrix");
+
+/* Calls function with a BayerMatrix of the supplied size, so that the size chosen at
+ *   runtime selects a kernel specialised for it at compile time. Throws if the size is
+ *   not supported. */
+template<typename Function>
+void withBayerMatrix(unsigned int size, Function &&function) {
+    switch (size) {
+        case 2:
+            function(BayerMatrix<2>());
+            break;
+        case 4:
+            function(BayerMatrix<4>());
+            break;
+        case 8:
+            function(BayerMatrix<8>());
+            break;
+        case 16:
+            function(BayerMatrix<16>());
+            break;
+        default:
+            throw std::invalid_argument("Bayer matrices must be 2, 4, 8 or 16 wide");
+    }
+}
+
+
+#endif //DITHER_BAYERMATRIX_H
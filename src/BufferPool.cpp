@@ -0,0 +1,108 @@
+#include "BufferPool.h"
+#include <new>
+#include "DitherStats.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#define DITHER_HAS_MADVISE_HUGEPAGE 1
+#else
+#define DITHER_HAS_MADVISE_HUGEPAGE 0
+#endif
+
+std::mutex BufferPool::mutex;
+std::map<std::size_t, std::vector<void *>> BufferPool::freeBlocks;
+std::size_t BufferPool::retainedBytes = 0, BufferPool::maxRetainedBytes = 0;
+
+/* Frees the kept blocks as the program exits, and stops keeping any freed after that. Defined
+ *   after the state of the pool, so that it is destroyed before it. */
+static struct BufferPoolCleanup {
+    ~BufferPoolCleanup() {
+        BufferPool::enable(0);
+    }
+} bufferPoolCleanup;
+
+void BufferPool::enable(std::size_t maxRetainedBytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        BufferPool::maxRetainedBytes = maxRetainedBytes;
+        if (retainedBytes <= maxRetainedBytes)
+            return;
+    }
+    trim();
+}
+
+void *BufferPool::allocate(std::size_t nBytes, std::size_t &blockBytes) {
+    blockBytes = getSizeClass(nBytes);
+
+    // Reuse a kept block of the class if there is one.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto blocks = freeBlocks.find(blockBytes);
+        if ((blocks != freeBlocks.end()) && !blocks->second.empty()) {
+            void *block = blocks->second.back();
+            blocks->second.pop_back();
+            retainedBytes -= blockBytes;
+            DitherStats::countImageReuse();
+            return block;
+        }
+    }
+
+    DitherStats::countImageAllocation(blockBytes);
+    void *block = ::operator new(blockBytes, std::align_val_t(getAlignment(blockBytes)));
+#if DITHER_HAS_MADVISE_HUGEPAGE
+    // Only advice, so the block is used as it is if the kernel declines.
+    if (blockBytes >= hugePageSize)
+        madvise(block, blockBytes, MADV_HUGEPAGE);
+#endif
+    return block;
+}
+
+void BufferPool::release(void *block, std::size_t blockBytes) noexcept {
+    if (block == nullptr)
+        return;
+
+    // Keep the block if it fits under the limit. If the list can not grow, the block is freed instead.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (retainedBytes + blockBytes <= maxRetainedBytes) {
+            try {
+                freeBlocks[blockBytes].push_back(block);
+                retainedBytes += blockBytes;
+                return;
+            } catch (std::bad_alloc &e) {}
+        }
+    }
+    freeBlock(block, blockBytes);
+}
+
+void BufferPool::trim() noexcept {
+    std::map<std::size_t, std::vector<void *>> blocks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.swap(freeBlocks);
+        retainedBytes = 0;
+    }
+    for (auto &[blockBytes, classBlocks] : blocks)
+        for (void *block : classBlocks)
+            freeBlock(block, blockBytes);
+}
+
+std::size_t BufferPool::getSizeClass(std::size_t nBytes) noexcept {
+    if (nBytes <= alignment)
+        return alignment;
+
+    // Round up to a quarter of the largest power of two below nBytes.
+    std::size_t powerOfTwo = alignment;
+    while (powerOfTwo * 2 < nBytes)
+        powerOfTwo *= 2;
+    std::size_t step = powerOfTwo / 4;
+    return ((nBytes + step - 1) / step) * step;
+}
+
+std::size_t BufferPool::getAlignment(std::size_t blockBytes) noexcept {
+    return (blockBytes >= hugePageSize) ? hugePageSize : alignment;
+}
+
+void BufferPool::freeBlock(void *block, std::size_t blockBytes) noexcept {
+    ::operator delete(block, std::align_val_t(getAlignment(blockBytes)));
+}
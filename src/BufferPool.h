@@ -0,0 +1,56 @@
+#ifndef DITHER_BUFFERPOOL_H
+#define DITHER_BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/* Allocates the pixel buffers of images, each as one contiguous block aligned to a cache line,
+ *   so that the rows of an image lie end to end and SIMD loads of a row's start are aligned.
+ *   Blocks of a huge page or more are aligned to one, and on Linux the kernel is asked to back
+ *   them with huge pages, which takes far fewer page faults to fill.
+ *   Blocks are rounded up to size classes, four to each power of two. Freed blocks are kept,
+ *   up to the limit given to enable(), and handed out again for the next block of their class,
+ *   so that a batch or a server dithering image after image of similar size stops allocating.
+ *   Until enable() is called nothing is kept, and freed blocks are returned at once. Blocks
+ *   still kept when the program exits are freed then. */
+class BufferPool {
+public:
+    static constexpr std::size_t alignment = 64;
+    static constexpr std::size_t hugePageSize = std::size_t(2) << 20;
+
+    // The freed blocks kept by batch and server modes, which dither image after image.
+    static constexpr std::size_t defaultRetainedBytes = std::size_t(256) << 20;
+
+    // Keeps up to maxRetainedBytes of freed blocks for reuse, trimming any above it.
+    static void enable(std::size_t maxRetainedBytes);
+
+    /* Returns a block of at least nBytes bytes, which must be more than zero, and sets
+     *   blockBytes to its size, which must be given back to release(). The block's contents
+     *   are undefined. Throws std::bad_alloc if there is no memory for it. */
+    static void *allocate(std::size_t nBytes, std::size_t &blockBytes);
+
+    // Frees a block of blockBytes bytes from allocate(), or keeps it for reuse.
+    static void release(void *block, std::size_t blockBytes) noexcept;
+
+    // Frees every block kept for reuse.
+    static void trim() noexcept;
+
+    // Returns the size of the blocks that nBytes bytes are rounded up to.
+    static std::size_t getSizeClass(std::size_t nBytes) noexcept;
+
+private:
+    // Returns the alignment of blocks of blockBytes bytes.
+    static std::size_t getAlignment(std::size_t blockBytes) noexcept;
+
+    static void freeBlock(void *block, std::size_t blockBytes) noexcept;
+
+    static std::mutex mutex;
+    static std::map<std::size_t, std::vector<void *>> freeBlocks; // Kept blocks, by size class.
+    static std::size_t retainedBytes, maxRetainedBytes;
+};
+
+
+#endif //DITHER_BUFFERPOOL_H
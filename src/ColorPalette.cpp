@@ -1,18 +1,50 @@
 #include "ColorPalette.h"
 #include "PNG_structs.h"
+#include <algorithm>
+#include <climits>
 #include <cmath>
+#include <stdexcept>
 
-RGB_Pixel ColorPalette::getNearest(RGB_Pixel color) {
+RGB_Pixel ColorPalette::getNearest(RGB_Pixel color) const {
     if (colorpalette.empty())
         return RGB_Pixel{0, 0, 0};
 
-    RGB_Pixel result = colorpalette.at(0);
-    unsigned long int resultError = getError(color, result);
+    return colorpalette.at(getNearestIndex(color));
+}
+
+RGBA_Pixel ColorPalette::getNearest(RGBA_Pixel color) const {
+    RGB_Pixel r = getNearest(RGB_Pixel{color.red, color.green, color.blue});
+    return RGBA_Pixel{r.red, r.green, r.blue, color.alpha};
+}
+
+unsigned int ColorPalette::getNearestIndex(RGB_Pixel color) const {
+    if (!finalized)
+        throw std::logic_error("ColorPalette must be finalized before lookups");
+    if (colorpalette.empty())
+        throw std::logic_error("ColorPalette is empty");
 
-    for (const auto &thisColor : colorpalette) {
-        unsigned long int thisError = getError(thisColor, color);
+    // Colors outside of the table are compared against the whole palette.
+    if ((color.red > 0xFF) || (color.green > 0xFF) || (color.blue > 0xFF)) {
+        unsigned int result = 0;
+        unsigned long int resultError = getError(color, vibrantPalette[0]);
+        for (unsigned int i = 1; i < vibrantPalette.size(); i++) {
+            unsigned long int thisError = getError(color, vibrantPalette[i]);
+            if (thisError < resultError) {
+                result = i;
+                resultError = thisError;
+            }
+        }
+        return result;
+    }
+
+    unsigned int cell = (((color.red / cellSize) * nCellsPerChannel) + (color.green / cellSize)) * nCellsPerChannel +
+                        (color.blue / cellSize);
+    unsigned int result = candidates[cellStarts[cell]];
+    unsigned long int resultError = getError(color, vibrantPalette[result]);
+    for (uint32_t i = cellStarts[cell] + 1; i < cellStarts[cell + 1]; i++) {
+        unsigned long int thisError = getError(color, vibrantPalette[candidates[i]]);
         if (thisError < resultError) {
-            result = thisColor;
+            result = candidates[i];
             resultError = thisError;
         }
     }
@@ -20,24 +52,77 @@ RGB_Pixel ColorPalette::getNearest(RGB_Pixel color) {
     return result;
 }
 
-RGBA_Pixel ColorPalette::getNearest(RGBA_Pixel color) {
-    RGB_Pixel r = getNearest(RGB_Pixel{color.red, color.green, color.blue});
-    return RGBA_Pixel{r.red, r.green, r.blue, color.alpha};
+void ColorPalette::addColor(RGB_Pixel color) {
+    colorpalette.push_back(color);
+    finalized = false;
 }
 
+void ColorPalette::finalize() {
+    if (colorpalette.size() > UINT16_MAX + 1UL)
+        throw std::length_error("ColorPalette can hold at most 65536 colors");
 
-void ColorPalette::addColor(RGB_Pixel color) {
-    colorpalette.push_back(color);
+    vibrantPalette.clear();
+    for (const auto &thisColor : colorpalette)
+        vibrantPalette.push_back(vibrant(thisColor));
+
+    cellStarts.clear();
+    candidates.clear();
+    if (colorpalette.empty()) {
+        finalized = true;
+        return;
+    }
+
+    /* Returns the smallest and largest squared distances along one channel
+     *   between value and any value in the cell starting at low. */
+    auto channelRange = [](unsigned int value, unsigned int low, unsigned long int &minDistance,
+                           unsigned long int &maxDistance) {
+        unsigned int high = low + cellSize - 1;
+        unsigned long int toLow = (value > low) ? (value - low) : (low - value);
+        unsigned long int toHigh = (value > high) ? (value - high) : (high - value);
+        unsigned long int nearest = ((value >= low) && (value <= high)) ? 0 : std::min(toLow, toHigh);
+        unsigned long int furthest = std::max(toLow, toHigh);
+        minDistance += nearest * nearest;
+        maxDistance += furthest * furthest;
+    };
+
+    /* Every color in the cell is within bound of some palette color, where bound is the
+     *   smallest of the largest distances to the cell. A palette color whose smallest distance
+     *   to the cell exceeds bound can therefore never be nearest, and is left out. */
+    std::vector<unsigned long int> minDistances(vibrantPalette.size());
+    std::vector<unsigned long int> maxDistances(vibrantPalette.size());
+    cellStarts.reserve((nCellsPerChannel * nCellsPerChannel * nCellsPerChannel) + 1);
+    for (unsigned int r = 0; r < nCellsPerChannel; r++) {
+        for (unsigned int g = 0; g < nCellsPerChannel; g++) {
+            for (unsigned int b = 0; b < nCellsPerChannel; b++) {
+                unsigned long int bound = ULONG_MAX;
+                for (std::size_t i = 0; i < vibrantPalette.size(); i++) {
+                    const RGB_Pixel &thisColor = vibrantPalette[i];
+                    minDistances[i] = 0;
+                    maxDistances[i] = 0;
+                    channelRange(thisColor.red, r * cellSize, minDistances[i], maxDistances[i]);
+                    channelRange(thisColor.green, g * cellSize, minDistances[i], maxDistances[i]);
+                    channelRange(thisColor.blue, b * cellSize, minDistances[i], maxDistances[i]);
+                    bound = std::min(bound, maxDistances[i]);
+                }
+
+                cellStarts.push_back(candidates.size());
+                for (std::size_t i = 0; i < vibrantPalette.size(); i++) {
+                    if (minDistances[i] <= bound)
+                        candidates.push_back((uint16_t) i);
+                }
+            }
+        }
+    }
+    cellStarts.push_back(candidates.size());
+    finalized = true;
 }
 
-unsigned long int ColorPalette::getError(const RGB_Pixel &a, RGB_Pixel b) {
-    b = vibrant(b);
+// Returns the squared distance between two colors. Only ever compared, so the square root is not needed.
+unsigned long int ColorPalette::getError(const RGB_Pixel &a, const RGB_Pixel &b) {
     long int dR = (long int) a.red - (long int) b.red;
     long int dG = (long int) a.green - (long int) b.green;
     long int dB = (long int) a.blue - (long int) b.blue;
-    auto d = (unsigned long int) sqrt((dR * dR) + (dG * dG) + (dB * dB));
-    //auto d = dR + dG + dB;
-    return d;
+    return (dR * dR) + (dG * dG) + (dB * dB);
 }
 
 RGB_Pixel ColorPalette::vibrant(RGB_Pixel input) {
@@ -49,9 +134,12 @@ RGB_Pixel ColorPalette::vibrant(RGB_Pixel input) {
     else
         max = input.green;
 
+    // Black has no hue to brighten.
+    if (max == 0)
+        return input;
+
     input.red = (unsigned int)round(0xFF * ((double)input.red / max));
     input.blue = (unsigned int)round(0xFF * ((double)input.blue / max));
     input.green = (unsigned int)round(0xFF * ((double)input.green / max));
     return input;
 }
-
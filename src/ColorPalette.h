@@ -1,18 +1,47 @@
 #ifndef DITHER_COLORPALETTE_H
 #define DITHER_COLORPALETTE_H
 
+#include <cstdint>
 #include <vector>
 #include "PNG_structs.h"
 
+/* A palette of colors, matched against the vibrant version of each color. Once every
+ *   color has been added, finalize() builds a lookup table that divides the color cube
+ *   into cells and lists, for each cell, only the palette colors that can be nearest to
+ *   some color in it. Lookups then only compare against a few candidates, and give the
+ *   same result as comparing against the whole palette. */
 class ColorPalette {
 public:
-    RGB_Pixel getNearest(RGB_Pixel color);
-    RGBA_Pixel getNearest(RGBA_Pixel color);
+    /* Returns the palette color nearest to the supplied color, or black if the palette is
+     *   empty. Throws std::logic_error if a color was added since the last finalize(). */
+    [[nodiscard]] RGB_Pixel getNearest(RGB_Pixel color) const;
+
+    [[nodiscard]] RGBA_Pixel getNearest(RGBA_Pixel color) const;
+
+    /* Returns the index of the palette color nearest to the supplied color. The palette
+     *   must not be empty. Throws std::logic_error if a color was added since the last finalize(). */
+    [[nodiscard]] unsigned int getNearestIndex(RGB_Pixel color) const;
+
     void addColor(RGB_Pixel color);
 
+    // Builds the lookup table. Must be called after the last color is added.
+    void finalize();
+
 private:
+    // Cells per channel of the lookup table. Each cell covers cellSize 8 bit values.
+    static const unsigned int nCellsPerChannel = 32;
+    static const unsigned int cellSize = 256 / nCellsPerChannel;
+
     std::vector<RGB_Pixel> colorpalette;
-    static unsigned long int getError(const RGB_Pixel &a, RGB_Pixel b);
+    std::vector<RGB_Pixel> vibrantPalette; // vibrant() of each color, which is what lookups compare against.
+    bool finalized = true;
+
+    /* For each cell, candidates[cellStarts[cell]] to candidates[cellStarts[cell + 1]] are the
+     *   indices of the colors that may be nearest to a color in the cell, in palette order. */
+    std::vector<uint32_t> cellStarts;
+    std::vector<uint16_t> candidates;
+
+    static unsigned long int getError(const RGB_Pixel &a, const RGB_Pixel &b);
     static RGB_Pixel vibrant(RGB_Pixel);
 };
 
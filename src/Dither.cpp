@@ -0,0 +1,174 @@
+#include "Dither.h"
+#include <mutex>
+
+const std::vector<RGB_Pixel> &get3BitPalette() {
+    static const std::vector<RGB_Pixel> palette = {
+            {0x00, 0x00, 0x00}, {0x00, 0x00, 0xFF}, {0x00, 0xFF, 0x00}, {0x00, 0xFF, 0xFF},
+            {0xFF, 0x00, 0x00}, {0xFF, 0x00, 0xFF}, {0xFF, 0xFF, 0x00}, {0xFF, 0xFF, 0xFF},
+    };
+    return palette;
+}
+
+void rawRowTo3BitIndices(const png_byte *input, uint8_t *output, unsigned long int width,
+                         unsigned int nBytesPerColor) {
+    if (nBytesPerColor == 1) {
+        for (unsigned long int x = 0; x < width; x++, input += 3)
+            output[x] = (uint8_t) (((input[0] != 0) << 2U) | ((input[1] != 0) << 1U) | (input[2] != 0));
+    } else {
+        // Only the most significant byte is checked, as a channel is either 0 or fully on.
+        for (unsigned long int x = 0; x < width; x++, input += 6)
+            output[x] = (uint8_t) (((input[0] != 0) << 2U) | ((input[2] != 0) << 1U) | (input[4] != 0));
+    }
+}
+
+template<typename Channel>
+std::optional<PNG_Indexed> toIndexedWithAlpha(const BasicPNG_RGBA<Channel> &input, ThreadPool &pool) {
+    DitherStats::Timer timer(DitherStage::conversion);
+    unsigned long int width = input.getInfo().width;
+    unsigned long int height = input.getInfo().height;
+    bool using16Bit = input.getInfo().colorDepth == 16;
+
+    /* Each pair of 8 bit alpha and 3 bit color has a key of (alpha << 3) | color. Fully
+     *   transparent pixels all have the key 0. Keys in ascending order are in ascending order of
+     *   alpha, so palette entries made in that order leave every opaque entry at the end, and
+     *   the tRNS chunk need only cover those before them. */
+    const unsigned int nKeys = 256 << 3U;
+    auto toKey = [&](const BasicRGBA_Pixel<Channel> &pixel, bool &fits) -> unsigned int {
+        unsigned int alpha = pixel.alpha;
+        if (using16Bit) {
+            fits = fits && ((alpha % 257) == 0);
+            alpha /= 257;
+        }
+        if (alpha == 0)
+            return 0;
+        unsigned int color = ((pixel.red != 0) << 2U) | ((pixel.green != 0) << 1U) | (pixel.blue != 0);
+        return (alpha << 3U) | color;
+    };
+
+    // Find the keys used by each band of rows, then merge them.
+    std::vector<bool> used(nKeys, false);
+    bool fits = true;
+    std::mutex usedMutex;
+    pool.parallelFor(0, height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+        std::vector<bool> bandUsed(nKeys, false);
+        bool bandFits = true;
+        for (unsigned long int y = firstRow; (y < lastRow) && bandFits; y++) {
+            const BasicRGBA_Pixel<Channel> *row = input.getRow(y);
+            for (unsigned long int x = 0; x < width; x++)
+                bandUsed[toKey(row[x], bandFits)] = true;
+        }
+        std::lock_guard<std::mutex> lock(usedMutex);
+        fits = fits && bandFits;
+        for (unsigned int key = 0; key < nKeys; key++)
+            used[key] = used[key] || bandUsed[key];
+    });
+    if (!fits)
+        return std::nullopt;
+
+    std::vector<RGB_Pixel> palette;
+    std::vector<uint8_t> alphas;
+    std::vector<uint8_t> indices(nKeys, 0);
+    for (unsigned int key = 0; key < nKeys; key++) {
+        if (!used[key])
+            continue;
+        if (palette.size() == 256)
+            return std::nullopt;
+        indices[key] = (uint8_t) palette.size();
+        palette.push_back(get3BitPalette().at(key & 7U));
+        if ((key >> 3U) < 255)
+            alphas.push_back((uint8_t) (key >> 3U));
+    }
+
+    PNG_Indexed resultPNG(width, height, palette, alphas);
+    pool.parallelFor(0, height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+        bool unused = true;
+        for (unsigned long int y = firstRow; y < lastRow; y++) {
+            const BasicRGBA_Pixel<Channel> *row = input.getRow(y);
+            uint8_t *output = resultPNG.getRow(y);
+            for (unsigned long int x = 0; x < width; x++)
+                output[x] = indices[toKey(row[x], unused)];
+        }
+    });
+    return resultPNG;
+}
+
+template<typename Channel>
+void diffuseRGBAInPlace(ImageView<BasicRGBA_Pixel<Channel>> image, const DiffusionKernel &kernel, bool serpentine,
+                        unsigned int maxValue, bool keepAlpha, ThreadPool &pool) {
+    unsigned long int width = image.getWidth();
+    ErrorDiffuser diffuser(kernel, width, 3, maxValue, maxValue, serpentine, 4);
+    static_assert(sizeof(BasicRGBA_Pixel<Channel>) == 4 * sizeof(Channel), "Pixels must be 4 packed channels");
+    auto row = [&](unsigned long int y) { return reinterpret_cast<Channel *>(image.getRow(y)); };
+
+    // Alpha is thresholded once the colors of its row are done, while the row is still in the cache.
+    std::function<void(unsigned long int)> finishRow = nullptr;
+    unsigned int alphaThreshold = maxValue / 2;
+    if (!keepAlpha) {
+        finishRow = [&](unsigned long int y) {
+            BasicRGBA_Pixel<Channel> *pixels = image.getRow(y);
+            for (unsigned long int x = 0; x < width; x++)
+                pixels[x].alpha = (Channel) ((pixels[x].alpha > alphaThreshold) ? maxValue : 0);
+        };
+    }
+    diffuser.processImage<Channel>(image.getHeight(), row, row, pool, finishRow);
+}
+
+template std::optional<PNG_Indexed> toIndexedWithAlpha(const PNG_RGBA &, ThreadPool &);
+template std::optional<PNG_Indexed> toIndexedWithAlpha(const PNG_RGBA8 &, ThreadPool &);
+template std::optional<PNG_Indexed> toIndexedWithAlpha(const PNG_RGBA16 &, ThreadPool &);
+template void diffuseRGBAInPlace(ImageView<RGBA_Pixel>, const DiffusionKernel &, bool, unsigned int, bool,
+                                 ThreadPool &);
+template void diffuseRGBAInPlace(ImageView<RGBA8_Pixel>, const DiffusionKernel &, bool, unsigned int, bool,
+                                 ThreadPool &);
+template void diffuseRGBAInPlace(ImageView<RGBA16_Pixel>, const DiffusionKernel &, bool, unsigned int, bool,
+                                 ThreadPool &);
+
+void streamDiffuse(PNG_Decoder &decoder, const PNG_Destination &output, bool using3Bit,
+                   const DiffusionKernel &kernel, bool serpentine, const PNG_Compression &compression) {
+    PNG_Info info = decoder.getInfo();
+    if (info.numberOfPasses > 1)
+        throw InterlacedPNG();
+    unsigned int maxValue = pow(2, info.colorDepth) - 1;
+
+    if (using3Bit) {
+        std::vector<RGB_Pixel> inputRow(info.width);
+        PNG_Encoder encoder(output, info.width, info.height, get3BitPalette(), compression);
+        ErrorDiffuser diffuser(kernel, info.width, 3, maxValue, maxValue, serpentine);
+        std::vector<uint8_t> indices(info.width);
+        for (png_uint_32 y = 0; y < info.height; y++) {
+            decoder.readRow(inputRow.data());
+            {
+                DitherStats::Timer timer(DitherStage::dither);
+                auto samples = reinterpret_cast<unsigned int *>(inputRow.data());
+                diffuser.processRow(samples, samples);
+            }
+            {
+                DitherStats::Timer timer(DitherStage::conversion);
+                rowTo3BitIndices(inputRow.data(), indices.data(), info.width);
+            }
+            encoder.writeRow(indices.data());
+        }
+        encoder.finish();
+    } else {
+        unsigned int bitDepth = 1;
+        unsigned int onColor = pow(2, bitDepth) - 1;
+        PNG_Encoder encoder(output, info.width, info.height, bitDepth, PNG_ColorType::grayscale, compression);
+        ErrorDiffuser diffuser(kernel, info.width, 1, maxValue, onColor, serpentine);
+        unsigned int nChannels = (info.colorType == PNG_ColorType::grayscale) ? 1 : 3;
+        std::vector<png_byte> inputRow(decoder.getRowBytes());
+        std::vector<GreyPixel> outputRow(info.width);
+        for (png_uint_32 y = 0; y < info.height; y++) {
+            decoder.readRawRow(inputRow.data());
+            {
+                DitherStats::Timer timer(DitherStage::conversion);
+                LumaKernel::rawRowToGrey(inputRow.data(), outputRow.data(), info.width, nChannels, info.colorDepth / 8);
+            }
+            {
+                DitherStats::Timer timer(DitherStage::dither);
+                diffuser.processRow<GreyPixel>(outputRow.data(), outputRow.data());
+            }
+            encoder.writeRow(outputRow.data());
+        }
+        encoder.finish();
+    }
+}
@@ -0,0 +1,339 @@
+#ifndef DITHER_DITHER_H
+#define DITHER_DITHER_H
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <cmath>
+#include "BayerMatrix.h"
+#include "DitherStats.h"
+#include "ErrorDiffusion.h"
+#include "ImageView.h"
+#include "LevelKernel.h"
+#include "LumaKernel.h"
+#include "PNG_RGB.h"
+#include "PNG_RGBA.h"
+#include "PNG_Grey.h"
+#include "PNG_Indexed.h"
+#include "PNG_Decoder.h"
+#include "PNG_Encoder.h"
+#include "PNG_structs.h"
+#include "PlanarRGB.h"
+#include "ThreadPool.h"
+#include "ThresholdKernel.h"
+
+/* Converts a color pixel to greyscale.
+ *   Colors are weighted by luminosity, in fixed point, as LumaKernel does */
+template<typename T>
+T pixelToGrey(T red, T blue, T green) {
+    return (T) LumaKernel::toGrey(red, green, blue);
+}
+
+// Converts a row of color pixels to greyscale.
+template<typename Channel>
+void rowToGrey(const BasicRGB_Pixel<Channel> *input, GreyPixel *output, unsigned long int width) {
+    for (unsigned long int x = 0; x < width; x++)
+        output[x] = pixelToGrey<GreyPixel>(input[x].red, input[x].blue, input[x].green);
+}
+
+// Converts a row of RGBA pixels to greyscale, ignoring their alpha.
+template<typename Channel>
+void rowToGrey(const BasicRGBA_Pixel<Channel> *input, GreyPixel *output, unsigned long int width) {
+    for (unsigned long int x = 0; x < width; x++)
+        output[x] = pixelToGrey<GreyPixel>(input[x].red, input[x].blue, input[x].green);
+}
+
+// Rows of RGB8_Pixel are laid out as raw LibPNG rows, so they are converted by LumaKernel's vector kernels.
+inline void rowToGrey(const RGB8_Pixel *input, GreyPixel *output, unsigned long int width) {
+    LumaKernel::rawRowToGrey(reinterpret_cast<png_const_bytep>(input), output, width, 3, 1);
+}
+
+/* Returns the palette of 3 bit output. Each channel is either black or fully on,
+ *   and the index of a color is (red << 2) | (green << 1) | blue. */
+const std::vector<RGB_Pixel> &get3BitPalette();
+
+// Converts a row of 3 bit color pixels, each channel either 0 or fully on, to palette indices.
+template<typename Channel>
+void rowTo3BitIndices(const BasicRGB_Pixel<Channel> *input, uint8_t *output, unsigned long int width) {
+    for (unsigned long int x = 0; x < width; x++)
+        output[x] = (uint8_t) (((input[x].red != 0) << 2U) | ((input[x].green != 0) << 1U) | (input[x].blue != 0));
+}
+
+// Converts a raw LibPNG row of 3 bit color pixels to palette indices.
+void rawRowTo3BitIndices(const png_byte *input, uint8_t *output, unsigned long int width,
+                         unsigned int nBytesPerColor);
+
+// Converts a 3 bit color image to an indexed image. The rows are split into bands across the threads of the pool.
+template<typename Pixel>
+PNG_Indexed to3BitIndexed(ImageView<Pixel> input, ThreadPool &pool) {
+    DitherStats::Timer timer(DitherStage::conversion);
+    PNG_Indexed resultPNG(input.getWidth(), input.getHeight(), get3BitPalette());
+    unsigned long int width = resultPNG.getInfo().width;
+    pool.parallelFor(0, resultPNG.getInfo().height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+        for (unsigned long int y = firstRow; y < lastRow; y++)
+            rowTo3BitIndices(input.getRow(y), resultPNG.getRow(y), width);
+    });
+
+    return resultPNG;
+}
+
+template<typename Channel>
+PNG_Indexed to3BitIndexed(const BasicPNG_RGB<Channel> &input, ThreadPool &pool) {
+    return to3BitIndexed(input.view(), pool);
+}
+
+/* Converts a 3 bit color RGBA image to an indexed image, with a tRNS chunk holding the alphas
+ *   of its palette. Every fully transparent pixel shares a single entry, whatever its color.
+ *   Returns nothing if the image has more than 256 pairs of color and alpha, or 16 bit alphas
+ *   that do not fit in 8 bits, in which case it can only be written as RGBA. */
+template<typename Channel>
+std::optional<PNG_Indexed> toIndexedWithAlpha(const BasicPNG_RGBA<Channel> &input, ThreadPool &pool);
+
+/* Dithers each channel of the image to either black or maxValue in place, using an N x N
+ *   Bayer matrix. The rows are split into bands across the threads of the pool. */
+template<unsigned int N, typename Channel>
+void bayerRGBInPlace(ImageView<BasicRGB_Pixel<Channel>> image, BayerMatrix<N> map, unsigned int maxValue,
+                     ThreadPool &pool) {
+    ThresholdKernel kernel(map, maxValue, maxValue, 3);
+    unsigned long int width = image.getWidth();
+
+    /* Scan through every pixel in the image. Each output pixel depends only on the input
+     *   pixel at the same location, so bands of rows can be processed independently. Every
+     *   channel that exceeds its threshold is filled in, the others become black. */
+    pool.parallelFor(0, image.getHeight(), [&](unsigned long int firstRow, unsigned long int lastRow) {
+        for (png_uint_32 y = firstRow; y < lastRow; y++) {
+            static_assert(sizeof(BasicRGB_Pixel<Channel>) == 3 * sizeof(Channel), "Pixels must be 3 packed channels");
+            auto row = reinterpret_cast<Channel *>(image.getRow(y));
+            kernel.applyToRow(row, row, 3 * width, y);
+        }
+    });
+}
+
+template<unsigned int N, typename Channel>
+void bayerRGBInPlace(BasicPNG_RGB<Channel> &image, BayerMatrix<N> map, unsigned int maxValue, ThreadPool &pool) {
+    bayerRGBInPlace(image.view(), map, maxValue, pool);
+}
+
+// As bayerRGBInPlace, but leaves the input untouched and returns the result as a new image.
+template<unsigned int N, typename Channel>
+BasicPNG_RGB<Channel> bayerRGB(const BasicPNG_RGB<Channel> &input, BayerMatrix<N> map, unsigned int maxValue,
+                               ThreadPool &pool) {
+    BasicPNG_RGB<Channel> resultPNG = input;
+    bayerRGBInPlace(resultPNG, map, maxValue, pool);
+    return resultPNG;
+}
+
+/* Dithers the colors of the RGBA image to either black or maxValue in place, using an N x N
+ *   Bayer matrix. If keepAlpha is set, alpha is left as it is, and otherwise every pixel is made
+ *   either transparent or opaque. Each row is dithered in a single pass over its samples, alpha
+ *   included. The rows are split into bands across the threads of the pool. */
+template<unsigned int N, typename Channel>
+void bayerRGBAInPlace(ImageView<BasicRGBA_Pixel<Channel>> image, BayerMatrix<N> map, unsigned int maxValue,
+                      bool keepAlpha, ThreadPool &pool) {
+    ThresholdKernel kernel = ThresholdKernel::forRGBA(map, maxValue, keepAlpha);
+    unsigned long int width = image.getWidth();
+    pool.parallelFor(0, image.getHeight(), [&](unsigned long int firstRow, unsigned long int lastRow) {
+        for (png_uint_32 y = firstRow; y < lastRow; y++) {
+            static_assert(sizeof(BasicRGBA_Pixel<Channel>) == 4 * sizeof(Channel), "Pixels must be 4 packed channels");
+            auto row = reinterpret_cast<Channel *>(image.getRow(y));
+            kernel.applyToRow(row, row, 4 * width, y);
+        }
+    });
+}
+
+template<unsigned int N, typename Channel>
+void bayerRGBAInPlace(BasicPNG_RGBA<Channel> &image, BayerMatrix<N> map, unsigned int maxValue, bool keepAlpha,
+                      ThreadPool &pool) {
+    bayerRGBAInPlace(image.view(), map, maxValue, keepAlpha, pool);
+}
+
+/* Dithers the image, RGB or RGBA, to greyscale of bitDepth bits(1, 2, 4 or 8), using an N x N
+ *   Bayer matrix. The rows are split into bands across the threads of the pool. */
+template<unsigned int N, typename Pixel>
+PNG_Grey bayerGrey(ImageView<Pixel> input, BayerMatrix<N> map, unsigned int maxValue, ThreadPool &pool,
+                   unsigned int bitDepth = 1) {
+    PNG_Grey resultPNG = PNG_Grey(input.getWidth(), input.getHeight(), bitDepth);
+
+    LevelKernel kernel(map, maxValue, bitDepth);
+    unsigned long int width = resultPNG.getInfo().width;
+
+    /* Scan through every pixel in the image, in bands of rows split across the threads. Pixels
+     *   are converted to greyscale, then dithered straight into the packed rows of the output. */
+    pool.parallelFor(0, resultPNG.getInfo().height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+        std::vector<GreyPixel> greyRow(width);
+        for (png_uint_32 y = firstRow; y < lastRow; y++) {
+            rowToGrey(input.getRow(y), greyRow.data(), width);
+            kernel.applyToRow(greyRow.data(), resultPNG.getRow(y), width, y);
+        }
+    });
+
+    return resultPNG;
+}
+
+template<unsigned int N, typename Format, typename Channel>
+PNG_Grey bayerGrey(const Image<Format, Channel> &input, BayerMatrix<N> map, unsigned int maxValue, ThreadPool &pool,
+                   unsigned int bitDepth = 1) {
+    return bayerGrey(input.view(), map, maxValue, pool, bitDepth);
+}
+
+/* Dithers each channel of the image to either black or maxValue in place, by error diffusion
+ *   with the supplied kernel. The rows are processed as a wavefront across the threads of the
+ *   pool. A serpentine scan can not be split into a wavefront, so the image is split into
+ *   planes instead, and each channel is diffused on a thread of its own. */
+template<typename Channel>
+void diffuseRGBInPlace(ImageView<BasicRGB_Pixel<Channel>> image, const DiffusionKernel &kernel, bool serpentine,
+                       unsigned int maxValue, ThreadPool &pool) {
+    unsigned long int width = image.getWidth();
+    unsigned long int height = image.getHeight();
+    if (serpentine && (pool.getThreadCount() > 1)) {
+        PlanarRGB<Channel> planes(image, pool);
+        pool.parallelFor(0, PlanarRGB<Channel>::nPlanes, [&](unsigned long int first, unsigned long int last) {
+            ThreadPool serial(1);
+            for (unsigned long int channel = first; channel < last; channel++) {
+                ErrorDiffuser diffuser(kernel, width, 1, maxValue, maxValue, serpentine);
+                auto row = [&](unsigned long int y) { return planes.getRow(channel, y); };
+                diffuser.processImage<Channel>(height, row, row, serial);
+            }
+        });
+        planes.interleaveInto(image, pool);
+        return;
+    }
+
+    ErrorDiffuser diffuser(kernel, width, 3, maxValue, maxValue, serpentine);
+    static_assert(sizeof(BasicRGB_Pixel<Channel>) == 3 * sizeof(Channel), "Pixels must be 3 packed channels");
+    auto row = [&](unsigned long int y) { return reinterpret_cast<Channel *>(image.getRow(y)); };
+    diffuser.processImage<Channel>(height, row, row, pool);
+}
+
+template<typename Channel>
+void diffuseRGBInPlace(BasicPNG_RGB<Channel> &image, const DiffusionKernel &kernel, bool serpentine,
+                       unsigned int maxValue, ThreadPool &pool) {
+    diffuseRGBInPlace(image.view(), kernel, serpentine, maxValue, pool);
+}
+
+// As diffuseRGBInPlace, but leaves the input untouched and returns the result as a new image.
+template<typename Channel>
+BasicPNG_RGB<Channel> diffuseRGB(const BasicPNG_RGB<Channel> &input, const DiffusionKernel &kernel, bool serpentine,
+                                 unsigned int maxValue, ThreadPool &pool) {
+    BasicPNG_RGB<Channel> resultPNG = input;
+    diffuseRGBInPlace(resultPNG, kernel, serpentine, maxValue, pool);
+    return resultPNG;
+}
+
+/* Dithers the colors of the RGBA image to either black or maxValue in place, by error diffusion
+ *   with the supplied kernel, and its alpha as bayerRGBAInPlace does. Only the colors are
+ *   diffused. The rows are processed as a wavefront across the threads of the pool, unless
+ *   the scan is serpentine. */
+template<typename Channel>
+void diffuseRGBAInPlace(ImageView<BasicRGBA_Pixel<Channel>> image, const DiffusionKernel &kernel, bool serpentine,
+                        unsigned int maxValue, bool keepAlpha, ThreadPool &pool);
+
+template<typename Channel>
+void diffuseRGBAInPlace(BasicPNG_RGBA<Channel> &image, const DiffusionKernel &kernel, bool serpentine,
+                        unsigned int maxValue, bool keepAlpha, ThreadPool &pool) {
+    diffuseRGBAInPlace(image.view(), kernel, serpentine, maxValue, keepAlpha, pool);
+}
+
+/* Dithers the image, RGB or RGBA, to 1 bit greyscale by error diffusion with the supplied
+ *   kernel. The rows are processed as a wavefront across the threads of the pool. */
+template<typename Pixel>
+PNG_Grey diffuseGrey(ImageView<Pixel> input, const DiffusionKernel &kernel, bool serpentine,
+                     unsigned int maxValue, ThreadPool &pool) {
+    unsigned int bitDepth = 1;
+    unsigned int onColor = pow(2, bitDepth) - 1;
+    PNG_Grey resultPNG = PNG_Grey(input.getWidth(), input.getHeight(), bitDepth);
+    unsigned long int width = resultPNG.getInfo().width;
+    ErrorDiffuser diffuser(kernel, width, 1, maxValue, onColor, serpentine);
+
+    /* Each row is converted to greyscale just before it is diffused, diffused in place, then
+     *   packed into the output. Only the rows in progress need a scratch row of their own. */
+    unsigned int nScratchRows = pool.getThreadCount();
+    std::vector<GreyPixel> scratch((std::size_t) nScratchRows * width);
+    auto scratchRow = [&](unsigned long int y) { return scratch.data() + ((y % nScratchRows) * width); };
+    diffuser.processImage<GreyPixel>(resultPNG.getInfo().height,
+                                     [&](unsigned long int y) {
+                                         rowToGrey(input.getRow(y), scratchRow(y), width);
+                                         return (const GreyPixel *) scratchRow(y);
+                                     },
+                                     scratchRow, pool,
+                                     [&](unsigned long int y) { resultPNG.setRow(y, scratchRow(y)); });
+
+    return resultPNG;
+}
+
+template<typename Format, typename Channel>
+PNG_Grey diffuseGrey(const Image<Format, Channel> &input, const DiffusionKernel &kernel, bool serpentine,
+                     unsigned int maxValue, ThreadPool &pool) {
+    return diffuseGrey(input.view(), kernel, serpentine, maxValue, pool);
+}
+
+/* Dithers the image open in the decoder one row at a time. Only the current input and output
+ *   rows are held in memory, so the memory used depends on the width of the image, but not on
+ *   its height. The decoder must have been opened to decode RGB and have had no rows read. For
+ *   greyscale output, it may instead be opened with LumaKernel::transformToGreyOrRGB, so that
+ *   greyscale images are read without being converted. Greyscale output has greyDepth bits.
+ *   The result is written to the output, which may be a file, standard output or a buffer,
+ *   with the supplied compression. Throws InterlacedPNG, before creating the output, if the
+ *   image is interlaced. */
+template<unsigned int N>
+void streamDither(PNG_Decoder &decoder, const PNG_Destination &output, bool using3Bit, BayerMatrix<N> map,
+                  const PNG_Compression &compression = {}, unsigned int greyDepth = 1) {
+    PNG_Info info = decoder.getInfo();
+    if (info.numberOfPasses > 1)
+        throw InterlacedPNG();
+    unsigned int maxValue = pow(2, info.colorDepth) - 1;
+
+    if (using3Bit) {
+        /* The raw LibPNG rows are thresholded in place without unpacking them,
+         *   then written as indices into the 8 color palette. */
+        PNG_Encoder encoder(output, info.width, info.height, get3BitPalette(), compression);
+        ThresholdKernel kernel(map, maxValue, maxValue, 3);
+        std::vector<png_byte> row(decoder.getRowBytes());
+        std::vector<uint8_t> indices(info.width);
+        for (png_uint_32 y = 0; y < info.height; y++) {
+            decoder.readRawRow(row.data());
+            {
+                DitherStats::Timer timer(DitherStage::dither);
+                if (info.colorDepth == 16)
+                    kernel.applyToRow16BE(row.data(), row.data(), 3 * info.width, y);
+                else
+                    kernel.applyToRow(row.data(), row.data(), 3 * info.width, y);
+            }
+            {
+                DitherStats::Timer timer(DitherStage::conversion);
+                rawRowTo3BitIndices(row.data(), indices.data(), info.width, info.colorDepth / 8);
+            }
+            encoder.writeRow(indices.data());
+        }
+        encoder.finish();
+    } else {
+        PNG_Encoder encoder(output, info.width, info.height, greyDepth, PNG_ColorType::grayscale, compression);
+        LevelKernel kernel(map, maxValue, greyDepth);
+        unsigned int nChannels = (info.colorType == PNG_ColorType::grayscale) ? 1 : 3;
+        std::vector<png_byte> inputRow(decoder.getRowBytes());
+        std::vector<GreyPixel> greyRow(info.width);
+        std::vector<png_byte> outputRow(encoder.getRowBytes());
+        for (png_uint_32 y = 0; y < info.height; y++) {
+            decoder.readRawRow(inputRow.data());
+            {
+                DitherStats::Timer timer(DitherStage::conversion);
+                LumaKernel::rawRowToGrey(inputRow.data(), greyRow.data(), info.width, nChannels, info.colorDepth / 8);
+            }
+            {
+                DitherStats::Timer timer(DitherStage::dither);
+                kernel.applyToRow(greyRow.data(), outputRow.data(), info.width, y);
+            }
+            encoder.writeRawRow(outputRow.data());
+        }
+        encoder.finish();
+    }
+}
+
+/* Dithers the image open in the decoder by error diffusion one row at a time. Only the current
+ *   input and output rows and the error rows that the kernel reaches are held in memory. The
+ *   decoder is used as by streamDither. */
+void streamDiffuse(PNG_Decoder &decoder, const PNG_Destination &output, bool using3Bit,
+                   const DiffusionKernel &kernel, bool serpentine, const PNG_Compression &compression = {});
+
+
+#endif //DITHER_DITHER_H
@@ -0,0 +1,384 @@
+#include "DitherServer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "PNG_structs.h"
+#include "ThreadPool.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define DITHER_HAS_UNIX_SOCKETS 1
+#else
+#define DITHER_HAS_UNIX_SOCKETS 0
+#endif
+
+DitherServer::DitherServer(std::string socketPath, const DitherSettings &settings, bool using3Bit,
+                           unsigned int nThreads, unsigned int concurrency, unsigned int queueLength)
+        : socketPath(std::move(socketPath)), settings(settings), using3Bit(using3Bit),
+          nThreads(std::max(nThreads, 1U)), concurrency(std::max(concurrency, 1U)),
+          queueLength(std::max(queueLength, 1U)) {}
+
+void DitherServer::parseRequestOptions(const std::string &options, DitherSettings &settings, bool &using3Bit) {
+    // As on the command line, explicit compression settings override those of the profile, wherever they are given.
+    PNG_Compression overrides;
+    bool alphaSet = false;
+    std::istringstream tokens(options);
+    std::string option;
+    auto getArgument = [&]() {
+        std::string argument;
+        if (!(tokens >> argument) || (argument.at(0) == '-'))
+            throw std::invalid_argument("Operation \"" + option + "\" requires argument");
+        return argument;
+    };
+
+    while (tokens >> option) {
+        if (option == "-m") {
+            std::string argument = getArgument();
+            if ((argument != "3bit") && (argument != "greyscale"))
+                throw std::invalid_argument('\"' + argument + "\" not recognized as a valid mode");
+            using3Bit = argument == "3bit";
+        } else if (option == "-d") {
+            std::string argument = getArgument();
+            try {
+                settings.diffusionKernel = (argument == "bayer") ? nullptr : &DiffusionKernel::fromName(argument);
+            } catch (std::invalid_argument &e) {
+                throw std::invalid_argument('\"' + argument + "\" not recognized as an algorithm");
+            }
+        } else if (option == "--matrix") {
+            std::string argument = getArgument();
+            if ((argument != "2") && (argument != "4") && (argument != "8") && (argument != "16"))
+                throw std::invalid_argument('\"' + argument + "\" is not a valid matrix size");
+            settings.matrixSize = std::stoul(argument);
+        } else if (option == "--depth") {
+            std::string argument = getArgument();
+            if ((argument != "1") && (argument != "2") && (argument != "4") && (argument != "8"))
+                throw std::invalid_argument('\"' + argument + "\" is not a valid grey depth");
+            settings.greyDepth = std::stoul(argument);
+        } else if (option == "--alpha") {
+            std::string argument = getArgument();
+            if (argument == "keep")
+                settings.alpha = AlphaMode::keep;
+            else if (argument == "threshold")
+                settings.alpha = AlphaMode::threshold;
+            else
+                throw std::invalid_argument('\"' + argument + "\" is not a valid alpha mode");
+            alphaSet = true;
+        } else if (option == "--crop") {
+            settings.geometry.parseCrop(getArgument());
+        } else if (option == "--resize") {
+            settings.geometry.parseSize(getArgument());
+        } else if (option == "--serpentine") {
+            settings.serpentine = true;
+        } else if (option == "--compression") {
+            settings.compression = PNG_Compression::fromProfile(getArgument());
+        } else if (option == "--compression-level") {
+            std::string argument = getArgument();
+            if ((argument.size() != 1) || (argument.find_first_not_of("0123456789") != std::string::npos))
+                throw std::invalid_argument('\"' + argument + "\" is not a valid compression level");
+            overrides.level = std::stoi(argument);
+        } else if (option == "--compression-strategy") {
+            overrides.strategy = PNG_Compression::parseStrategy(getArgument());
+        } else if (option == "--compression-filter") {
+            overrides.filters = PNG_Compression::parseFilters(getArgument());
+        } else
+            throw std::invalid_argument('\"' + option + "\" is not a valid request option");
+    }
+
+    // As on the command line, greyscale output has no alpha to keep.
+    if (alphaSet && !using3Bit)
+        throw std::invalid_argument("Operation \"--alpha\" requires 3bit mode");
+
+    if (overrides.level != PNG_Compression::useLibPNGDefault)
+        settings.compression.level = overrides.level;
+    if (overrides.strategy != PNG_Compression::useLibPNGDefault)
+        settings.compression.strategy = overrides.strategy;
+    if (overrides.filters != PNG_Compression::useLibPNGDefault)
+        settings.compression.filters = overrides.filters;
+}
+
+#if DITHER_HAS_UNIX_SOCKETS
+
+/* Becomes readable once the process is asked to stop, and stays readable, so that every thread
+ *   waiting on a socket can also wait on it. Writing to a pipe is safe in a signal handler. */
+static int stopPipe[2] = {-1, -1};
+
+static void requestStop(int) {
+    char byte = 1;
+    (void) !write(stopPipe[1], &byte, 1);
+}
+
+// Returns true if the process has been asked to stop.
+static bool isStopRequested() {
+    pollfd stopFD{stopPipe[0], POLLIN, 0};
+    return poll(&stopFD, 1, 0) > 0;
+}
+
+// Reads exactly size bytes. Returns false if the connection was closed, failed or timed out first.
+static bool readFully(int connection, void *data, std::size_t size) {
+    auto bytes = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t nRead = read(connection, bytes, size);
+        if ((nRead < 0) && (errno == EINTR))
+            continue;
+        if (nRead <= 0)
+            return false;
+        bytes += nRead;
+        size -= nRead;
+    }
+    return true;
+}
+
+// Writes exactly size bytes. Returns false if the connection was closed, failed or timed out first.
+static bool writeFully(int connection, const void *data, std::size_t size) {
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t nWritten = write(connection, bytes, size);
+        if ((nWritten < 0) && (errno == EINTR))
+            continue;
+        if (nWritten <= 0)
+            return false;
+        bytes += nWritten;
+        size -= nWritten;
+    }
+    return true;
+}
+
+static bool readLength(int connection, std::uint32_t &length) {
+    unsigned char bytes[4];
+    if (!readFully(connection, bytes, sizeof(bytes)))
+        return false;
+    length = ((std::uint32_t) bytes[0] << 24U) | ((std::uint32_t) bytes[1] << 16U) |
+             ((std::uint32_t) bytes[2] << 8U) | bytes[3];
+    return true;
+}
+
+static bool writeResponse(int connection, unsigned char status, const void *data, std::size_t size) {
+    auto length = (std::uint32_t) size;
+    unsigned char header[5] = {status, (unsigned char) (length >> 24U), (unsigned char) (length >> 16U),
+                               (unsigned char) (length >> 8U), (unsigned char) length};
+    return writeFully(connection, header, sizeof(header)) && writeFully(connection, data, size);
+}
+
+// Returns true if a server is listening on the socket at the address.
+static bool isListening(const sockaddr_un &address) {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+        return false;
+    bool listening = connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+    close(probe);
+    return listening;
+}
+
+// Creates a socket listening at the path, replacing a stale socket left there. Throws BadPath if it can not.
+static int listenAt(const std::string &socketPath, unsigned int queueLength) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || (socketPath.size() >= sizeof(address.sun_path)))
+        throw BadPath();
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    int listeningSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listeningSocket < 0)
+        throw BadPath();
+    auto bindSocket = [&]() {
+        return bind(listeningSocket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+    };
+    bool bound = bindSocket();
+    struct stat status{};
+    if (!bound && (errno == EADDRINUSE) && (lstat(socketPath.c_str(), &status) == 0) && S_ISSOCK(status.st_mode) &&
+        !isListening(address)) {
+        unlink(socketPath.c_str());
+        bound = bindSocket();
+    }
+    if (!bound || (listen(listeningSocket, (int) queueLength) != 0)) {
+        close(listeningSocket);
+        throw BadPath();
+    }
+    return listeningSocket;
+}
+
+void DitherServer::run() {
+    int listeningSocket = listenAt(socketPath, queueLength);
+    if (pipe(stopPipe) != 0) {
+        close(listeningSocket);
+        unlink(socketPath.c_str());
+        throw BadPath();
+    }
+
+    // Stop on SIGINT and SIGTERM, and report closed connections as failed writes rather than dying of SIGPIPE.
+    struct sigaction stopAction{}, ignoreAction{}, oldInterruptAction{}, oldTerminateAction{}, oldPipeAction{};
+    stopAction.sa_handler = requestStop;
+    sigemptyset(&stopAction.sa_mask);
+    ignoreAction.sa_handler = SIG_IGN;
+    sigemptyset(&ignoreAction.sa_mask);
+    sigaction(SIGINT, &stopAction, &oldInterruptAction);
+    sigaction(SIGTERM, &stopAction, &oldTerminateAction);
+    sigaction(SIGPIPE, &ignoreAction, &oldPipeAction);
+
+    /* Each worker serves one connection at a time, with a ditherer and a pool of its own, so that
+     *   its buffers are reused from one request to the next. The threads are shared out as in a batch. */
+    ThreadPool workerPool(concurrency);
+    std::vector<std::unique_ptr<ThreadPool>> ditherPools;
+    std::vector<std::unique_ptr<Ditherer>> ditherers;
+    for (unsigned int i = 0; i < concurrency; i++) {
+        ditherPools.push_back(std::make_unique<ThreadPool>(std::max(nThreads / concurrency, 1U)));
+        ditherers.push_back(std::make_unique<Ditherer>(settings, *ditherPools.back()));
+    }
+
+    stopping = false;
+    std::thread acceptor(&DitherServer::acceptConnections, this, listeningSocket);
+    workerPool.parallelFor(0, concurrency, [&](unsigned long int firstWorker, unsigned long int lastWorker) {
+        for (unsigned long int worker = firstWorker; worker < lastWorker; worker++)
+            serveConnections(*ditherers.at(worker));
+    });
+    acceptor.join();
+
+    // Connections still queued had sent nothing that was read, so they are closed unanswered.
+    for (int connection : connections)
+        close(connection);
+    connections.clear();
+    close(listeningSocket);
+    unlink(socketPath.c_str());
+    sigaction(SIGINT, &oldInterruptAction, nullptr);
+    sigaction(SIGTERM, &oldTerminateAction, nullptr);
+    sigaction(SIGPIPE, &oldPipeAction, nullptr);
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    stopPipe[0] = stopPipe[1] = -1;
+}
+
+void DitherServer::acceptConnections(int listeningSocket) {
+    while (true) {
+        /* Only accept a connection if there is room to queue it. Until then, clients wait in
+         *   the listen backlog. The stop pipe is checked while waiting, as a signal handler can
+         *   not wake a condition variable. */
+        bool hasRoom = false;
+        while (!hasRoom && !isStopRequested()) {
+            std::unique_lock<std::mutex> lock(connectionsMutex);
+            hasRoom = connectionsChanged.wait_for(lock, std::chrono::milliseconds(50), [&]() {
+                return connections.size() < queueLength;
+            });
+        }
+        if (!hasRoom)
+            break;
+
+        pollfd fds[2] = {{listeningSocket, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents != 0)
+            break;
+        int connection = accept(listeningSocket, nullptr, nullptr);
+        if (connection < 0)
+            continue;
+
+        // A client that stalls part way through a request or response is dropped after the idle timeout.
+        timeval timeout{idleTimeoutSeconds, 0};
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        connections.push_back(connection);
+        connectionsChanged.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    stopping = true;
+    connectionsChanged.notify_all();
+}
+
+void DitherServer::serveConnections(Ditherer &ditherer) {
+    while (true) {
+        int connection;
+        {
+            std::unique_lock<std::mutex> lock(connectionsMutex);
+            connectionsChanged.wait(lock, [&]() { return stopping || !connections.empty(); });
+            if (stopping)
+                return;
+            connection = connections.front();
+            connections.pop_front();
+            connectionsChanged.notify_all();
+        }
+        serveConnection(connection, ditherer);
+        close(connection);
+    }
+}
+
+void DitherServer::serveConnection(int connection, Ditherer &ditherer) {
+    // Kept for every request of the connection, so that their buffers are only allocated once.
+    std::string options;
+    std::vector<png_byte> request, response;
+    while (true) {
+        // Wait for the next request, unless the server stops or the connection has been idle too long.
+        pollfd fds[2] = {{connection, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+        int nReady = poll(fds, 2, idleTimeoutSeconds * 1000);
+        if ((nReady < 0) && (errno == EINTR))
+            continue;
+        if ((nReady <= 0) || (fds[1].revents != 0))
+            return;
+
+        std::uint32_t optionsLength, pngLength;
+        if (!readLength(connection, optionsLength))
+            return;
+        if (optionsLength > maxOptionsLength) {
+            std::string message = "Request options are too long";
+            writeResponse(connection, 1, message.data(), message.size());
+            return;
+        }
+        options.resize(optionsLength);
+        if (!readFully(connection, &options[0], optionsLength) || !readLength(connection, pngLength))
+            return;
+        if (pngLength > maxPNGLength) {
+            std::string message = "PNG is too large";
+            writeResponse(connection, 1, message.data(), message.size());
+            return;
+        }
+        request.resize(pngLength);
+        if (!readFully(connection, request.data(), pngLength))
+            return;
+
+        // A request that can not be dithered is answered with why, and the connection carries on.
+        std::string message;
+        try {
+            DitherSettings requestSettings = settings;
+            bool requestUsing3Bit = using3Bit;
+            parseRequestOptions(options, requestSettings, requestUsing3Bit);
+            ditherer.setSettings(requestSettings);
+            response.clear();
+            ditherer.ditherPNG(PNG_Source(request.data(), request.size()), {DitherOutput{response, requestUsing3Bit}});
+        } catch (std::exception &e) {
+            message = (*e.what() != '\0') ? e.what() : "Unknown error";
+        }
+        bool answered = message.empty() ? writeResponse(connection, 0, response.data(), response.size())
+                                        : writeResponse(connection, 1, message.data(), message.size());
+        if (!answered)
+            return;
+    }
+}
+
+#else
+
+void DitherServer::run() {
+    throw std::runtime_error("UNIX sockets are not supported on this platform");
+}
+
+void DitherServer::acceptConnections(int) {}
+
+void DitherServer::serveConnections(Ditherer &) {}
+
+void DitherServer::serveConnection(int, Ditherer &) {}
+
+#endif
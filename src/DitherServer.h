@@ -0,0 +1,77 @@
+#ifndef DITHER_DITHERSERVER_H
+#define DITHER_DITHERSERVER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include "Ditherer.h"
+
+/* Dithers PNGs sent over a local UNIX socket, so that a service can dither many small images
+ *   without starting a process for each. The worker threads, their decoders and image buffers
+ *   stay alive between requests.
+ *
+ * A connection sends any number of requests, one after the other, and each gets a response
+ *   before the next is read. All lengths are 4 byte unsigned integers, most significant byte first.
+ *   Request:  options length, options, PNG length, PNG.
+ *             The options are those of the command line, separated by spaces: -m, -d, --matrix,
+ *             --depth, --alpha, --serpentine, --crop, --resize, --compression,
+ *             --compression-level, --compression-strategy and --compression-filter. Options that are not given
+ *             keep the server's settings.
+ *   Response: a status byte, then a length and that many bytes. A status of 0 is followed
+ *             by the dithered PNG, and any other status by a message saying why it failed.
+ *
+ * Up to concurrency connections are served at once, each by a worker of its own. Connections
+ *   beyond those wait in a queue of up to queueLength. When the queue is full, connections are
+ *   left to the listen backlog of the kernel, and then refused, so that a busy server pushes
+ *   back on its clients instead of holding ever more images in memory. Connections idle for
+ *   idleTimeoutSeconds, or that stall part way through a request, are closed. */
+class DitherServer {
+public:
+    static constexpr std::uint32_t maxOptionsLength = 4096;
+    static constexpr std::uint32_t maxPNGLength = 256U << 20U;
+    static constexpr int idleTimeoutSeconds = 30;
+
+    DitherServer(std::string socketPath, const DitherSettings &settings, bool using3Bit, unsigned int nThreads,
+                 unsigned int concurrency, unsigned int queueLength);
+
+    DitherServer(const DitherServer &) = delete;
+
+    DitherServer &operator=(const DitherServer &) = delete;
+
+    /* Serves requests until the process receives SIGINT or SIGTERM, then finishes the requests
+     *   in progress, removes the socket and returns. A stale socket left at the path is replaced.
+     *   Throws BadPath if the socket can not be created, and std::runtime_error if the platform
+     *   has no UNIX sockets. */
+    void run();
+
+    /* Sets the settings and color mode of a request from its options. Throws std::invalid_argument,
+     *   with a message naming the bad option, if they are malformed or give --alpha without 3bit mode. */
+    static void parseRequestOptions(const std::string &options, DitherSettings &settings, bool &using3Bit);
+
+private:
+    // Accepts connections into the queue until the server stops.
+    void acceptConnections(int listeningSocket);
+
+    // Serves the connections of the queue, one at a time, with the worker's ditherer.
+    void serveConnections(Ditherer &ditherer);
+
+    // Answers the requests of a connection until it is closed or the server stops.
+    void serveConnection(int connection, Ditherer &ditherer);
+
+    std::string socketPath;
+    DitherSettings settings;
+    bool using3Bit;
+    unsigned int nThreads;
+    unsigned int concurrency;
+    unsigned int queueLength;
+
+    std::deque<int> connections; // Accepted but not yet being served.
+    std::mutex connectionsMutex;
+    std::condition_variable connectionsChanged;
+    bool stopping = false;
+};
+
+
+#endif //DITHER_DITHERSERVER_H
@@ -0,0 +1,125 @@
+#include "DitherStats.h"
+#include <iomanip>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define DITHER_HAS_RUSAGE 1
+#else
+#define DITHER_HAS_RUSAGE 0
+#endif
+
+std::atomic<bool> DitherStats::enabled{false};
+std::chrono::steady_clock::time_point DitherStats::startTime;
+std::atomic<std::uint64_t> DitherStats::stageNanoseconds[DitherStats::nStages] = {};
+std::atomic<std::uint64_t> DitherStats::nImages{0}, DitherStats::nPixels{0};
+std::atomic<std::uint64_t> DitherStats::nInputBytes{0}, DitherStats::nOutputs{0}, DitherStats::nRawOutputBytes{0},
+        DitherStats::nOutputBytes{0};
+std::atomic<std::uint64_t> DitherStats::nImageAllocations{0}, DitherStats::nImageAllocationBytes{0},
+        DitherStats::nImageReuses{0};
+
+// The name of each stage in the report, in the order of DitherStage.
+static const char *const stageNames[] = {"decode", "conversion", "dither", "encode"};
+
+DitherStats::Timer::Timer(DitherStage stage) noexcept: stage(stage), running(isEnabled()) {
+    if (running)
+        start = std::chrono::steady_clock::now();
+}
+
+DitherStats::Timer::~Timer() {
+    if (running) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        stageNanoseconds[(unsigned int) stage] += (std::uint64_t) elapsed.count();
+    }
+}
+
+void DitherStats::enable() noexcept {
+    startTime = std::chrono::steady_clock::now();
+    enabled = true;
+}
+
+void DitherStats::addImage(std::uint64_t nPixels) noexcept {
+    if (isEnabled()) {
+        nImages++;
+        DitherStats::nPixels += nPixels;
+    }
+}
+
+void DitherStats::addInputBytes(std::uint64_t nBytes) noexcept {
+    if (isEnabled())
+        nInputBytes += nBytes;
+}
+
+void DitherStats::addOutput(std::uint64_t rawBytes, std::uint64_t outputBytes) noexcept {
+    if (isEnabled()) {
+        nOutputs++;
+        nRawOutputBytes += rawBytes;
+        nOutputBytes += outputBytes;
+    }
+}
+
+void DitherStats::countImageAllocation(std::uint64_t nBytes) noexcept {
+    if (isEnabled()) {
+        nImageAllocations++;
+        nImageAllocationBytes += nBytes;
+    }
+}
+
+void DitherStats::countImageReuse() noexcept {
+    if (isEnabled())
+        nImageReuses++;
+}
+
+std::uint64_t DitherStats::getPeakRSS() noexcept {
+#if DITHER_HAS_RUSAGE
+    struct rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return (std::uint64_t) usage.ru_maxrss; // Bytes on macOS.
+#else
+    return (std::uint64_t) usage.ru_maxrss * 1024; // Kilobytes elsewhere.
+#endif
+#else
+    return 0;
+#endif
+}
+
+void DitherStats::print(std::ostream &output, bool json, const std::string &compression) {
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double megapixels = (double) nPixels / 1e6;
+    double megapixelsPerSecond = (wallSeconds > 0) ? megapixels / wallSeconds : 0;
+    double compressionRatio = (nOutputBytes > 0) ? (double) nRawOutputBytes / (double) nOutputBytes : 0;
+    auto milliseconds = [](std::uint64_t nanoseconds) { return (double) nanoseconds / 1e6; };
+
+    // Build the report first, so that it is written in one piece alongside the output of other threads.
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(3);
+    if (json) {
+        report << "{\"images\":" << nImages << ",\"megapixels\":" << megapixels;
+        for (unsigned int i = 0; i < nStages; i++)
+            report << ",\"" << stageNames[i] << "_ms\":" << milliseconds(stageNanoseconds[i]);
+        report << ",\"wall_ms\":" << wallSeconds * 1e3 << ",\"megapixels_per_s\":" << megapixelsPerSecond
+               << ",\"input_bytes\":" << nInputBytes << ",\"outputs\":" << nOutputs << ",\"output_bytes\":"
+               << nOutputBytes << ",\"compression_ratio\":" << compressionRatio << ",\"image_allocations\":"
+               << nImageAllocations << ",\"image_allocation_bytes\":" << nImageAllocationBytes
+               << ",\"image_reuses\":" << nImageReuses << ",\"peak_rss_bytes\":" << getPeakRSS()
+               << ",\"compression\":\"" << compression << "\"}\n";
+    } else {
+        report << "Stats:\n"
+               << "  images             " << nImages << " (" << megapixels << " megapixels)\n";
+        for (unsigned int i = 0; i < nStages; i++)
+            report << "  " << std::left << std::setw(19) << stageNames[i] << milliseconds(stageNanoseconds[i])
+                   << " ms\n";
+        report << "  wall               " << wallSeconds * 1e3 << " ms\n"
+               << "  throughput         " << megapixelsPerSecond << " megapixels/s\n"
+               << "  input bytes        " << nInputBytes << '\n'
+               << "  output bytes       " << nOutputBytes << " in " << nOutputs << " files\n"
+               << "  compression ratio  " << compressionRatio << " (uncompressed rows to output bytes)\n"
+               << "  image allocations  " << nImageAllocations << " (" << nImageAllocationBytes << " bytes)\n"
+               << "  image reuses       " << nImageReuses << " (freed buffers handed out again)\n"
+               << "  peak RSS           " << getPeakRSS() / 1024 << " KiB\n"
+               << "  compression        " << compression << '\n';
+    }
+    output << report.str() << std::flush;
+}
@@ -0,0 +1,84 @@
+#ifndef DITHER_DITHERSTATS_H
+#define DITHER_DITHERSTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// The stages of dithering an image that are timed separately.
+enum class DitherStage {
+    decode,     // Decoding PNG rows.
+    conversion, // Converting pixels between formats, such as to greyscale or palette indices.
+    dither,
+    encode,     // Encoding PNG rows, including compression.
+};
+
+/* Counters of the work done by the process, for the --stats report. They are off until enable()
+ *   is called, and every hook then costs a single check. The counters are atomic, so the threads
+ *   of a batch add to the same totals. Stage times are summed over the threads, so with more
+ *   than one thread they may add up to more than the wall time. */
+class DitherStats {
+public:
+    /* Times a stage for as long as it exists, and adds the time to
+     *   the stage's total when it is destroyed. Does nothing if stats are off. */
+    class Timer {
+    public:
+        explicit Timer(DitherStage stage) noexcept;
+
+        ~Timer();
+
+        Timer(const Timer &) = delete;
+
+        Timer &operator=(const Timer &) = delete;
+
+    private:
+        DitherStage stage;
+        bool running;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    static void enable() noexcept;
+
+    static bool isEnabled() noexcept {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Counts an image of nPixels pixels read from an input file.
+    static void addImage(std::uint64_t nPixels) noexcept;
+
+    // Counts bytes of PNG read from a source, and written to a destination.
+    static void addInputBytes(std::uint64_t nBytes) noexcept;
+
+    /* Counts a PNG written to a destination. rawBytes is the size of its rows before
+     *   compression, and outputBytes is the size of the PNG. */
+    static void addOutput(std::uint64_t rawBytes, std::uint64_t outputBytes) noexcept;
+
+    // Counts the allocation of the pixels of an image, of nBytes bytes.
+    static void countImageAllocation(std::uint64_t nBytes) noexcept;
+
+    // Counts a freed buffer handed out again for the pixels of an image, rather than allocated.
+    static void countImageReuse() noexcept;
+
+    /* Returns the largest resident set size the process has had, in bytes,
+     *   or 0 if the platform does not report it. */
+    static std::uint64_t getPeakRSS() noexcept;
+
+    /* Prints every counter, the wall time since enable() and the compression settings, as
+     *   indented lines of text or as a JSON object on a single line. */
+    static void print(std::ostream &output, bool json, const std::string &compression);
+
+private:
+    static constexpr unsigned int nStages = 4;
+
+    static std::atomic<bool> enabled;
+    static std::chrono::steady_clock::time_point startTime;
+    static std::atomic<std::uint64_t> stageNanoseconds[nStages];
+    static std::atomic<std::uint64_t> nImages, nPixels;
+    static std::atomic<std::uint64_t> nInputBytes, nOutputs, nRawOutputBytes, nOutputBytes;
+    static std::atomic<std::uint64_t> nImageAllocations, nImageAllocationBytes, nImageReuses;
+};
+
+
+#endif //DITHER_DITHERSTATS_H
@@ -0,0 +1,515 @@
+#include "Ditherer.h"
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include "AreaResampler.h"
+#include "BayerMatrix.h"
+#include "Dither.h"
+#include "DitherStats.h"
+#include "LevelKernel.h"
+#include "LumaKernel.h"
+#include "PNG_Grey.h"
+#include "PNG_Indexed.h"
+#include "PNG_Loader.h"
+
+// Returns the number of bytes taken by a row of the buffer's pixels, without any padding.
+static std::size_t getRowBytes(const ConstPixelBuffer &buffer) {
+    return (((std::size_t) buffer.width * buffer.channels * buffer.depth) + 7) / 8;
+}
+
+// Throws std::invalid_argument, naming the buffer, if its pixels and stride can not hold its rows.
+static void checkRows(const ConstPixelBuffer &buffer, const std::string &name) {
+    if ((buffer.width == 0) || (buffer.height == 0))
+        return;
+    if (buffer.pixels == nullptr)
+        throw std::invalid_argument("The " + name + " buffer has no pixels");
+    if (buffer.stride < getRowBytes(buffer))
+        throw std::invalid_argument("The stride of the " + name + " buffer is shorter than its rows");
+}
+
+// Throws std::invalid_argument if the settings ask for output that can not be made.
+static void checkSettings(const DitherSettings &settings) {
+    if (!LevelKernel::isSupportedDepth(settings.greyDepth))
+        throw std::invalid_argument("Greyscale output must have a depth of 1, 2, 4 or 8 bits");
+    if (settings.diffusionKernel && (settings.greyDepth != 1))
+        throw std::invalid_argument("Error diffusion only makes 1 bit greyscale output");
+    if ((settings.alpha != AlphaMode::discard) && settings.geometry.isSet())
+        throw std::invalid_argument("Alpha can not be kept while cropping or resizing");
+}
+
+// Throws std::invalid_argument if the buffers do not have a layout that ditherPixels supports.
+static void checkLayout(const ConstPixelBuffer &input, const ConstPixelBuffer &output, bool using3Bit,
+                        unsigned int greyDepth) {
+    if ((input.depth != 8) && (input.depth != 16))
+        throw std::invalid_argument("Input pixels must have a depth of 8 or 16 bits");
+    if ((input.channels != 1) && (input.channels != 3) && (input.channels != 4))
+        throw std::invalid_argument("Input pixels must have 1, 3 or 4 channels");
+    if ((output.width != input.width) || (output.height != input.height))
+        throw std::invalid_argument("The output buffer must be the size of the input buffer");
+    if (using3Bit) {
+        if (!((output.depth == 8) && ((output.channels == 1) || (output.channels == 3))))
+            throw std::invalid_argument("3 bit output pixels must have 1 or 3 channels of 8 bits");
+    } else if (!(((output.depth == greyDepth) || (output.depth == 8)) && (output.channels == 1)))
+        throw std::invalid_argument("Greyscale output pixels must have 1 channel of the grey depth or of 8 bits");
+    checkRows(input, "input");
+    checkRows(output, "output");
+}
+
+Ditherer::Ditherer(const DitherSettings &settings, ThreadPool &pool) : settings(settings), pool(pool) {
+    checkSettings(settings);
+}
+
+const DitherSettings &Ditherer::getSettings() const noexcept {
+    return settings;
+}
+
+void Ditherer::setSettings(const DitherSettings &newSettings) {
+    checkSettings(newSettings);
+    settings = newSettings;
+}
+
+void Ditherer::ditherPixels(const ConstPixelBuffer &input, const PixelBuffer &output, bool using3Bit) {
+    checkLayout(input, output, using3Bit, settings.greyDepth);
+    if (input.depth == 16)
+        ditherBuffer(rgb16, input, output, using3Bit);
+    else
+        ditherBuffer(rgb8, input, output, using3Bit);
+    DitherStats::addImage((std::uint64_t) input.width * input.height);
+}
+
+template<typename Channel>
+void Ditherer::ditherBuffer(BasicPNG_RGB<Channel> &image, const ConstPixelBuffer &input, const PixelBuffer &output,
+                            bool using3Bit) {
+    unsigned long int width = input.width;
+    unsigned int maxValue = (1U << input.depth) - 1;
+    const DiffusionKernel *diffusionKernel = settings.diffusionKernel;
+
+    // Greyscale output only reads the pixels, so RGB and RGBA buffers are dithered where they are.
+    if (!using3Bit && (input.channels == 3)) {
+        auto pixels = static_cast<const BasicRGB_Pixel<Channel> *>(input.pixels);
+        ditherToGreyBuffer(ImageView<const BasicRGB_Pixel<Channel>>(pixels, width, input.height, input.stride),
+                           output, maxValue);
+        return;
+    }
+    if (!using3Bit && (input.channels == 4)) {
+        auto pixels = static_cast<const BasicRGBA_Pixel<Channel> *>(input.pixels);
+        ditherToGreyBuffer(ImageView<const BasicRGBA_Pixel<Channel>>(pixels, width, input.height, input.stride),
+                           output, maxValue);
+        return;
+    }
+    image.resize(width, input.height, input.depth);
+
+    /* Copy the input into the image. Grey pixels are spread over the 3 channels, as LibPNG does
+     *   for greyscale PNGs, so that a buffer is dithered exactly as the same image in a PNG is. */
+    {
+        DitherStats::Timer timer(DitherStage::conversion);
+        pool.parallelFor(0, input.height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+            for (unsigned long int y = firstRow; y < lastRow; y++) {
+                auto samples = reinterpret_cast<const Channel *>(
+                        static_cast<const unsigned char *>(input.pixels) + (y * input.stride));
+                typename BasicPNG_RGB<Channel>::Pixel *row = image.getRow(y);
+                for (unsigned long int x = 0; x < width; x++) {
+                    const Channel *pixel = samples + ((std::size_t) x * input.channels);
+                    if (input.channels == 1)
+                        row[x] = {pixel[0], pixel[0], pixel[0]};
+                    else
+                        row[x] = {pixel[0], pixel[1], pixel[2]};
+                }
+            }
+        });
+    }
+
+    auto outputRow = [&](unsigned long int y) {
+        return static_cast<unsigned char *>(output.pixels) + (y * output.stride);
+    };
+    if (using3Bit) {
+        {
+            DitherStats::Timer timer(DitherStage::dither);
+            if (diffusionKernel)
+                diffuseRGBInPlace(image, *diffusionKernel, settings.serpentine, maxValue, pool);
+            else
+                withBayerMatrix(settings.matrixSize, [&](auto map) { bayerRGBInPlace(image, map, maxValue, pool); });
+        }
+
+        // Every channel is now either black or fully on.
+        DitherStats::Timer timer(DitherStage::conversion);
+        pool.parallelFor(0, input.height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+            for (unsigned long int y = firstRow; y < lastRow; y++) {
+                if (output.channels == 1) {
+                    rowTo3BitIndices(image.getRow(y), outputRow(y), width);
+                    continue;
+                }
+                const Channel *samples = reinterpret_cast<const Channel *>(image.getRow(y));
+                unsigned char *row = outputRow(y);
+                for (unsigned long int i = 0; i < 3 * width; i++)
+                    row[i] = (samples[i] != 0) ? 255 : 0;
+            }
+        });
+    } else
+        ditherToGreyBuffer(image.view(), output, maxValue);
+}
+
+template<typename Source>
+PNG_Grey Ditherer::ditherGrey(const Source &input, unsigned int maxValue) {
+    // Greyscale conversion is fused with dithering, so it is timed as part of it.
+    DitherStats::Timer timer(DitherStage::dither);
+    if (settings.diffusionKernel)
+        return diffuseGrey(input, *settings.diffusionKernel, settings.serpentine, maxValue, pool);
+    PNG_Grey pngGrey(0, 0, 1); // Empty, so that nothing is allocated until the result is moved in.
+    withBayerMatrix(settings.matrixSize, [&](auto map) {
+        pngGrey = bayerGrey(input, map, maxValue, pool, settings.greyDepth);
+    });
+    return pngGrey;
+}
+
+template<typename Pixel>
+void Ditherer::ditherToGreyBuffer(ImageView<Pixel> input, const PixelBuffer &output, unsigned int maxValue) {
+    unsigned long int width = input.getWidth();
+    auto outputRow = [&](unsigned long int y) {
+        return static_cast<unsigned char *>(output.pixels) + (y * output.stride);
+    };
+    PNG_Grey pngGrey = ditherGrey(input, maxValue);
+
+    /* The rows of the result are already packed at the grey depth, so output of that depth
+     *   is a copy. 8 bit output spreads the levels over [0, 255] instead. */
+    DitherStats::Timer timer(DitherStage::conversion);
+    unsigned int greyDepth = settings.greyDepth;
+    unsigned int levelMask = (1U << greyDepth) - 1;
+    unsigned int levelScale = 255 / levelMask;
+    pool.parallelFor(0, input.getHeight(), [&](unsigned long int firstRow, unsigned long int lastRow) {
+        for (unsigned long int y = firstRow; y < lastRow; y++) {
+            png_const_bytep levels = pngGrey.getRow(y);
+            unsigned char *row = outputRow(y);
+            if (output.depth == greyDepth) {
+                std::memcpy(row, levels, pngGrey.getRowBytes());
+                continue;
+            }
+            for (unsigned long int x = 0; x < width; x++) {
+                unsigned long int bit = x * greyDepth;
+                unsigned int shift = 8 - greyDepth - (bit % 8);
+                row[x] = (unsigned char) (((levels[bit / 8] >> shift) & levelMask) * levelScale);
+            }
+        }
+    });
+}
+
+[[noreturn]] void Ditherer::rethrowAsDitherFailed(const std::string &badPathMessage) {
+    try {
+        throw;
+    } catch (DitherFailed &e) {
+        throw;
+    } catch (BadPath &e) {
+        throw DitherFailed(badPathMessage);
+    } catch (NotPNG &e) {
+        throw DitherFailed("File is not a PNG. Aborting");
+    } catch (UnsupportedColorMode &e) {
+        throw DitherFailed("File color mode not supported. Aborting.");
+    } catch (std::exception &e) {
+        throw DitherFailed(std::string("Fatal error. Program threw the following exception: ") + e.what());
+    }
+}
+
+void Ditherer::ditherPNG(const PNG_Source &source, const std::vector<DitherOutput> &outputs) {
+    /* Greyscale outputs only need the luma of the image, so if there are no others, greyscale
+     *   PNGs are decoded as they are rather than expanded to RGB. */
+    bool allGreyscale = std::none_of(outputs.begin(), outputs.end(), [](const DitherOutput &output) {
+        return output.using3Bit;
+    });
+    PNG_Decoder::Transform transform = allGreyscale ? &LumaKernel::transformToGreyOrRGB : nullptr;
+    bool keepingAlpha = (settings.alpha != AlphaMode::discard) && !allGreyscale;
+
+    /* In streaming mode, rows are decoded, dithered and encoded one at a time, so each output
+     *   decodes the PNG again. Standard input can only be read once, so it is only streamed to a
+     *   single output. Interlaced images can not be streamed either. Both fall through to the
+     *   regular path below, which decodes the PNG once. */
+    bool reopenable = (source.data != nullptr) || (source.filePath != standardStreamPath);
+    if (settings.streaming && !settings.geometry.isSet() && !keepingAlpha && (reopenable || (outputs.size() == 1))) {
+        try {
+            PNG_Info info{};
+            for (const DitherOutput &output : outputs) {
+                decoder.open(source, transform);
+                info = decoder.getInfo();
+                if (settings.diffusionKernel) {
+                    streamDiffuse(decoder, output.destination, output.using3Bit, *settings.diffusionKernel,
+                                  settings.serpentine, settings.compression);
+                } else {
+                    withBayerMatrix(settings.matrixSize, [&](auto map) {
+                        streamDither(decoder, output.destination, output.using3Bit, map, settings.compression,
+                                     settings.greyDepth);
+                    });
+                }
+            }
+            decoder.reset();
+            DitherStats::addImage((std::uint64_t) info.width * info.height);
+            return;
+        } catch (InterlacedPNG &e) {
+            /* Fall back to loading the whole image. Nothing has been read past its header, so
+             *   the decoder is left open, as standard input can not be opened twice. */
+        } catch (...) {
+            decoder.reset();
+            rethrowAsDitherFailed("Could not open file at source or destination. Aborting.");
+        }
+    }
+
+    /* Alpha is kept by dithering the image as RGBA, of which greyscale outputs ignore the alpha.
+     *   Channels are held in 8 or 16 bits, as the rows are decoded. */
+    if (keepingAlpha) {
+        bool using16Bit = false;
+        try {
+            decoder.open(source, &RGBA_Format::transform);
+            PNG_Info info = decoder.getInfo();
+            using16Bit = info.colorDepth == 16;
+            if (using16Bit)
+                rgba16.load(decoder);
+            else
+                rgba8.load(decoder);
+            decoder.reset();
+            DitherStats::addImage((std::uint64_t) info.width * info.height);
+        } catch (...) {
+            decoder.reset();
+            rethrowAsDitherFailed("Could not load file at source. Aborting.");
+        }
+        if (using16Bit)
+            ditherImage(rgba16, outputs);
+        else
+            ditherImage(rgba8, outputs);
+        return;
+    }
+
+    /* Unless the image is resampled, greyscale outputs are dithered as the PNG is decoded. The
+     *   result is the same for every output, so it is only made once. */
+    if (allGreyscale && !settings.geometry.isSet()) {
+        PNG_Grey result;
+        try {
+            if (!decoder.isOpen())
+                decoder.open(source, transform);
+            PNG_Info info = decoder.getInfo();
+            result = ditherDecodedGrey();
+            decoder.reset();
+            DitherStats::addImage((std::uint64_t) info.width * info.height);
+        } catch (...) {
+            decoder.reset();
+            rethrowAsDitherFailed("Could not load file at source. Aborting.");
+        }
+        for (const DitherOutput &output : outputs) {
+            try {
+                result.write_png_file(output.destination, settings.compression);
+            } catch (...) {
+                rethrowAsDitherFailed("Could not create file at destination. Aborting.");
+            }
+        }
+        return;
+    }
+
+    /* Open the PNG once, both to identify it and to load it. Channels are held in 8 or 16 bits
+     *   to match the file, as 1, 2 and 4 bit images are expanded to 8 bits when they are decoded. */
+    bool using16Bit = false;
+    try {
+        if (!decoder.isOpen())
+            decoder.open(source);
+        PNG_Info info = decoder.getInfo();
+        using16Bit = info.colorDepth == 16;
+        if (settings.geometry.isSet()) {
+            if (using16Bit)
+                loadResampled(rgb16);
+            else
+                loadResampled(rgb8);
+        } else if (using16Bit)
+            rgb16.load(decoder);
+        else
+            rgb8.load(decoder);
+        decoder.reset();
+        DitherStats::addImage((std::uint64_t) info.width * info.height);
+    } catch (...) {
+        decoder.reset();
+        rethrowAsDitherFailed("Could not load file at source. Aborting.");
+    }
+
+    // Dither the image.
+    if (using16Bit)
+        ditherImage(rgb16, outputs);
+    else
+        ditherImage(rgb8, outputs);
+}
+
+PNG_Grey Ditherer::ditherDecodedGrey() {
+    PNG_Info info = decoder.getInfo();
+    unsigned long int width = info.width;
+    unsigned int nChannels = (info.colorType == PNG_ColorType::grayscale) ? 1 : 3;
+    unsigned int nBytesPerColor = info.colorDepth / 8;
+    unsigned int maxValue = (1U << info.colorDepth) - 1;
+    unsigned int bitDepth = settings.greyDepth;
+    unsigned int onColor = (1U << bitDepth) - 1;
+    std::size_t rowBytes = decoder.getRowBytes();
+    PNG_Grey result(width, info.height, bitDepth);
+
+    /* Bayer dithering needs each row once, so rows are converted and thresholded as they are
+     *   decoded, and the image is never held. Each row is only ever in the cache. */
+    if (!settings.diffusionKernel && (info.numberOfPasses == 1)) {
+        rawRows.resize(rowBytes);
+        std::vector<GreyPixel> greyRow(width);
+        withBayerMatrix(settings.matrixSize, [&](auto map) {
+            LevelKernel kernel(map, maxValue, bitDepth);
+            for (unsigned long int y = 0; y < info.height; y++) {
+                decoder.readRawRow(rawRows.data());
+                {
+                    DitherStats::Timer timer(DitherStage::conversion);
+                    LumaKernel::rawRowToGrey(rawRows.data(), greyRow.data(), width, nChannels, nBytesPerColor);
+                }
+                DitherStats::Timer timer(DitherStage::dither);
+                kernel.applyToRow(greyRow.data(), result.getRow(y), width, y);
+            }
+        });
+        return result;
+    }
+
+    /* Otherwise decode the whole image in the LibPNG format, which for greyscale PNGs takes only
+     *   a byte or two per pixel, and convert each row just before it is dithered. */
+    if (rawRows.capacity() < info.height * rowBytes)
+        DitherStats::countImageAllocation(info.height * rowBytes);
+    rawRows.resize(info.height * rowBytes);
+    std::vector<png_bytep> rowPointers(info.height);
+    for (unsigned long int y = 0; y < info.height; y++)
+        rowPointers[y] = rawRows.data() + (y * rowBytes);
+    decoder.readImage(rowPointers.data());
+
+    // As in ditherGrey, the conversion is timed as part of dithering.
+    DitherStats::Timer timer(DitherStage::dither);
+    if (!settings.diffusionKernel) {
+        withBayerMatrix(settings.matrixSize, [&](auto map) {
+            LevelKernel kernel(map, maxValue, bitDepth);
+            pool.parallelFor(0, info.height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+                std::vector<GreyPixel> greyRow(width);
+                for (unsigned long int y = firstRow; y < lastRow; y++) {
+                    LumaKernel::rawRowToGrey(rowPointers[y], greyRow.data(), width, nChannels, nBytesPerColor);
+                    kernel.applyToRow(greyRow.data(), result.getRow(y), width, y);
+                }
+            });
+        });
+        return result;
+    }
+
+    // As diffuseGrey, each row is converted into a scratch row of the thread diffusing it.
+    ErrorDiffuser diffuser(*settings.diffusionKernel, width, 1, maxValue, onColor, settings.serpentine);
+    unsigned int nScratchRows = pool.getThreadCount();
+    std::vector<GreyPixel> scratch((std::size_t) nScratchRows * width);
+    auto scratchRow = [&](unsigned long int y) { return scratch.data() + ((y % nScratchRows) * width); };
+    diffuser.processImage<GreyPixel>(info.height,
+                                     [&](unsigned long int y) {
+                                         LumaKernel::rawRowToGrey(rowPointers[y], scratchRow(y), width, nChannels,
+                                                                  nBytesPerColor);
+                                         return (const GreyPixel *) scratchRow(y);
+                                     },
+                                     scratchRow, pool,
+                                     [&](unsigned long int y) { result.setRow(y, scratchRow(y)); });
+    return result;
+}
+
+template<typename Channel>
+void Ditherer::loadResampled(BasicPNG_RGB<Channel> &image) {
+    PNG_Info info = decoder.getInfo();
+    PixelRect keptRect{};
+    try {
+        keptRect = settings.geometry.getCrop(info.width, info.height);
+    } catch (std::invalid_argument &e) {
+        throw DitherFailed(std::string(e.what()) + ". Aborting.");
+    }
+    unsigned long int width, height;
+    settings.geometry.getOutputSize(keptRect, width, height);
+    image.resize(width, height, info.colorDepth);
+    AreaResampler resampler(keptRect, width, height);
+    unsigned int nBytesPerColor = (info.colorDepth == 16) ? 2 : 1;
+    std::size_t rowBytes = decoder.getRowBytes();
+
+    // Rows are decoded one at a time, and decoding stops at the bottom of the crop.
+    if (info.numberOfPasses == 1) {
+        rawRows.resize(rowBytes);
+        while (!resampler.isComplete()) {
+            decoder.readRawRow(rawRows.data());
+            DitherStats::Timer timer(DitherStage::conversion);
+            resampler.addRow(rawRows.data(), nBytesPerColor, image);
+        }
+        return;
+    }
+
+    // Interlaced images can only be decoded whole.
+    if (rawRows.capacity() < info.height * rowBytes)
+        DitherStats::countImageAllocation(info.height * rowBytes);
+    rawRows.resize(info.height * rowBytes);
+    std::vector<png_bytep> rowPointers(info.height);
+    for (unsigned long int y = 0; y < info.height; y++)
+        rowPointers[y] = rawRows.data() + (y * rowBytes);
+    decoder.readImage(rowPointers.data());
+    DitherStats::Timer timer(DitherStage::conversion);
+    for (unsigned long int y = 0; !resampler.isComplete(); y++)
+        resampler.addRow(rowPointers[y], nBytesPerColor, image);
+}
+
+template<typename Channel>
+void Ditherer::dither3Bit(BasicPNG_RGB<Channel> &image, const PNG_Destination &destination) {
+    unsigned int maxValue = (1U << image.getInfo().colorDepth) - 1;
+    {
+        DitherStats::Timer timer(DitherStage::dither);
+        if (settings.diffusionKernel)
+            diffuseRGBInPlace(image, *settings.diffusionKernel, settings.serpentine, maxValue, pool);
+        else
+            withBayerMatrix(settings.matrixSize, [&](auto map) { bayerRGBInPlace(image, map, maxValue, pool); });
+    }
+
+    // Write the resultant PNG. It only holds 8 colors, so it is written as an indexed image.
+    to3BitIndexed(image, pool).write_png_file(destination, settings.compression);
+}
+
+template<typename Channel>
+void Ditherer::dither3Bit(BasicPNG_RGBA<Channel> &image, const PNG_Destination &destination) {
+    unsigned int maxValue = (1U << image.getInfo().colorDepth) - 1;
+    bool keepAlpha = settings.alpha == AlphaMode::keep;
+    {
+        DitherStats::Timer timer(DitherStage::dither);
+        if (settings.diffusionKernel)
+            diffuseRGBAInPlace(image, *settings.diffusionKernel, settings.serpentine, maxValue, keepAlpha, pool);
+        else
+            withBayerMatrix(settings.matrixSize, [&](auto map) {
+                bayerRGBAInPlace(image, map, maxValue, keepAlpha, pool);
+            });
+    }
+
+    /* With 8 colors, thresholded alpha makes at most 9 pairs of color and alpha, so only images
+     *   that keep many levels of alpha are too many for a palette. */
+    std::optional<PNG_Indexed> indexed = toIndexedWithAlpha(image, pool);
+    if (indexed)
+        indexed->write_png_file(destination, settings.compression);
+    else
+        image.write_png_file(destination, settings.compression);
+}
+
+/* Bayer dithering is used unless an error diffusion kernel was chosen. The work is split
+ *   across the threads of the pool. Throws DitherFailed if an output can not be written. */
+template<typename Image>
+void Ditherer::ditherImage(Image &png, std::vector<DitherOutput> outputs) {
+    unsigned int maxValue = (1U << png.getInfo().colorDepth) - 1;
+
+    /* Greyscale outputs only read the image, so they are made first. The last 3 bit output
+     *   can then dither the image in place, as nothing needs it afterwards. */
+    std::stable_partition(outputs.begin(), outputs.end(), [](const DitherOutput &output) {
+        return !output.using3Bit;
+    });
+    for (std::size_t i = 0; i < outputs.size(); i++) {
+        const PNG_Destination &destination = outputs.at(i).destination;
+        try {
+            if (outputs.at(i).using3Bit) {
+                // Any earlier 3 bit output dithers a copy, leaving the image for the outputs after it.
+                bool lastOutput = (i + 1 == outputs.size());
+                std::optional<Image> copy;
+                if (!lastOutput)
+                    copy = png;
+                dither3Bit(lastOutput ? png : *copy, destination);
+            } else {
+                // Write the resultant PNG.
+                ditherGrey(png, maxValue).write_png_file(destination, settings.compression);
+            }
+        } catch (...) {
+            rethrowAsDitherFailed("Could not create file at destination. Aborting.");
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#ifndef DITHER_DITHERER_H
+#define DITHER_DITHERER_H
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ErrorDiffusion.h"
+#include "ImageGeometry.h"
+#include "ImageView.h"
+#include "PixelBuffer.h"
+#include "PNG_Compression.h"
+#include "PNG_Decoder.h"
+#include "PNG_Grey.h"
+#include "PNG_IO.h"
+#include "PNG_RGB.h"
+#include "PNG_RGBA.h"
+#include "ThreadPool.h"
+
+/* What becomes of the alpha of PNGs dithered to 3 bit color. It is either discarded, kept as it
+ *   is, or thresholded so that every pixel is either transparent or opaque. Greyscale output
+ *   never has alpha. */
+enum class AlphaMode {
+    discard,
+    keep,
+    threshold,
+};
+
+// How images are dithered, whatever they are read from.
+struct DitherSettings {
+    unsigned int matrixSize = 4; // The size of the Bayer matrix(2, 4, 8 or 16).
+    const DiffusionKernel *diffusionKernel = nullptr; // Bayer dithering is used if not set.
+    bool serpentine = false;
+    unsigned int greyDepth = 1; // The bits per pixel of greyscale output(1, 2, 4 or 8). Above 1 needs Bayer dithering.
+    bool streaming = false; // PNGs are decoded, dithered and encoded a row at a time if set.
+    PNG_Compression compression = PNG_Compression::fromProfile("balanced");
+    ImageGeometry geometry; // How PNGs are cropped and resized as they are decoded. Not applied to pixel buffers.
+    AlphaMode alpha = AlphaMode::discard; // Only applied to PNGs, and not while cropping or resizing.
+};
+
+// One PNG made by ditherPNG.
+struct DitherOutput {
+    PNG_Destination destination;
+    bool using3Bit;
+};
+
+// Thrown when a PNG can not be dithered, holding the message that describes why.
+struct DitherFailed : public std::runtime_error {
+    explicit DitherFailed(const std::string &message) : std::runtime_error(message) {}
+};
+
+/* Dithers images held in memory or in PNGs, splitting the work across the threads of a pool.
+ *   The decoder and images are kept between calls, so that dithering many images of similar
+ *   size allocates their buffers only once. A Ditherer may only be used by one thread at a
+ *   time, but any number of them may share a pool. */
+class Ditherer {
+public:
+    // Throws std::invalid_argument if the settings ask for output that can not be made.
+    Ditherer(const DitherSettings &settings, ThreadPool &pool);
+
+    Ditherer(const Ditherer &) = delete;
+
+    Ditherer &operator=(const Ditherer &) = delete;
+
+    /* Dithers the pixels of input into output, which must be of the same width and height. The
+     *   input holds 1(grey), 3(RGB) or 4(RGBA, whose alpha is ignored) channels of 8 or 16 bits.
+     *   A greyscale result is written to 1 channel of the grey depth, packed as in a PNG row, or of
+     *   8 bits, its levels spread over [0, 255]. A 3 bit result is written to 1 channel of 8 bits,
+     *   holding indices into get3BitPalette(), or to 3 channels of 8 bits, each 0 or 255. Throws
+     *   std::invalid_argument if either buffer has another layout. */
+    void ditherPixels(const ConstPixelBuffer &input, const PixelBuffer &output, bool using3Bit);
+
+    /* Dithers the PNG in the source to every one of the outputs, decoding it only once unless
+     *   streaming. Standard input is only streamed to a single output, as it can not be read
+     *   again. If the settings crop or resize the image, it is resampled as its rows are
+     *   decoded, which also streams it, as the image is only held at its final size. If the
+     *   settings keep alpha and there are 3 bit outputs, the image is loaded as RGBA, and never
+     *   streamed. Throws DitherFailed if the PNG can not be read, dithered or written. */
+    void ditherPNG(const PNG_Source &source, const std::vector<DitherOutput> &outputs);
+
+    [[nodiscard]] const DitherSettings &getSettings() const noexcept;
+
+    /* Changes the settings of the images dithered from now on. The buffers are kept.
+     *   Throws std::invalid_argument, as the constructor does. */
+    void setSettings(const DitherSettings &newSettings);
+
+private:
+    /* Dithers the image to each of the outputs, using the color mode and algorithm of the
+     *   settings, and writes the results. The image is overwritten. */
+    template<typename Image>
+    void ditherImage(Image &png, std::vector<DitherOutput> outputs);
+
+    // Dithers the image to 3 bit color in place, and writes it as an indexed PNG.
+    template<typename Channel>
+    void dither3Bit(BasicPNG_RGB<Channel> &image, const PNG_Destination &destination);
+
+    /* Dithers the colors of the image to 3 bit color in place, and its alpha as the settings say.
+     *   It is written as an indexed PNG with a tRNS chunk if it fits, and as RGBA otherwise. */
+    template<typename Channel>
+    void dither3Bit(BasicPNG_RGBA<Channel> &image, const PNG_Destination &destination);
+
+    /* Dithers the PNG open in the decoder to greyscale of the grey depth, converting its rows
+     *   straight from the LibPNG format, so that no RGB image is made. Greyscale PNGs, opened
+     *   with LumaKernel::transformToGreyOrRGB, are not converted at all. */
+    PNG_Grey ditherDecodedGrey();
+
+    /* Replaces the image with the PNG open in the decoder, cropped and resized as the settings say.
+     *   Throws DitherFailed if the crop does not lie inside the PNG. */
+    template<typename Channel>
+    void loadResampled(BasicPNG_RGB<Channel> &image);
+
+    /* Copies the input into the image, dithers it and copies the result into the output. RGB and
+     *   RGBA input dithered to greyscale is read where it is, without copying it into the image. */
+    template<typename Channel>
+    void ditherBuffer(BasicPNG_RGB<Channel> &image, const ConstPixelBuffer &input, const PixelBuffer &output,
+                      bool using3Bit);
+
+    /* Dithers the input, an image or an ImageView, to greyscale of the grey depth, using the
+     *   algorithm of the settings. */
+    template<typename Source>
+    PNG_Grey ditherGrey(const Source &input, unsigned int maxValue);
+
+    // Dithers the input to greyscale of the grey depth, and writes the result into the output.
+    template<typename Pixel>
+    void ditherToGreyBuffer(ImageView<Pixel> input, const PixelBuffer &output, unsigned int maxValue);
+
+    /* Rethrows the exception being handled as a DitherFailed with a message describing it. A
+     *   BadPath is described by badPathMessage, as which path was bad depends on the step that failed. */
+    [[noreturn]] static void rethrowAsDitherFailed(const std::string &badPathMessage);
+
+    DitherSettings settings;
+    ThreadPool &pool;
+    PNG_Decoder decoder;
+    PNG_RGB8 rgb8{0, 0, 8}; // Empty until the first image is loaded.
+    PNG_RGB16 rgb16{0, 0, 16};
+    PNG_RGBA8 rgba8{0, 0, 8}; // Only used when keeping alpha.
+    PNG_RGBA16 rgba16{0, 0, 16};
+    std::vector<png_byte> rawRows; // The rows of PNGs being resampled, in the LibPNG format.
+};
+
+
+#endif //DITHER_DITHERER_H
@@ -0,0 +1,213 @@
+#include "ErrorDiffusion.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+unsigned int DiffusionKernel::getHeight() const noexcept {
+    unsigned int result = 1;
+    for (const auto &weight : weights)
+        result = std::max(result, weight.dy + 1);
+    return result;
+}
+
+unsigned int DiffusionKernel::getReach() const noexcept {
+    unsigned int result = 0;
+    for (const auto &weight : weights)
+        result = std::max(result, (unsigned int) std::abs(weight.dx));
+    return result;
+}
+
+const DiffusionKernel &DiffusionKernel::fromName(const std::string &name) {
+    for (const auto &kernel : getKernels()) {
+        if (kernel.name == name)
+            return kernel;
+    }
+    throw std::invalid_argument("Unknown error diffusion kernel: " + name);
+}
+
+const std::vector<DiffusionKernel> &DiffusionKernel::getKernels() {
+    static const std::vector<DiffusionKernel> kernels = {
+            {"floyd-steinberg", 16, {{1,  0, 7},
+                                     {-1, 1, 3}, {0, 1, 5}, {1, 1, 1}}},
+            {"atkinson",        8,  {{1,  0, 1}, {2,  0, 1},
+                                     {-1, 1, 1}, {0,  1, 1}, {1, 1, 1},
+                                     {0,  2, 1}}},
+            {"jarvis",          48, {{1,  0, 7}, {2,  0, 5},
+                                     {-2, 1, 3}, {-1, 1, 5}, {0, 1, 7}, {1, 1, 5}, {2, 1, 3},
+                                     {-2, 2, 1}, {-1, 2, 3}, {0, 2, 5}, {1, 2, 3}, {2, 2, 1}}},
+            {"stucki",          42, {{1,  0, 8}, {2,  0, 4},
+                                     {-2, 1, 2}, {-1, 1, 4}, {0, 1, 8}, {1, 1, 4}, {2, 1, 2},
+                                     {-2, 2, 1}, {-1, 2, 2}, {0, 2, 4}, {1, 2, 2}, {2, 2, 1}}},
+            {"sierra",          32, {{1,  0, 5}, {2,  0, 3},
+                                     {-2, 1, 2}, {-1, 1, 4}, {0, 1, 5}, {1, 1, 4}, {2, 1, 2},
+                                     {-1, 2, 2}, {0,  2, 3}, {1, 2, 2}}},
+    };
+    return kernels;
+}
+
+ErrorDiffuser::ErrorDiffuser(const DiffusionKernel &kernel, unsigned long int width, unsigned int nChannels,
+                             unsigned int maxValue, unsigned int onValue, bool serpentine,
+                             unsigned int nSamplesPerPixel)
+        : kernel(kernel), width(width), nChannels(nChannels),
+          nSamplesPerPixel((nSamplesPerPixel == 0) ? nChannels : nSamplesPerPixel), onValue(onValue),
+          serpentine(serpentine) {
+    fixedMaxValue = (int32_t) (maxValue << fractionBits);
+    height = kernel.getHeight();
+    reach = kernel.getReach();
+
+    // Pad each row by the reach on both sides, so that edge pixels need no bounds checks.
+    rowLength = (width + (2 * reach)) * nChannels;
+    resetErrorRows(height);
+}
+
+template<typename Sample>
+void ErrorDiffuser::processRow(const Sample *input, Sample *output) {
+    unsigned long int y = nextRow++;
+    clearLowestErrorRow(y);
+    diffuseRow(y, input, output, [](unsigned long int) {}, [](unsigned long int) {});
+}
+
+template<typename Sample>
+void ErrorDiffuser::processImage(unsigned long int imageHeight,
+                                 const std::function<const Sample *(unsigned long int)> &inputRow,
+                                 const std::function<Sample *(unsigned long int)> &outputRow,
+                                 ThreadPool &pool, const std::function<void(unsigned long int)> &finishRow) {
+    nextRow = 0;
+    unsigned int nThreads = pool.getThreadCount();
+    if (serpentine || (nThreads == 1) || (imageHeight < 2)) {
+        resetErrorRows(height);
+        for (unsigned long int y = 0; y < imageHeight; y++) {
+            processRow(inputRow(y), outputRow(y));
+            if (finishRow)
+                finishRow(y);
+        }
+        return;
+    }
+
+    /* At most one row per thread is in progress, and rows finish in order, so when a row
+     *   starts every row more than nThreads above it is finished. Each row then only needs
+     *   the error rows that it and the rows in progress above it reach. */
+    resetErrorRows(height + nThreads);
+
+    /* A row may read the error at x once the row above has passed x + reach, so that no more
+     *   error is coming to x. Staying a further reach behind keeps the two rows from ever
+     *   adding to the same error at once. */
+    unsigned long int lag = (2 * reach) + 1;
+    std::unique_ptr<std::atomic<unsigned long int>[]> progress(new std::atomic<unsigned long int>[imageHeight]);
+    for (unsigned long int y = 0; y < imageHeight; y++)
+        progress[y].store(0, std::memory_order_relaxed);
+    std::atomic<unsigned long int> nextClaim(0);
+
+    /* Rows are claimed in order by whichever thread is free. A thread only ever waits for a
+     *   row claimed before its own, which is always being worked on, so waiting can not
+     *   deadlock even if some of the pool's threads are busy elsewhere. */
+    pool.parallelFor(0, nThreads, [&](unsigned long int, unsigned long int) {
+        while (true) {
+            unsigned long int y = nextClaim.fetch_add(1);
+            if (y >= imageHeight)
+                return;
+
+            clearLowestErrorRow(y);
+
+            unsigned long int available = 0;
+            auto waitForRowAbove = [&](unsigned long int x) {
+                if (y == 0)
+                    return;
+                unsigned long int needed = std::min(width, x + lag);
+                while (available < needed) {
+                    available = progress[y - 1].load(std::memory_order_acquire);
+                    if (available < needed)
+                        std::this_thread::yield();
+                }
+            };
+            auto publishProgress = [&](unsigned long int done) {
+                if (((done % progressInterval) == 0) && (done < width))
+                    progress[y].store(done, std::memory_order_release);
+            };
+
+            /* The row is only marked complete once finishRow is done with it, so that rows
+             *   complete in order and never more than nThreads are in progress at once. */
+            diffuseRow(y, inputRow(y), outputRow(y), waitForRowAbove, publishProgress);
+            if (finishRow)
+                finishRow(y);
+            progress[y].store(width, std::memory_order_release);
+        }
+    });
+}
+
+void ErrorDiffuser::clearLowestErrorRow(unsigned long int y) noexcept {
+    // The lowest row was last used by a row that has finished.
+    int32_t *lowestRow = getErrorRow(y + height - 1) - (reach * nChannels);
+    std::fill(lowestRow, lowestRow + rowLength, 0);
+}
+
+void ErrorDiffuser::resetErrorRows(unsigned int nRows) {
+    nErrorRows = nRows;
+    errorRows.assign(nErrorRows * rowLength, 0);
+    resolvedWeights.resize(nErrorRows * kernel.weights.size());
+}
+
+int32_t *ErrorDiffuser::getErrorRow(unsigned long int y) noexcept {
+    return errorRows.data() + ((y % nErrorRows) * rowLength) + (reach * nChannels);
+}
+
+template<typename Sample, typename WaitFunction, typename PublishFunction>
+void ErrorDiffuser::diffuseRow(unsigned long int y, const Sample *input, Sample *output,
+                               WaitFunction &&waitForRowAbove, PublishFunction &&publishProgress) {
+    // Odd rows of a serpentine scan run right to left, with the kernel mirrored.
+    bool reversed = serpentine && (y % 2 == 1);
+    long int direction = reversed ? -1 : 1;
+
+    // Resolve each weight to the error row and sample offset it adds to.
+    std::size_t nWeights = kernel.weights.size();
+    ResolvedWeight *resolved = resolvedWeights.data() + ((y % nErrorRows) * nWeights);
+    for (std::size_t w = 0; w < nWeights; w++) {
+        const DiffusionWeight &weight = kernel.weights[w];
+        resolved[w] = {getErrorRow(y + weight.dy), direction * weight.dx * (long int) nChannels, weight.weight};
+    }
+
+    int32_t *currentRow = getErrorRow(y);
+    int32_t divisor = kernel.divisor;
+    int32_t midpoint = fixedMaxValue / 2;
+
+    for (unsigned long int i = 0; i < width; i++) {
+        unsigned long int x = reversed ? (width - 1 - i) : i;
+        waitForRowAbove(i);
+
+        for (unsigned int c = 0; c < nChannels; c++) {
+            std::size_t index = (x * nChannels) + c;
+            std::size_t sample = (x * nSamplesPerPixel) + c;
+
+            // Add the error diffused so far, and round to the nearer of black and onValue.
+            int32_t value = (int32_t) ((unsigned int) input[sample] << fractionBits) + currentRow[index];
+            bool on = value > midpoint;
+            output[sample] = on ? (Sample) onValue : 0;
+
+            // Spread the difference over the neighbours.
+            int32_t error = value - (on ? fixedMaxValue : 0);
+            for (std::size_t w = 0; w < nWeights; w++)
+                resolved[w].row[(long int) index + resolved[w].offset] += (error * resolved[w].weight) / divisor;
+        }
+
+        publishProgress(i + 1);
+    }
+}
+
+template void ErrorDiffuser::processRow<uint8_t>(const uint8_t *, uint8_t *);
+template void ErrorDiffuser::processRow<uint16_t>(const uint16_t *, uint16_t *);
+template void ErrorDiffuser::processRow<unsigned int>(const unsigned int *, unsigned int *);
+template void ErrorDiffuser::processImage<uint8_t>(unsigned long int,
+                                                   const std::function<const uint8_t *(unsigned long int)> &,
+                                                   const std::function<uint8_t *(unsigned long int)> &, ThreadPool &,
+                                                   const std::function<void(unsigned long int)> &);
+template void ErrorDiffuser::processImage<uint16_t>(unsigned long int,
+                                                    const std::function<const uint16_t *(unsigned long int)> &,
+                                                    const std::function<uint16_t *(unsigned long int)> &, ThreadPool &,
+                                                    const std::function<void(unsigned long int)> &);
+template void ErrorDiffuser::processImage<unsigned int>(unsigned long int,
+                                                        const std::function<const unsigned int *(unsigned long int)> &,
+                                                        const std::function<unsigned int *(unsigned long int)> &,
+                                                        ThreadPool &, const std::function<void(unsigned long int)> &);
@@ -0,0 +1,120 @@
+#ifndef DITHER_ERRORDIFFUSION_H
+#define DITHER_ERRORDIFFUSION_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+// Spreads weight / divisor of a pixel's error to the pixel dx to the right and dy below it.
+struct DiffusionWeight {
+    int dx;
+    unsigned int dy;
+    int weight;
+};
+
+/* An error diffusion kernel. Kernels are plain data, so new ones only need a
+ *   list of weights. Weights may only point forwards, to the right on the same row
+ *   or to any later row. */
+struct DiffusionKernel {
+    std::string name;
+    int divisor;
+    std::vector<DiffusionWeight> weights;
+
+    // Returns the number of rows the kernel spans, including the current one.
+    [[nodiscard]] unsigned int getHeight() const noexcept;
+
+    // Returns the furthest that any weight reaches to the left or right.
+    [[nodiscard]] unsigned int getReach() const noexcept;
+
+    // Returns the kernel with the supplied name. Throws std::invalid_argument if there is none.
+    static const DiffusionKernel &fromName(const std::string &name);
+
+    // Returns every built-in kernel.
+    static const std::vector<DiffusionKernel> &getKernels();
+};
+
+/* Dithers rows of samples by error diffusion. Each sample becomes 0 or onValue, and
+ *   the difference is spread over its neighbours with the weights of the kernel.
+ *   Error is carried in fixed point, in a ring buffer holding only the rows that the
+ *   kernel reaches, rather than in a floating-point copy of the whole image. Rows are
+ *   arrays of samples, nChannels samples per pixel, each channel diffused separately. */
+class ErrorDiffuser {
+public:
+    /* Sets up the diffuser for rows of width pixels with samples in [0, maxValue]. If
+     *   serpentine is set, odd rows are scanned right to left with the kernel mirrored. Pixels
+     *   are nSamplesPerPixel samples apart, nChannels if it is 0, of which only the first
+     *   nChannels are diffused and the rest are left as they are, such as the alpha of RGBA. */
+    ErrorDiffuser(const DiffusionKernel &kernel, unsigned long int width, unsigned int nChannels,
+                  unsigned int maxValue, unsigned int onValue, bool serpentine, unsigned int nSamplesPerPixel = 0);
+
+    /* Dithers the next row. Rows must be supplied in order, starting from the top of the
+     *   image. The input and output may be the same array. Samples may be uint8_t, uint16_t
+     *   or unsigned int. */
+    template<typename Sample>
+    void processRow(const Sample *input, Sample *output);
+
+    /* Dithers a whole image of imageHeight rows, returned by inputRow and outputRow. Rows are
+     *   processed as a wavefront across the pool: row y + 1 starts as soon as row y is far
+     *   enough ahead that none of its error is still to come. The result is identical to
+     *   processing the rows in order. Serpentine scanning reverses every other row, so it
+     *   can not be split into a wavefront and is always processed on the calling thread.
+     *   If supplied, finishRow(y) is called once row y is complete. The rows in progress at
+     *   once are always consecutive and at most pool.getThreadCount(), so the callbacks may
+     *   share that many scratch rows, indexed by y modulo the thread count. */
+    template<typename Sample>
+    void processImage(unsigned long int imageHeight, const std::function<const Sample *(unsigned long int)> &inputRow,
+                      const std::function<Sample *(unsigned long int)> &outputRow, ThreadPool &pool,
+                      const std::function<void(unsigned long int)> &finishRow = nullptr);
+
+private:
+    // Fractional bits of the fixed-point error.
+    static const unsigned int fractionBits = 8;
+
+    // Pixels between progress updates published to the row below, in wavefront mode.
+    static const unsigned long int progressInterval = 64;
+
+    // A weight of the kernel resolved, for one row, to the error row and sample offset it adds to.
+    struct ResolvedWeight {
+        int32_t *row;
+        long int offset;
+        int32_t weight;
+    };
+
+    // Clears the lowest error row that row y spreads error to, before row y starts.
+    void clearLowestErrorRow(unsigned long int y) noexcept;
+
+    // Resizes the ring buffer, and the resolved weights of each of its rows, to nRows rows, and clears them.
+    void resetErrorRows(unsigned int nRows);
+
+    // Returns the error accumulated for row y, offset so that index 0 is the first channel of x = 0.
+    int32_t *getErrorRow(unsigned long int y) noexcept;
+
+    /* Dithers row y. Before reading the error at pixel x, waitForRowAbove(x) is called. After
+     *   finishing pixel x, publishProgress(x + 1) may be called. */
+    template<typename Sample, typename WaitFunction, typename PublishFunction>
+    void diffuseRow(unsigned long int y, const Sample *input, Sample *output,
+                    WaitFunction &&waitForRowAbove, PublishFunction &&publishProgress);
+
+    DiffusionKernel kernel;
+    unsigned long int width;
+    unsigned int nChannels;
+    unsigned int nSamplesPerPixel;
+    unsigned int onValue;
+    bool serpentine;
+    int32_t fixedMaxValue; // maxValue in fixed point.
+    unsigned int height;   // Rows spanned by the kernel.
+    unsigned int reach;    // Columns reached by the kernel either side of the current pixel.
+
+    unsigned long int nextRow = 0;
+    std::size_t rowLength;        // Samples per error row, including padding for the reach.
+    std::vector<int32_t> errorRows;
+    unsigned int nErrorRows = 0;
+    /* The weights of the kernel resolved by the row using each error row. Rows in progress at
+     *   once use different error rows, so they never share them. */
+    std::vector<ResolvedWeight> resolvedWeights;
+};
+
+
+#endif //DITHER_ERRORDIFFUSION_H
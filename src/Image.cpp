@@ -0,0 +1,252 @@
+#include "Image.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "DitherStats.h"
+#include "PNG_Encoder.h"
+#include "PNG_Loader.h"
+
+template<typename Format, typename Channel>
+Image<Format, Channel>::Image() {
+    allocate(0, 0, 8);
+}
+
+template<typename Format, typename Channel>
+Image<Format, Channel>::Image(unsigned long int width, unsigned long int height, unsigned int colorDepth) {
+    resize(width, height, colorDepth);
+
+    // Start from black, so that the padding at the end of each packed row is always clear.
+    if (isPacked())
+        std::fill(pngData.data(), pngData.data() + (rowLength * height), 0);
+}
+
+template<typename Format, typename Channel>
+Image<Format, Channel>::Image(const PNG_Source &source) {
+    load(source);
+}
+
+template<typename Format, typename Channel>
+void Image<Format, Channel>::load(const PNG_Source &source) {
+    PNG_Decoder decoder(source, &Format::transform);
+    load(decoder);
+}
+
+template<typename Format, typename Channel>
+void Image<Format, Channel>::load(PNG_Decoder &decoder) {
+    // If the rows are not of the format, or their samples do not fit in a Channel, throw.
+    PNG_Info finalInfo = decoder.getInfo();
+    if ((finalInfo.colorType != Format::colorType) || (finalInfo.colorDepth > 8 * sizeof(Channel)))
+        throw UnsupportedColorMode();
+    allocate(finalInfo.width, finalInfo.height, finalInfo.colorDepth);
+    selfInfo = finalInfo;
+    std::size_t nSamples = nChannels * (std::size_t) selfInfo.width;
+
+    /* If the rows match the layout of the image, LibPNG decodes them straight into it. 16 bit
+     *   samples are then converted in place from most significant byte first. */
+    if (decodesInPlace()) {
+        // LibPNG leaves the padding at the end of packed rows as it was, so it is cleared first.
+        if (isPacked())
+            std::fill(pngData.data(), pngData.data() + (rowLength * selfInfo.height), 0);
+        std::vector<png_bytep> rowPointers(selfInfo.height);
+        for (unsigned long int y = 0; y < selfInfo.height; y++)
+            rowPointers[y] = reinterpret_cast<png_bytep>(getRow(y));
+        decoder.readImage(rowPointers.data());
+
+        if (sizeof(Channel) > 1) {
+            DitherStats::Timer timer(DitherStage::conversion);
+            for (unsigned long int y = 0; y < selfInfo.height; y++)
+                PNG_Loader::unpackSamples(rowPointers[y], pngData.data() + (y * rowLength), nSamples,
+                                          selfInfo.colorDepth);
+        }
+        return;
+    }
+
+    // Otherwise rows are decoded one at a time into a single buffer, and widened straight into the image.
+    if (selfInfo.numberOfPasses == 1) {
+        std::vector<png_byte> row(decoder.getRowBytes());
+        for (unsigned long int y = 0; y < selfInfo.height; y++) {
+            decoder.readRawRow(row.data());
+            DitherStats::Timer timer(DitherStage::conversion);
+            PNG_Loader::unpackSamples(row.data(), pngData.data() + (y * rowLength), nSamples, selfInfo.colorDepth);
+        }
+        return;
+    }
+
+    // Interlaced images can only be decoded as a whole, in the LibPNG format, before being widened.
+    std::vector<png_byte> rawImage(selfInfo.height * decoder.getRowBytes());
+    DitherStats::countImageAllocation(rawImage.size());
+    std::vector<png_bytep> rowPointers(selfInfo.height);
+    for (unsigned long int y = 0; y < selfInfo.height; y++)
+        rowPointers[y] = rawImage.data() + (y * decoder.getRowBytes());
+    decoder.readImage(rowPointers.data());
+
+    DitherStats::Timer timer(DitherStage::conversion);
+    for (unsigned long int y = 0; y < selfInfo.height; y++)
+        PNG_Loader::unpackSamples(rowPointers[y], pngData.data() + (y * rowLength), nSamples, selfInfo.colorDepth);
+}
+
+template<typename Format, typename Channel>
+void Image<Format, Channel>::resize(unsigned long int width, unsigned long int height, unsigned int colorDepth) {
+    if (colorDepth > 8 * sizeof(Channel))
+        throw UnsupportedColorMode();
+    allocate(width, height, colorDepth);
+}
+
+template<typename Format, typename Channel>
+void Image<Format, Channel>::allocate(unsigned long int width, unsigned long int height, unsigned int colorDepth) {
+    selfInfo.colorDepth = colorDepth;
+    selfInfo.colorType = Format::colorType;
+    selfInfo.width = width;
+    selfInfo.height = height;
+    selfInfo.numberOfPasses = 1;
+    if (isPacked())
+        rowLength = PNG_Loader::getPackedRowBytes(nChannels * width, colorDepth);
+    else
+        rowLength = nChannels * (std::size_t) width;
+    pngData.resize((unsigned long long int) rowLength * height, colorDepth);
+}
+
+template<typename Format, typename Channel>
+std::optional<typename Image<Format, Channel>::WidePixel>
+Image<Format, Channel>::getPixel(unsigned long int x, unsigned long int y) const noexcept {
+    // If x or y are outside the image bounds, return nothing.
+    if ((x >= selfInfo.width) || (y >= selfInfo.height))
+        return std::nullopt;
+
+    // Return the pixel, unpacking it if necessary.
+    unsigned int samples[nChannels];
+    for (unsigned int c = 0; c < nChannels; c++)
+        samples[c] = getSample(y, (nChannels * (std::size_t) x) + c);
+    return Format::fromSamples(samples);
+}
+
+template<typename Format, typename Channel>
+bool Image<Format, Channel>::setPixel(unsigned long int x, unsigned long int y, const WidePixel &value) {
+    // If x or y are outside the image bounds, return false.
+    if ((x >= selfInfo.width) || (y >= selfInfo.height))
+        return false;
+
+    // Set the pixel to the supplied value, packing it if necessary.
+    unsigned int samples[nChannels];
+    Format::toSamples(value, samples);
+    Channel *row = pngData.data() + (y * rowLength);
+    for (unsigned int c = 0; c < nChannels; c++) {
+        std::size_t i = (nChannels * (std::size_t) x) + c;
+        if (isPacked()) {
+            std::size_t bit = i * selfInfo.colorDepth;
+            unsigned int shift = 8 - selfInfo.colorDepth - (bit % 8);
+            unsigned int mask = ((1U << selfInfo.colorDepth) - 1U) << shift;
+            row[bit / 8] = (Channel) ((row[bit / 8] & ~mask) | ((samples[c] << shift) & mask));
+        } else
+            row[i] = (Channel) samples[c];
+    }
+    return true;
+}
+
+template<typename Format, typename Channel>
+unsigned int Image<Format, Channel>::getSample(unsigned long int y, std::size_t i) const noexcept {
+    const Channel *row = pngData.data() + (y * rowLength);
+    if (isPacked()) {
+        std::size_t bit = i * selfInfo.colorDepth;
+        unsigned int shift = 8 - selfInfo.colorDepth - (bit % 8);
+        return (row[bit / 8] >> shift) & ((1U << selfInfo.colorDepth) - 1U);
+    }
+    return row[i];
+}
+
+template<typename Format, typename Channel>
+typename Image<Format, Channel>::Pixel *Image<Format, Channel>::getRow(unsigned long int y) noexcept {
+    return reinterpret_cast<Pixel *>(pngData.data() + (y * rowLength));
+}
+
+template<typename Format, typename Channel>
+const typename Image<Format, Channel>::Pixel *Image<Format, Channel>::getRow(unsigned long int y) const noexcept {
+    return reinterpret_cast<const Pixel *>(pngData.data() + (y * rowLength));
+}
+
+template<typename Format, typename Channel>
+typename Image<Format, Channel>::View Image<Format, Channel>::view() noexcept {
+    return View(getRow(0), getRowBytes() / sizeof(Pixel), selfInfo.height, getRowBytes());
+}
+
+template<typename Format, typename Channel>
+typename Image<Format, Channel>::ConstView Image<Format, Channel>::view() const noexcept {
+    return ConstView(getRow(0), getRowBytes() / sizeof(Pixel), selfInfo.height, getRowBytes());
+}
+
+template<typename Format, typename Channel>
+void Image<Format, Channel>::setRow(unsigned long int y, const unsigned int *samples) {
+    std::size_t nSamples = nChannels * (std::size_t) selfInfo.width;
+    Channel *row = pngData.data() + (y * rowLength);
+    if (isPacked())
+        PNG_Loader::packRow(samples, reinterpret_cast<png_bytep>(row), nSamples, selfInfo.colorDepth);
+    else
+        std::transform(samples, samples + nSamples, row, [](unsigned int sample) { return (Channel) sample; });
+}
+
+template<typename Format, typename Channel>
+bool Image<Format, Channel>::isPacked() const noexcept {
+    return (sizeof(Channel) == 1) && (selfInfo.colorDepth < 8);
+}
+
+template<typename Format, typename Channel>
+std::size_t Image<Format, Channel>::getRowBytes() const noexcept {
+    return rowLength * sizeof(Channel);
+}
+
+template<typename Format, typename Channel>
+bool Image<Format, Channel>::decodesInPlace() const noexcept {
+    return (sizeof(Channel) == 1) || ((sizeof(Channel) == 2) && (selfInfo.colorDepth == 16));
+}
+
+template<typename Format, typename Channel>
+PNG_Info Image<Format, Channel>::getInfo() const noexcept {
+    return selfInfo;
+}
+
+template<typename Format, typename Channel>
+void Image<Format, Channel>::write_png_file(const PNG_Destination &destination, const PNG_Compression &compression) {
+    if (!isPacked()) {
+        write_png_file(view(), selfInfo.colorDepth, destination, compression);
+        return;
+    }
+
+    // Packed rows are already in the LibPNG format, so they are handed to LibPNG as they are.
+    PNG_Encoder encoder(destination, selfInfo.width, selfInfo.height, selfInfo.colorDepth, Format::colorType,
+                        compression);
+    for (unsigned long int y = 0; y < selfInfo.height; y++)
+        encoder.writeRawRow(reinterpret_cast<png_const_bytep>(getRow(y)));
+    encoder.finish();
+}
+
+template<typename Format, typename Channel>
+void Image<Format, Channel>::write_png_file(ConstView view, unsigned int colorDepth,
+                                            const PNG_Destination &destination, const PNG_Compression &compression) {
+    if ((sizeof(Channel) == 1) && (colorDepth < 8))
+        throw std::invalid_argument("Views of packed samples can not be written");
+    PNG_Encoder encoder(destination, view.getWidth(), view.getHeight(), colorDepth, Format::colorType, compression);
+
+    /* Rows of bytes are already in the LibPNG format, so they are handed to LibPNG as they are.
+     *   Other rows are narrowed into the LibPNG format one at a time. */
+    std::size_t nSamples = nChannels * (std::size_t) view.getWidth();
+    std::vector<png_byte> row(sizeof(Channel) > 1 ? encoder.getRowBytes() : 0);
+    for (unsigned long int y = 0; y < view.getHeight(); y++) {
+        const Channel *samples = reinterpret_cast<const Channel *>(view.getRow(y));
+        if (sizeof(Channel) > 1) {
+            PNG_Loader::packSamples(samples, row.data(), nSamples, colorDepth);
+            encoder.writeRawRow(row.data());
+        } else
+            encoder.writeRawRow(reinterpret_cast<png_const_bytep>(samples));
+    }
+
+    encoder.finish();
+}
+
+template class Image<RGB_Format, unsigned int>;
+template class Image<RGB_Format, uint8_t>;
+template class Image<RGB_Format, uint16_t>;
+template class Image<RGBA_Format, unsigned int>;
+template class Image<RGBA_Format, uint8_t>;
+template class Image<RGBA_Format, uint16_t>;
+template class Image<Grey_Format, uint8_t>;
+template class Image<Grey_Format, uint16_t>;
@@ -0,0 +1,130 @@
+#ifndef DITHER_IMAGE_H
+#define DITHER_IMAGE_H
+
+#include <png.h>
+#include <cstdint>
+#include <optional>
+#include "ImageView.h"
+#include "PixelFormat.h"
+#include "PNG_Compression.h"
+#include "PNG_Data_Array.h"
+#include "PNG_Decoder.h"
+#include "PNG_IO.h"
+#include "PNG_structs.h"
+
+/* An image of pixels of the Format, holding each channel as a Channel. The channel type fixes
+ *   how rows are moved to and from the LibPNG format, so the conversion is chosen at compile
+ *   time rather than for each pixel: 8 bit rows are copied as they are, 16 bit rows have their
+ *   bytes swapped, and rows of unsigned ints are widened. Images of uint8_t of 1, 2 or 4 bits
+ *   are held packed, in rows in the LibPNG format, so that a 1 bit image takes a bit per pixel.
+ *   Rows of uint8_t, and of uint16_t at 16 bits, are decoded straight into the image.
+ *   PNG_RGB, PNG_RGBA and PNG_Grey are instances of it. */
+template<typename Format, typename Channel>
+class Image {
+public:
+    typedef typename Format::template Pixel<Channel> Pixel;
+    typedef typename Format::WidePixel WidePixel;
+    typedef ImageView<Pixel> View;
+    typedef ImageView<const Pixel> ConstView;
+
+    static constexpr unsigned int nChannels = Format::nChannels;
+    static_assert(sizeof(Pixel) == nChannels * sizeof(Channel), "Pixels must be packed channels");
+
+    // Creates an empty image, of no pixels.
+    Image();
+
+    // Creates a width x height image of colorDepth bits. Packed images start out black.
+    Image(unsigned long int width, unsigned long int height, unsigned int colorDepth);
+
+    /* Loads the image from the source, converted to the format. Throws UnsupportedColorMode if
+     *   its depth does not fit in a Channel. */
+    explicit Image(const PNG_Source &source);
+
+    ~Image() = default;
+
+    Image(const Image &) = default;
+
+    Image(Image &&) noexcept = default;
+
+    Image &operator=(const Image &) = default;
+
+    // Moving an image hands over its pixels without copying them.
+    Image &operator=(Image &&) noexcept = default;
+
+    /* Replaces the image with the one in the source, as the constructor does. The pixels of the
+     *   old image are overwritten, so loading an image no larger than the last allocates nothing. */
+    void load(const PNG_Source &source);
+
+    /* Replaces the image with the one open in the decoder, which must have been opened with
+     *   Format::transform, or another transformation to the same color type, and have had no
+     *   rows read. Throws UnsupportedColorMode if the rows are of another color type, or their
+     *   depth does not fit in a Channel. */
+    void load(PNG_Decoder &decoder);
+
+    /* Makes the image width x height pixels of colorDepth bits, keeping its pixels if they are
+     *   large enough. The pixels are left undefined. Throws UnsupportedColorMode if the depth
+     *   does not fit in a Channel. */
+    void resize(unsigned long int width, unsigned long int height, unsigned int colorDepth);
+
+    /* Returns the value of the indicated pixel. Returns nothing if pixel is
+     *   outside the bounds of the image. */
+    [[nodiscard]] std::optional<WidePixel> getPixel(unsigned long int x, unsigned long int y) const noexcept;
+
+    /* Sets the pixel at x and y to the indicated value. Returns true if
+     *   successful. Returns false if x or y are outside the bounds of the image. */
+    bool setPixel(unsigned long int x, unsigned long int y, const WidePixel &value);
+
+    /* Returns the first pixel of row y. The row holds getInfo().width pixels, which are stored
+     *   contiguously, or getRowBytes() bytes in the LibPNG format if the image is packed.
+     *   Does not check that y is in bounds. */
+    Pixel *getRow(unsigned long int y) noexcept;
+
+    [[nodiscard]] const Pixel *getRow(unsigned long int y) const noexcept;
+
+    /* Returns a view of the whole image, which stays valid until the image is loaded, resized or
+     *   destroyed. The pixels of a view of a packed image are the bytes of its rows. */
+    View view() noexcept;
+
+    [[nodiscard]] ConstView view() const noexcept;
+
+    /* Sets row y to the getInfo().width pixels of samples, nChannels to a pixel, packing
+     *   them if the image is packed. Does not check that y is in bounds. */
+    void setRow(unsigned long int y, const unsigned int *samples);
+
+    // Returns true if the samples are held packed, several to a byte, which they are below 8 bits.
+    [[nodiscard]] bool isPacked() const noexcept;
+
+    // Returns the number of bytes in a row of the image.
+    [[nodiscard]] std::size_t getRowBytes() const noexcept;
+
+    /* Returns the a struct containing
+     *   the properties of the image. */
+    [[nodiscard]] PNG_Info getInfo() const noexcept;
+
+    // Writes the PNG to the supplied file, standard output if the path is "-", or buffer.
+    void write_png_file(const PNG_Destination &destination, const PNG_Compression &compression = {});
+
+    /* Writes the pixels of the view, of colorDepth bits, as a PNG, as the member of the same name
+     *   does, without copying them into an image. Throws std::invalid_argument if the samples
+     *   are packed, as a view can not tell how many pixels its rows hold. */
+    static void write_png_file(ConstView view, unsigned int colorDepth, const PNG_Destination &destination,
+                               const PNG_Compression &compression = {});
+
+private:
+    // Sets the properties of the image and makes room for its rows, leaving them undefined.
+    void allocate(unsigned long int width, unsigned long int height, unsigned int colorDepth);
+
+    /* Returns true if the rows in the LibPNG format take exactly the bytes of the image's rows,
+     *   so that LibPNG can decode them straight into the image. */
+    [[nodiscard]] bool decodesInPlace() const noexcept;
+
+    // Returns sample i of row y, unpacking it if the image is packed.
+    [[nodiscard]] unsigned int getSample(unsigned long int y, std::size_t i) const noexcept;
+
+    PNG_Info selfInfo{};  // Image properties.
+    std::size_t rowLength = 0; // The Channels in a row, or its bytes if the image is packed.
+    PNG_Data_Array<Channel> pngData = PNG_Data_Array<Channel>(0, 0); // Row after row of the image's samples.
+};
+
+
+#endif //DITHER_IMAGE_H
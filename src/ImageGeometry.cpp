@@ -0,0 +1,68 @@
+#include "ImageGeometry.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+/* Parses text as numbers separated by separator. A field may be empty, and is then 0.
+ *   Throws std::invalid_argument, describing the text as a description, if it is not made of
+ *   nFields fields of up to 9 digits. */
+static std::vector<unsigned long int> parseFields(const std::string &text, char separator, std::size_t nFields,
+                                                  const std::string &description) {
+    std::vector<unsigned long int> fields;
+    std::istringstream stream(text);
+    std::string field;
+    while (std::getline(stream, field, separator)) {
+        if ((field.size() > 9) || (field.find_first_not_of("0123456789") != std::string::npos))
+            break;
+        fields.push_back(field.empty() ? 0 : std::stoul(field));
+    }
+    if (!text.empty() && (text.back() == separator))
+        fields.push_back(0);
+    if ((fields.size() != nFields) || (std::count(text.begin(), text.end(), separator) != (long) nFields - 1))
+        throw std::invalid_argument('\"' + text + "\" is not a valid " + description);
+    return fields;
+}
+
+PixelRect ImageGeometry::getCrop(unsigned long int imageWidth, unsigned long int imageHeight) const {
+    if (!cropping)
+        return PixelRect{0, 0, imageWidth, imageHeight};
+    if ((crop.x >= imageWidth) || (crop.y >= imageHeight) || (crop.width > imageWidth - crop.x) ||
+        (crop.height > imageHeight - crop.y))
+        throw std::invalid_argument("Crop does not lie inside the " + std::to_string(imageWidth) + 'x' +
+                                    std::to_string(imageHeight) + " image");
+    return crop;
+}
+
+void ImageGeometry::getOutputSize(const PixelRect &keptRect, unsigned long int &outputWidth,
+                                  unsigned long int &outputHeight) const noexcept {
+    outputWidth = width;
+    outputHeight = height;
+    if ((width == 0) && (height == 0)) {
+        outputWidth = keptRect.width;
+        outputHeight = keptRect.height;
+    } else if (width == 0)
+        outputWidth = std::max(1UL, (unsigned long int) (((double) keptRect.width * height / keptRect.height) + 0.5));
+    else if (height == 0)
+        outputHeight = std::max(1UL, (unsigned long int) (((double) keptRect.height * width / keptRect.width) + 0.5));
+}
+
+void ImageGeometry::parseCrop(const std::string &text) {
+    std::vector<unsigned long int> fields = parseFields(text, ',', 4, "crop");
+    if ((fields.at(2) == 0) || (fields.at(3) == 0))
+        throw std::invalid_argument('\"' + text + "\" is not a valid crop");
+    crop = PixelRect{fields.at(0), fields.at(1), fields.at(2), fields.at(3)};
+    cropping = true;
+}
+
+void ImageGeometry::parseSize(const std::string &text) {
+    std::vector<unsigned long int> fields = parseFields(text, 'x', 2, "size");
+    if ((fields.at(0) == 0) && (fields.at(1) == 0))
+        throw std::invalid_argument('\"' + text + "\" is not a valid size");
+    // A side may only be left out, not given as 0.
+    std::size_t separator = text.find('x');
+    if (((separator > 0) && (fields.at(0) == 0)) || ((separator + 1 < text.size()) && (fields.at(1) == 0)))
+        throw std::invalid_argument('\"' + text + "\" is not a valid size");
+    width = fields.at(0);
+    height = fields.at(1);
+}
@@ -0,0 +1,40 @@
+#ifndef DITHER_IMAGEGEOMETRY_H
+#define DITHER_IMAGEGEOMETRY_H
+
+#include <string>
+
+// A rectangle of pixels, whose top left pixel is at x and y.
+struct PixelRect {
+    unsigned long int x, y, width, height;
+};
+
+/* How an image is cropped and then resized before it is dithered. The crop is in the pixels
+ *   of the image. A resize with one side 0 keeps the aspect ratio of the crop. */
+struct ImageGeometry {
+    bool cropping = false;
+    PixelRect crop{};
+    unsigned long int width = 0, height = 0; // The size to resize to. The crop is kept as it is if both are 0.
+
+    [[nodiscard]] bool isSet() const noexcept {
+        return cropping || (width != 0) || (height != 0);
+    }
+
+    /* Returns the rectangle of an image of imageWidth x imageHeight pixels that is kept.
+     *   Throws std::invalid_argument if the crop does not lie inside the image. */
+    [[nodiscard]] PixelRect getCrop(unsigned long int imageWidth, unsigned long int imageHeight) const;
+
+    // Sets outputWidth and outputHeight to the size the crop is resized to.
+    void getOutputSize(const PixelRect &keptRect, unsigned long int &outputWidth,
+                       unsigned long int &outputHeight) const noexcept;
+
+    /* Sets the crop from "x,y,width,height". Throws std::invalid_argument if the text is malformed
+     *   or the crop is empty. */
+    void parseCrop(const std::string &text);
+
+    /* Sets the size from "WIDTHxHEIGHT", "WIDTHx" or "xHEIGHT". Throws std::invalid_argument if the
+     *   text is malformed or either side is 0. */
+    void parseSize(const std::string &text);
+};
+
+
+#endif //DITHER_IMAGEGEOMETRY_H
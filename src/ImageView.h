@@ -0,0 +1,70 @@
+#ifndef DITHER_IMAGEVIEW_H
+#define DITHER_IMAGEVIEW_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+/* A view of pixels held elsewhere, such as by an Image or a caller's buffer, that does not own
+ *   them. Rows are stride bytes apart, so a view of a rectangle of an image, or of a band of
+ *   its rows, is made without copying any pixels. Pixel is const for views that only read.
+ *   Views are the size of a few pointers, and are passed by value. */
+template<typename Pixel>
+class ImageView {
+public:
+    // Creates a view of no pixels.
+    ImageView() = default;
+
+    ImageView(Pixel *pixels, unsigned long int width, unsigned long int height, std::size_t stride) noexcept
+            : pixels(pixels), width(width), height(height), stride(stride) {}
+
+    // A view that writes converts to a view of the same pixels that only reads.
+    template<typename Other, typename = std::enable_if_t<std::is_convertible_v<Other (*)[], Pixel (*)[]>>>
+    ImageView(const ImageView<Other> &other) noexcept
+            : ImageView(other.getRow(0), other.getWidth(), other.getHeight(), other.getStride()) {}
+
+    // Returns the first pixel of row y. Does not check that y is in bounds.
+    Pixel *getRow(unsigned long int y) const noexcept {
+        return reinterpret_cast<Pixel *>(reinterpret_cast<Byte *>(pixels) + (y * stride));
+    }
+
+    [[nodiscard]] unsigned long int getWidth() const noexcept {
+        return width;
+    }
+
+    [[nodiscard]] unsigned long int getHeight() const noexcept {
+        return height;
+    }
+
+    // Returns the number of bytes from the start of a row to the start of the next.
+    [[nodiscard]] std::size_t getStride() const noexcept {
+        return stride;
+    }
+
+    /* Returns a view of the subWidth x subHeight pixels whose top left pixel is at x and y.
+     *   Throws std::out_of_range if they do not lie inside the view. */
+    [[nodiscard]] ImageView subView(unsigned long int x, unsigned long int y, unsigned long int subWidth,
+                                    unsigned long int subHeight) const {
+        if ((x > width) || (subWidth > width - x) || (y > height) || (subHeight > height - y))
+            throw std::out_of_range("The rectangle does not lie inside the view");
+        return ImageView(getRow(y) + x, subWidth, subHeight, stride);
+    }
+
+    /* Returns a view of rows first up to, but not including, last. Throws std::out_of_range if
+     *   they do not lie inside the view. */
+    [[nodiscard]] ImageView rows(unsigned long int first, unsigned long int last) const {
+        if (first > last)
+            throw std::out_of_range("The rows do not lie inside the view");
+        return subView(0, first, width, last - first);
+    }
+
+private:
+    typedef std::conditional_t<std::is_const_v<Pixel>, const unsigned char, unsigned char> Byte;
+
+    Pixel *pixels = nullptr;
+    unsigned long int width = 0, height = 0;
+    std::size_t stride = 0;
+};
+
+
+#endif //DITHER_IMAGEVIEW_H
@@ -0,0 +1,63 @@
+#include "LevelKernel.h"
+
+void LevelKernel::setSteps(unsigned int maxValue) {
+    unsigned int nSteps = (1U << bitDepth) - 1;
+    steps.resize((std::size_t) maxValue + 1);
+    for (unsigned int value = 0; value <= maxValue; value++) {
+        std::uint32_t scaled = value * nSteps;
+        steps[value] = ((scaled / maxValue) << 16U) | (scaled % maxValue);
+    }
+}
+
+template<unsigned int BitDepth>
+void LevelKernel::packRow(const GreyPixel *input, png_bytep output, unsigned long int width,
+                          unsigned long int y) const {
+    constexpr unsigned int nPixelsInByte = 8 / BitDepth;
+    const unsigned int *rowThresholds = thresholds.data() + ((y & rowMask) * matrixSize);
+    auto level = [&](unsigned long int x) {
+        std::uint32_t step = steps[input[x]];
+        return (step >> 16U) + ((step & 0xFFFFU) > rowThresholds[x & rowMask]);
+    };
+
+    unsigned long int x = 0;
+    for (; x + nPixelsInByte <= width; x += nPixelsInByte) {
+        unsigned int packed = 0;
+        for (unsigned int i = 0; i < nPixelsInByte; i++)
+            packed = (packed << BitDepth) | level(x + i);
+        output[x / nPixelsInByte] = (png_byte) packed;
+    }
+
+    // The last pixels are shifted up to the top of their byte, leaving the unused bits clear.
+    if (x < width) {
+        unsigned int packed = 0;
+        for (unsigned long int i = x; i < width; i++)
+            packed = (packed << BitDepth) | level(i);
+        output[x / nPixelsInByte] = (png_byte) (packed << ((nPixelsInByte - (width - x)) * BitDepth));
+    }
+}
+
+void LevelKernel::applyToRow(const GreyPixel *input, png_bytep output, unsigned long int width,
+                             unsigned long int y) const {
+    switch (bitDepth) {
+        case 1:
+            thresholdKernel.applyToRow32Bits(input, output, width, y);
+            break;
+        case 2:
+            packRow<2>(input, output, width, y);
+            break;
+        case 4:
+            packRow<4>(input, output, width, y);
+            break;
+        default:
+            packRow<8>(input, output, width, y);
+            break;
+    }
+}
+
+unsigned int LevelKernel::getBitDepth() const noexcept {
+    return bitDepth;
+}
+
+bool LevelKernel::isSupportedDepth(unsigned int bitDepth) noexcept {
+    return (bitDepth == 1) || (bitDepth == 2) || (bitDepth == 4) || (bitDepth == 8);
+}
@@ -0,0 +1,65 @@
+#ifndef DITHER_LEVELKERNEL_H
+#define DITHER_LEVELKERNEL_H
+
+#include <png.h>
+#include <cstdint>
+#include <vector>
+#include "BayerMatrix.h"
+#include "PNG_structs.h"
+#include "ThresholdKernel.h"
+
+/* Ordered dithering of greyscale to the 2^bitDepth levels of 1, 2, 4 or 8 bit output. A sample
+ *   of value v in [0, maxValue] lies v * (2^bitDepth - 1) / maxValue levels up, and is rounded
+ *   up to the level above when the remainder of that division exceeds the threshold of its
+ *   matrix entry. The remainders are in units of 1 / maxValue of a level, as samples are, so
+ *   the thresholds are those of ThresholdKernel, and the level and remainder of every sample
+ *   value are precomputed, leaving a lookup and a compare per pixel. At 1 bit every level is
+ *   the whole range, so ThresholdKernel's vector kernels are used instead. Rows are written in
+ *   the LibPNG format, a byte at a time. */
+class LevelKernel {
+public:
+    // Sets up the thresholds of an N x N matrix for samples in [0, maxValue], which must be at most 65535.
+    template<unsigned int N>
+    LevelKernel(BayerMatrix<N> map, unsigned int maxValue, unsigned int bitDepth)
+            : bitDepth(bitDepth), thresholdKernel(map, maxValue, 1, 1), matrixSize(N), rowMask(BayerMatrix<N>::mask) {
+        thresholds.resize(BayerMatrix<N>::nLevels);
+        for (unsigned int y = 0; y < N; y++) {
+            for (unsigned int x = 0; x < N; x++) {
+                unsigned int t = map.at(x, y);
+                thresholds[(y * N) + x] =
+                        (unsigned int) (((unsigned long long int) t * maxValue) / BayerMatrix<N>::nLevels);
+            }
+        }
+        if (bitDepth > 1)
+            setSteps(maxValue);
+    }
+
+    /* Dithers the width samples of row y into a LibPNG row of bitDepth bits per pixel, the first
+     *   pixel in the most significant bits. The output must hold
+     *   PNG_Loader::getPackedRowBytes(width, bitDepth) bytes, as a row of a PNG_Grey of bitDepth
+     *   bits does. Unused bits of the last byte are cleared. */
+    void applyToRow(const GreyPixel *input, png_bytep output, unsigned long int width, unsigned long int y) const;
+
+    [[nodiscard]] unsigned int getBitDepth() const noexcept;
+
+    // Returns true if bitDepth is a depth that greyscale output can have(1, 2, 4 or 8).
+    static bool isSupportedDepth(unsigned int bitDepth) noexcept;
+
+private:
+    // Sets up the level and remainder of every sample value in [0, maxValue].
+    void setSteps(unsigned int maxValue);
+
+    // Dithers and packs the row, 8 / BitDepth pixels to each byte.
+    template<unsigned int BitDepth>
+    void packRow(const GreyPixel *input, png_bytep output, unsigned long int width, unsigned long int y) const;
+
+    unsigned int bitDepth;
+    ThresholdKernel thresholdKernel; // Used for 1 bit output.
+    unsigned int matrixSize;
+    unsigned long int rowMask;
+    std::vector<unsigned int> thresholds; // Row by row, matrixSize thresholds to a row.
+    std::vector<std::uint32_t> steps;     // The level of each sample value above 16 bits, its remainder below.
+};
+
+
+#endif //DITHER_LEVELKERNEL_H
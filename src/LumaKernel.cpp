@@ -0,0 +1,156 @@
+#include "LumaKernel.h"
+#include "PNG_Loader.h"
+#include "ThresholdKernel.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DITHER_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Returns sample i of a raw LibPNG row whose samples take nBytesPerColor bytes, most significant first.
+static inline std::uint32_t getRawSample(png_const_bytep input, std::size_t i, unsigned int nBytesPerColor) {
+    if (nBytesPerColor == 2)
+        return ((std::uint32_t) input[2 * i] << 8U) | input[(2 * i) + 1];
+    return input[i];
+}
+
+/* The scalar kernel. It is used on CPUs without AVX2, and for the pixels left over after the
+ *   last whole vector. Converts the pixels from first onwards. */
+static void rawRowToGreyScalar(png_const_bytep input, GreyPixel *output, unsigned long int first,
+                               unsigned long int width, unsigned int nChannels, unsigned int nBytesPerColor) {
+    if (nChannels == 1) {
+        for (unsigned long int x = first; x < width; x++)
+            output[x] = getRawSample(input, x, nBytesPerColor);
+        return;
+    }
+    for (unsigned long int x = first; x < width; x++) {
+        std::size_t i = 3 * (std::size_t) x;
+        output[x] = LumaKernel::toGrey(getRawSample(input, i, nBytesPerColor),
+                                       getRawSample(input, i + 1, nBytesPerColor),
+                                       getRawSample(input, i + 2, nBytesPerColor));
+    }
+}
+
+#ifdef DITHER_X86_SIMD
+
+/* AVX2 kernels, 4 to 8 pixels at a time. Each returns the number of pixels it converted, leaving
+ *   the rest to the scalar kernel. The channels of RGB pixels are gathered into 32 bit lanes with
+ *   byte shuffles, which SSE2 does not have, so SSE2 uses the scalar kernel. */
+
+__attribute__((target("avx2")))
+static inline __m256i weighColors(__m256i red, __m256i green, __m256i blue) {
+    __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(red, _mm256_set1_epi32((int) LumaKernel::redWeight)),
+                                   _mm256_mullo_epi32(green, _mm256_set1_epi32((int) LumaKernel::greenWeight)));
+    sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(blue, _mm256_set1_epi32((int) LumaKernel::blueWeight)));
+    return _mm256_srli_epi32(sum, LumaKernel::weightBits);
+}
+
+// Loads 16 bytes from input into the low lane, and 16 bytes from input + offset into the high lane.
+__attribute__((target("avx2")))
+static inline __m256i loadLanes(png_const_bytep input, std::size_t offset) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) input)),
+                                   _mm_loadu_si128((const __m128i *) (input + offset)), 1);
+}
+
+__attribute__((target("avx2")))
+static unsigned long int grey8ToGreyAVX2(png_const_bytep input, GreyPixel *output, unsigned long int width) {
+    unsigned long int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i grey = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (input + x)));
+        _mm256_storeu_si256((__m256i *) (output + x), grey);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static unsigned long int grey16ToGreyAVX2(png_const_bytep input, GreyPixel *output, unsigned long int width) {
+    const __m128i swapBytes = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    unsigned long int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i samples = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (input + (2 * x))), swapBytes);
+        _mm256_storeu_si256((__m256i *) (output + x), _mm256_cvtepu16_epi32(samples));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static unsigned long int rgb8ToGreyAVX2(png_const_bytep input, GreyPixel *output, unsigned long int width) {
+    // Each lane holds 4 pixels, of which each channel is moved to the low byte of a 32 bit lane.
+    const __m256i redShuffle = _mm256_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1,
+                                                0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m256i greenShuffle = _mm256_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1,
+                                                  1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+    const __m256i blueShuffle = _mm256_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1,
+                                                 2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+    unsigned long int x = 0;
+    // The high lane loads 4 bytes past the 8 pixels, so the loop stops while they are still in the row.
+    for (; x + 10 <= width; x += 8) {
+        __m256i bytes = loadLanes(input + (3 * x), 12);
+        __m256i grey = weighColors(_mm256_shuffle_epi8(bytes, redShuffle), _mm256_shuffle_epi8(bytes, greenShuffle),
+                                   _mm256_shuffle_epi8(bytes, blueShuffle));
+        _mm256_storeu_si256((__m256i *) (output + x), grey);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static unsigned long int rgb16ToGreyAVX2(png_const_bytep input, GreyPixel *output, unsigned long int width) {
+    // Each lane holds 2 pixels, of which each channel is moved to the low half of a 32 bit lane, swapping its bytes.
+    const __m256i redShuffle = _mm256_setr_epi8(1, 0, -1, -1, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                1, 0, -1, -1, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i greenShuffle = _mm256_setr_epi8(3, 2, -1, -1, 9, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                  3, 2, -1, -1, 9, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i blueShuffle = _mm256_setr_epi8(5, 4, -1, -1, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                 5, 4, -1, -1, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i gatherPixels = _mm256_setr_epi32(0, 1, 4, 5, 0, 0, 0, 0);
+    unsigned long int x = 0;
+    // The high lane loads 4 bytes past the 4 pixels, so the loop stops while they are still in the row.
+    for (; x + 5 <= width; x += 4) {
+        __m256i bytes = loadLanes(input + (6 * x), 12);
+        __m256i grey = weighColors(_mm256_shuffle_epi8(bytes, redShuffle), _mm256_shuffle_epi8(bytes, greenShuffle),
+                                   _mm256_shuffle_epi8(bytes, blueShuffle));
+        grey = _mm256_permutevar8x32_epi32(grey, gatherPixels);
+        _mm_storeu_si128((__m128i *) (output + x), _mm256_castsi256_si128(grey));
+    }
+    return x;
+}
+
+#endif
+
+void LumaKernel::rawRowToGrey(png_const_bytep input, GreyPixel *output, unsigned long int width,
+                              unsigned int nChannels, unsigned int nBytesPerColor) {
+    unsigned long int first = 0;
+#ifdef DITHER_X86_SIMD
+    if (ThresholdKernel::getInstructionSet() == InstructionSet::AVX2) {
+        static_assert(sizeof(GreyPixel) == 4, "Grey pixels must be 32 bit lanes");
+        if (nChannels == 1)
+            first = (nBytesPerColor == 2) ? grey16ToGreyAVX2(input, output, width)
+                                          : grey8ToGreyAVX2(input, output, width);
+        else
+            first = (nBytesPerColor == 2) ? rgb16ToGreyAVX2(input, output, width)
+                                          : rgb8ToGreyAVX2(input, output, width);
+    }
+#endif
+    rawRowToGreyScalar(input, output, first, width, nChannels, nBytesPerColor);
+}
+
+void LumaKernel::transformToGreyOrRGB(png_structp pngStructp, png_infop infoPtr) {
+    PNG_Loader::readInfo(pngStructp, infoPtr);
+    png_byte colorType = png_get_color_type(pngStructp, infoPtr);
+
+    // Greyscale stays greyscale, expanded to at least 8 bits, without any alpha channel.
+    if ((colorType == PNG_COLOR_TYPE_GRAY) || (colorType == PNG_COLOR_TYPE_GRAY_ALPHA)) {
+        png_set_expand_gray_1_2_4_to_8(pngStructp);
+        if (colorType == PNG_COLOR_TYPE_GRAY_ALPHA)
+            png_set_strip_alpha(pngStructp);
+        return;
+    }
+
+    // Everything else becomes RGB, as in RGB_Format::transform.
+    if (colorType == PNG_COLOR_TYPE_RGBA)
+        png_set_strip_alpha(pngStructp);
+    if (colorType == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(pngStructp);
+        png_set_strip_alpha(pngStructp);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef DITHER_LUMAKERNEL_H
+#define DITHER_LUMAKERNEL_H
+
+#include <png.h>
+#include <cstdint>
+#include "PNG_structs.h"
+
+/* Fixed-point conversion of color to greyscale. Colors are weighted by luminosity, 0.21 red,
+ *   0.72 green and 0.07 blue, as integers of weightBits bits. The weights sum to exactly
+ *   1 << weightBits, so grey pixels convert to themselves. Rows are converted straight from
+ *   the LibPNG format, using the instruction set chosen for ThresholdKernel. */
+class LumaKernel {
+public:
+    static constexpr std::uint32_t redWeight = 13763;
+    static constexpr std::uint32_t greenWeight = 47186;
+    static constexpr std::uint32_t blueWeight = 4587;
+    static constexpr unsigned int weightBits = 16;
+    static_assert(redWeight + greenWeight + blueWeight == (1U << weightBits), "The weights must sum to 1");
+
+    // Converts a color of up to 16 bits per channel to greyscale.
+    static constexpr std::uint32_t toGrey(std::uint32_t red, std::uint32_t green, std::uint32_t blue) noexcept {
+        return ((redWeight * red) + (greenWeight * green) + (blueWeight * blue)) >> weightBits;
+    }
+
+    /* Converts a raw LibPNG row of width pixels to greyscale. Pixels hold nChannels samples, 1 for
+     *   grey, which is copied as it is, or 3 for RGB, of nBytesPerColor bytes, most significant first. */
+    static void rawRowToGrey(png_const_bytep input, GreyPixel *output, unsigned long int width,
+                             unsigned int nChannels, unsigned int nBytesPerColor);
+
+    /* Opens the stream and sets up the LibPNG transformations that convert greyscale PNGs into
+     *   8 or 16 bit grey, and every other PNG into RGB as RGB_Format::transform does. Greyscale
+     *   images then need no conversion, and take a third of the memory of RGB. */
+    static void transformToGreyOrRGB(png_structp pngStructp, png_infop infoPtr);
+};
+
+
+#endif //DITHER_LUMAKERNEL_H
@@ -0,0 +1,74 @@
+#include "PNG_Compression.h"
+#include <png.h>
+#include <zlib.h>
+#include <stdexcept>
+#include <utility>
+
+// The names accepted for each zlib strategy and LibPNG filter setting.
+static const std::pair<const char *, int> strategyNames[] = {
+        {"default",  Z_DEFAULT_STRATEGY},
+        {"filtered", Z_FILTERED},
+        {"huffman",  Z_HUFFMAN_ONLY},
+        {"rle",      Z_RLE},
+        {"fixed",    Z_FIXED},
+};
+
+static const std::pair<const char *, int> filterNames[] = {
+        {"none",    PNG_FILTER_NONE},
+        {"sub",     PNG_FILTER_SUB},
+        {"up",      PNG_FILTER_UP},
+        {"average", PNG_FILTER_AVG},
+        {"paeth",   PNG_FILTER_PAETH},
+        {"all",     PNG_ALL_FILTERS},
+};
+
+PNG_Compression PNG_Compression::fromProfile(const std::string &profileName) {
+    /* Measured on Bayer and error diffused images, fast takes about a quarter of the time of
+     *   LibPNG's defaults and balanced about half, for files 5-30% and 5-10% larger. Small
+     *   saves a few percent more than the defaults, at several times the time. */
+    PNG_Compression compression;
+    compression.profileName = profileName;
+    if (profileName == "fast") {
+        compression.level = 1;
+        compression.strategy = Z_RLE;
+        compression.filters = PNG_FILTER_NONE;
+    } else if (profileName == "balanced") {
+        compression.level = 4;
+        compression.strategy = Z_DEFAULT_STRATEGY;
+        compression.filters = PNG_FILTER_NONE;
+    } else if (profileName == "small") {
+        compression.level = 9;
+        compression.strategy = Z_DEFAULT_STRATEGY;
+        compression.filters = PNG_FILTER_NONE;
+    } else
+        throw std::invalid_argument('\"' + profileName + "\" is not a valid compression profile");
+    return compression;
+}
+
+int PNG_Compression::parseStrategy(const std::string &strategyName) {
+    for (const auto &name : strategyNames)
+        if (strategyName == name.first)
+            return name.second;
+    throw std::invalid_argument('\"' + strategyName + "\" is not a valid compression strategy");
+}
+
+int PNG_Compression::parseFilters(const std::string &filterName) {
+    for (const auto &name : filterNames)
+        if (filterName == name.first)
+            return name.second;
+    throw std::invalid_argument('\"' + filterName + "\" is not a valid filter");
+}
+
+std::string PNG_Compression::describe() const {
+    std::string strategyName = "default";
+    for (const auto &name : strategyNames)
+        if (strategy == name.second)
+            strategyName = name.first;
+    std::string filterName = "default";
+    for (const auto &name : filterNames)
+        if (filters == name.second)
+            filterName = name.first;
+
+    return profileName + " (level " + ((level == useLibPNGDefault) ? "default" : std::to_string(level)) +
+           ", strategy " + strategyName + ", filters " + filterName + ')';
+}
@@ -0,0 +1,35 @@
+#ifndef DITHER_PNG_COMPRESSION_H
+#define DITHER_PNG_COMPRESSION_H
+
+#include <string>
+
+/* How a PNG is compressed: the zlib level and strategy, and the row filters LibPNG may choose
+ *   from. Any setting left at useLibPNGDefault is chosen by LibPNG, which filters images of 8 bits
+ *   and more adaptively and uses zlib level 6. Dithered images are made of few colors in
+ *   repeating patterns, so they compress as well without filtering, at a fraction of the time. */
+struct PNG_Compression {
+    static constexpr int useLibPNGDefault = -1;
+
+    /* Returns the settings of a named profile: "fast", "balanced" or "small".
+     *   Throws std::invalid_argument if the name is not recognized. */
+    static PNG_Compression fromProfile(const std::string &profileName);
+
+    /* Returns the zlib strategy named "default", "filtered", "huffman", "rle" or "fixed".
+     *   Throws std::invalid_argument if the name is not recognized. */
+    static int parseStrategy(const std::string &strategyName);
+
+    /* Returns the LibPNG filter flags named "none", "sub", "up", "average", "paeth" or "all", in
+     *   which case LibPNG picks a filter for each row. Throws std::invalid_argument if the name is not recognized. */
+    static int parseFilters(const std::string &filterName);
+
+    // Returns a description of the settings, such as "balanced (level 4, strategy default, filters none)".
+    [[nodiscard]] std::string describe() const;
+
+    std::string profileName = "default"; // The profile the settings came from, for describe().
+    int level = useLibPNGDefault;        // The zlib level, from 0 for no compression to 9.
+    int strategy = useLibPNGDefault;     // A zlib strategy, such as Z_RLE.
+    int filters = useLibPNGDefault;      // LibPNG filter flags, such as PNG_FILTER_NONE.
+};
+
+
+#endif //DITHER_PNG_COMPRESSION_H
@@ -1,25 +1,46 @@
 #ifndef DITHER_PNG_DATA_ARRAY_H
 #define DITHER_PNG_DATA_ARRAY_H
 
+#include <algorithm>
+#include <type_traits>
+#include "BufferPool.h"
 #include "PNG_structs.h"
 
-/* Essentially an array with added functions that allow for easy copying. */
+/* Essentially an array with added functions that allow for easy copying.
+ *   Moving an array hands over its data without copying it. The data is one
+ *   block from BufferPool, aligned to a cache line, and is given back to the
+ *   pool when the array is freed. Empty arrays allocate nothing. */
 template <typename T>
 class PNG_Data_Array {
 public:
-    explicit PNG_Data_Array(unsigned long long nPixels, unsigned int nBits) : _nBits(nBits), _nPixels(nPixels) {
-        _data = new T[nPixels];
+    static_assert(std::is_trivial_v<T>, "Elements are left uninitialised, so must be trivial");
+
+    explicit PNG_Data_Array(unsigned long long nPixels, unsigned int nBits)
+            : _nBits(nBits), _nPixels(nPixels) {
+        _data = allocate(nPixels, _capacity, _blockBytes);
     };
 
     PNG_Data_Array(const PNG_Data_Array<T> &source) {
         _data = nullptr;
         _nPixels = 0;
+        _capacity = 0;
+        _blockBytes = 0;
         _nBits = 0;
         operator=(source);
     };
 
+    // Takes the array of the source, leaving the source empty. Nothing is copied.
+    PNG_Data_Array(PNG_Data_Array<T> &&source) noexcept
+            : _data(source._data), _nBits(source._nBits), _nPixels(source._nPixels), _capacity(source._capacity),
+              _blockBytes(source._blockBytes) {
+        source._data = nullptr;
+        source._nPixels = 0;
+        source._capacity = 0;
+        source._blockBytes = 0;
+    };
+
     ~PNG_Data_Array() {
-        delete[] _data;
+        BufferPool::release(_data, _blockBytes);
     };
 
     // Returns element at n.
@@ -32,35 +53,86 @@ public:
         return _data[n];
     };
 
+    // Returns the underlying array.
+    T *data() noexcept {
+        return _data;
+    };
+
+    // Returns the underlying array.
+    [[nodiscard]] const T *data() const noexcept {
+        return _data;
+    };
+
     // Assignment operator
     PNG_Data_Array<T> &operator=(const PNG_Data_Array<T> &other) {
-        /* If the source and destination are the same, do nothing.
-         *   This is also necessary to avoid a seg-fault */
-        if ((_data != other._data) || (this == &other)) {
-            // Delete the old data
-            delete[] _data;
+        // If the source and destination are the same, do nothing.
+        if (this != &other) {
+            // Make room for the source's elements, keeping the old array if it is large enough.
+            resize(other._nPixels, other._nBits);
+
+            // Transfer the contents from the source array to the destination array.
+            std::copy(other._data, other._data + _nPixels, _data);
+        }
 
-            // Set the number of pixel and create the new array.
+        return *this;
+    }
+
+    // Move assignment. Frees the old array and takes the array of the source, leaving the source empty.
+    PNG_Data_Array<T> &operator=(PNG_Data_Array<T> &&other) noexcept {
+        if (this != &other) {
+            BufferPool::release(_data, _blockBytes);
+            _data = other._data;
             _nPixels = other._nPixels;
+            _capacity = other._capacity;
+            _blockBytes = other._blockBytes;
             _nBits = other._nBits;
-            _data = new T[_nPixels];
-
-            // Transfer the contents from the source array to the destination array.
-            for (unsigned long long i = 0; i < _nPixels; i++)
-                _data[i] = other._data[i];
+            other._data = nullptr;
+            other._nPixels = 0;
+            other._capacity = 0;
+            other._blockBytes = 0;
         }
 
         return *this;
     }
 
+    /* Resizes the array to nPixels elements. The old array is kept if it is large enough, so
+     *   that reusing an array for images of similar size allocates nothing. The contents are
+     *   left as they are, rather than cleared. */
+    void resize(unsigned long long nPixels, unsigned int nBits) {
+        if (nPixels > _capacity) {
+            BufferPool::release(_data, _blockBytes);
+            _data = nullptr;
+            _nPixels = 0;
+            _capacity = 0;
+            _blockBytes = 0;
+            _data = allocate(nPixels, _capacity, _blockBytes);
+        }
+        _nPixels = nPixels;
+        _nBits = nBits;
+    }
+
     [[nodiscard]] unsigned int getDepthInBits() const noexcept {
         return _nBits;
     };
 
 protected:
+    /* Returns a new array of at least nElements elements, or nullptr if there are none, and sets
+     *   capacity to the elements it holds and blockBytes to the size of its block. */
+    static T *allocate(unsigned long long nElements, unsigned long long &capacity, std::size_t &blockBytes) {
+        capacity = 0;
+        blockBytes = 0;
+        if (nElements == 0)
+            return nullptr;
+        T *data = static_cast<T *>(BufferPool::allocate(nElements * sizeof(T), blockBytes));
+        capacity = blockBytes / sizeof(T);
+        return data;
+    }
+
     T *_data; // Data array
     unsigned int _nBits;
     unsigned long long _nPixels;
+    unsigned long long _capacity; // Elements allocated, at least _nPixels.
+    std::size_t _blockBytes = 0; // The size of the block from BufferPool, or 0 if there is none.
 };
 
 
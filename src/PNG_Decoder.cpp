@@ -0,0 +1,137 @@
+#include "PNG_Decoder.h"
+#include <stdexcept>
+#include "DitherStats.h"
+#include "PixelFormat.h"
+
+PNG_Decoder::PNG_Decoder(const PNG_Source &source, Transform transform) {
+    open(source, transform);
+}
+
+void PNG_Decoder::open(const PNG_Source &source, Transform transform) {
+    reset();
+
+    /* Setup LibPNG's PNG and INFO structs, with errors reported through PNG_Loader::handleError.
+     *   LibPNG has no way to reset a struct for a new file, so a new pair is made every time. */
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, &errorMessage, PNG_Loader::handleError,
+                                     PNG_Loader::handleWarning);
+    if (!png_ptr)
+        throw std::runtime_error("Internal Error: Could not create PNG object");
+    info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr) {
+        reset();
+        throw std::runtime_error("Internal Error: Could not create info object");
+    }
+
+    // Open the source. If it can not be opened, or is not a PNG, throw.
+    try {
+        input.open(source);
+    } catch (...) {
+        reset();
+        throw;
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        reset();
+        throw std::runtime_error(errorMessage);
+    }
+
+    // By default, apply the same transformations as a fully loaded PNG_RGB, those of RGB_Format.
+    input.attach(png_ptr);
+    if (transform)
+        transform(png_ptr, info_ptr);
+    else
+        RGB_Format::transform(png_ptr, info_ptr);
+
+    // Load the image's final properties.
+    try {
+        selfInfo = PNG_Loader::getPNGInfo(png_ptr, info_ptr);
+    } catch (UnsupportedColorMode &e) {
+        reset();
+        throw;
+    }
+
+    nBytesPerColor = PNG_Loader::getBytesPerPixel(selfInfo);
+    rowBuffer.resize(png_get_rowbytes(png_ptr, info_ptr));
+}
+
+PNG_Decoder::~PNG_Decoder() {
+    reset();
+}
+
+void PNG_Decoder::reset() noexcept {
+    if (png_ptr)
+        png_destroy_read_struct(&png_ptr, info_ptr ? &info_ptr : nullptr, nullptr);
+    png_ptr = nullptr;
+    info_ptr = nullptr;
+    DitherStats::addInputBytes(input.getBytesRead());
+    input.close();
+    selfInfo = PNG_Info{};
+    nextRow = 0;
+}
+
+bool PNG_Decoder::isOpen() const noexcept {
+    return png_ptr != nullptr;
+}
+
+PNG_Info PNG_Decoder::getInfo() const noexcept {
+    return selfInfo;
+}
+
+void PNG_Decoder::readRow(RGB_Pixel *row) {
+    if (selfInfo.colorType != PNG_ColorType::RGB_truecolor)
+        throw std::runtime_error("Attempted to read an RGB row from a non-RGB image");
+    readRawRow(rowBuffer.data());
+
+    // Transfer the row from the LibPNG format to RGB pixels.
+    DitherStats::Timer timer(DitherStage::conversion);
+    const png_byte *ptr = rowBuffer.data();
+    for (unsigned long int x = 0; x < selfInfo.width; x++) {
+        RGB_Pixel result = RGB_Pixel{0, 0, 0};
+        for (unsigned int i = 0; i < nBytesPerColor; i++)
+            result.red += ptr[(0 * nBytesPerColor) + i] << (((nBytesPerColor - 1) - i) * 8);
+
+        for (unsigned int i = 0; i < nBytesPerColor; i++)
+            result.green += ptr[(1 * nBytesPerColor) + i] << (((nBytesPerColor - 1) - i) * 8);
+
+        for (unsigned int i = 0; i < nBytesPerColor; i++)
+            result.blue += ptr[(2 * nBytesPerColor) + i] << (((nBytesPerColor - 1) - i) * 8);
+
+        row[x] = result;
+        ptr += 3 * nBytesPerColor;
+    }
+}
+
+void PNG_Decoder::readRawRow(png_bytep row) {
+    if (!isOpen())
+        throw std::runtime_error("Attempted to read from a decoder with no file open");
+    if (nextRow >= selfInfo.height)
+        throw std::runtime_error("Attempted to read past the last row");
+    if (selfInfo.numberOfPasses > 1)
+        throw InterlacedPNG();
+
+    DitherStats::Timer timer(DitherStage::decode);
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        throw std::runtime_error(errorMessage);
+    }
+    png_read_row(png_ptr, row, nullptr);
+    nextRow++;
+}
+
+void PNG_Decoder::readImage(png_bytep *rows) {
+    if (!isOpen())
+        throw std::runtime_error("Attempted to read from a decoder with no file open");
+    if (nextRow != 0)
+        throw std::runtime_error("Attempted to read a whole image after reading rows of it");
+
+    // LibPNG runs every pass of an interlaced image, as interlace handling was set up on opening.
+    DitherStats::Timer timer(DitherStage::decode);
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        throw std::runtime_error(errorMessage);
+    }
+    png_read_image(png_ptr, rows);
+    nextRow = selfInfo.height;
+}
+
+std::size_t PNG_Decoder::getRowBytes() const noexcept {
+    return rowBuffer.size();
+}
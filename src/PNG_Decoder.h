@@ -0,0 +1,80 @@
+#ifndef DITHER_PNG_DECODER_H
+#define DITHER_PNG_DECODER_H
+
+#include <png.h>
+#include <string>
+#include <vector>
+#include "PNG_IO.h"
+#include "PNG_Loader.h"
+#include "PNG_structs.h"
+
+/* Decodes a PNG, either one row at a time or as a whole image. When decoding row by row,
+ *   only the current row is ever held in memory, so images of any height can be processed
+ *   with a buffer the size of one row. Interlaced images can only be decoded as a whole.
+ *   A decoder is a session that can be reused: open() starts on a new PNG, closing the
+ *   last one, and the buffers of the last image are kept for the next. The decoder owns its
+ *   source and LibPNG structs, and frees them when it is reset or destroyed. LibPNG errors
+ *   are thrown as std::runtime_error, holding LibPNG's message. */
+class PNG_Decoder {
+public:
+    /* Reads the properties of the PNG, and sets up the transformations applied
+     *   to its rows, such as RGB_Format::transform. */
+    typedef void (*Transform)(png_structp pngStructp, png_infop infoPtr);
+
+    // Creates a decoder with no file open.
+    PNG_Decoder() = default;
+
+    // Opens the PNG, as open() does.
+    explicit PNG_Decoder(const PNG_Source &source, Transform transform = nullptr);
+
+    ~PNG_Decoder();
+
+    PNG_Decoder(const PNG_Decoder &) = delete;
+
+    PNG_Decoder &operator=(const PNG_Decoder &) = delete;
+
+    /* Opens the PNG in the source, which may be a file, standard input or a buffer, closing any
+     *   PNG that is already open. The rows are transformed by transform, or to RGB exactly as
+     *   PNG_RGB does if it is not supplied. Throws BadPath if the source can not be opened,
+     *   NotPNG if it is not a PNG and UnsupportedColorMode if its color mode is not supported. */
+    void open(const PNG_Source &source, Transform transform = nullptr);
+
+    // Closes the source, if one is open, and frees LibPNG's structs. The decoder can then be opened again.
+    void reset() noexcept;
+
+    [[nodiscard]] bool isOpen() const noexcept;
+
+    /* Returns the a struct containing
+     *   the properties of the image. */
+    [[nodiscard]] PNG_Info getInfo() const noexcept;
+
+    /* Decodes the next row of the image into the supplied array, which must hold
+     *   at least getInfo().width pixels. Throws if every row has already been read. */
+    void readRow(RGB_Pixel *row);
+
+    /* Decodes the next row of the image into the supplied array in the LibPNG format, 3 samples
+     *   per pixel for RGB and 4 for RGBA, with 16 bit samples most significant byte first. The array
+     *   must hold at least getRowBytes() bytes. Throws InterlacedPNG if the image is interlaced. */
+    void readRawRow(png_bytep row);
+
+    /* Decodes the whole image in the LibPNG format, including interlaced images. rows must
+     *   hold getInfo().height rows of getRowBytes() bytes. No rows may have been read before. */
+    void readImage(png_bytep *rows);
+
+    // Returns the number of bytes in a row in the LibPNG format.
+    [[nodiscard]] std::size_t getRowBytes() const noexcept;
+
+private:
+    png_structp png_ptr = nullptr;
+    png_infop info_ptr = nullptr;
+    PNG_InputStream input;
+    std::string errorMessage; // The last LibPNG error, set by PNG_Loader::handleError.
+
+    PNG_Info selfInfo{};  // Image properties.
+    unsigned int nBytesPerColor = 1;
+    unsigned long int nextRow = 0;
+    std::vector<png_byte> rowBuffer; // Raw LibPNG data for the current row.
+};
+
+
+#endif //DITHER_PNG_DECODER_H
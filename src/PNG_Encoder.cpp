@@ -0,0 +1,244 @@
+#include "PNG_Encoder.h"
+#include "DitherStats.h"
+#include "PNG_Indexed.h"
+#include <stdexcept>
+#include <algorithm>
+
+PNG_Encoder::PNG_Encoder(const PNG_Destination &destination, unsigned long int width, unsigned long int height,
+                         unsigned int colorDepth, PNG_ColorType colorType, const PNG_Compression &compression) {
+    setCompression(compression);
+    open(destination, width, height, colorDepth, colorType);
+}
+
+PNG_Encoder::PNG_Encoder(const PNG_Destination &destination, unsigned long int width, unsigned long int height,
+                         const std::vector<RGB_Pixel> &palette, const PNG_Compression &compression,
+                         const std::vector<uint8_t> &alphas) {
+    setCompression(compression);
+    open(destination, width, height, palette, alphas);
+}
+
+void PNG_Encoder::open(const PNG_Destination &destination, unsigned long int width, unsigned long int height,
+                       unsigned int colorDepth, PNG_ColorType colorType) {
+    reset();
+    if ((colorType != PNG_ColorType::grayscale) && (colorType != PNG_ColorType::RGB_truecolor) &&
+        (colorType != PNG_ColorType::RGBA))
+        throw UnsupportedColorMode();
+
+    selfInfo.width = width;
+    selfInfo.height = height;
+    selfInfo.colorDepth = colorDepth;
+    selfInfo.colorType = colorType;
+    selfInfo.numberOfPasses = 1;
+    start(destination, {}, {});
+}
+
+void PNG_Encoder::open(const PNG_Destination &destination, unsigned long int width, unsigned long int height,
+                       const std::vector<RGB_Pixel> &palette, const std::vector<uint8_t> &alphas) {
+    reset();
+    if (alphas.size() > palette.size())
+        throw std::invalid_argument("A palette can not have more alphas than colors");
+    selfInfo.width = width;
+    selfInfo.height = height;
+    selfInfo.colorDepth = PNG_Indexed::getDepthForColors(palette.size());
+    selfInfo.colorType = PNG_ColorType::indexed;
+    selfInfo.numberOfPasses = 1;
+    start(destination, palette, alphas);
+}
+
+void PNG_Encoder::start(const PNG_Destination &destination, const std::vector<RGB_Pixel> &palette,
+                        const std::vector<uint8_t> &alphas) {
+    int libPNGColorType;
+    switch (selfInfo.colorType) {
+        case PNG_ColorType::grayscale:
+            libPNGColorType = PNG_COLOR_TYPE_GRAY;
+            break;
+        case PNG_ColorType::RGB_truecolor:
+            libPNGColorType = PNG_COLOR_TYPE_RGB;
+            break;
+        case PNG_ColorType::RGBA:
+            libPNGColorType = PNG_COLOR_TYPE_RGBA;
+            break;
+        case PNG_ColorType::indexed:
+            libPNGColorType = PNG_COLOR_TYPE_PALETTE;
+            break;
+        default:
+            throw UnsupportedColorMode();
+    }
+
+    // The palette entries are converted before LibPNG is called, so that nothing is skipped by a jump.
+    std::vector<png_color> entries;
+    for (const auto &color : palette)
+        entries.push_back(png_color{(png_byte) color.red, (png_byte) color.green, (png_byte) color.blue});
+
+    // Setup LibPNG's PNG and INFO structs, with errors reported through PNG_Loader::handleError.
+    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, &errorMessage, PNG_Loader::handleError,
+                                      PNG_Loader::handleWarning);
+    if (!png_ptr)
+        throw std::runtime_error("Internal Error: Could not create PNG object");
+    info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr) {
+        reset();
+        throw std::runtime_error("Internal Error: Could not create info object");
+    }
+
+    // Open the destination. If a file can not be created there, throw.
+    try {
+        output.open(destination);
+    } catch (...) {
+        reset();
+        throw;
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        reset();
+        throw std::runtime_error(errorMessage);
+    }
+
+    // Set and load the output settings.
+    output.attach(png_ptr);
+    png_set_IHDR(png_ptr, info_ptr, selfInfo.width, selfInfo.height, selfInfo.colorDepth, libPNGColorType,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+    if (selfInfo.colorType == PNG_ColorType::indexed)
+        png_set_PLTE(png_ptr, info_ptr, entries.data(), (int) entries.size());
+    if ((selfInfo.colorType == PNG_ColorType::indexed) && !alphas.empty())
+        png_set_tRNS(png_ptr, info_ptr, alphas.data(), (int) alphas.size(), nullptr);
+    if (compression.level != PNG_Compression::useLibPNGDefault)
+        png_set_compression_level(png_ptr, compression.level);
+    if (compression.strategy != PNG_Compression::useLibPNGDefault)
+        png_set_compression_strategy(png_ptr, compression.strategy);
+    if (compression.filters != PNG_Compression::useLibPNGDefault)
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, compression.filters);
+    png_write_info(png_ptr, info_ptr);
+
+    nBytesPerColor = PNG_Loader::getBytesPerPixel(selfInfo);
+    rowBuffer.resize(png_get_rowbytes(png_ptr, info_ptr));
+}
+
+PNG_Encoder::~PNG_Encoder() {
+    reset();
+}
+
+void PNG_Encoder::reset() noexcept {
+    if (png_ptr)
+        png_destroy_write_struct(&png_ptr, info_ptr ? &info_ptr : nullptr);
+    png_ptr = nullptr;
+    info_ptr = nullptr;
+    output.close();
+    nextRow = 0;
+}
+
+bool PNG_Encoder::isOpen() const noexcept {
+    return png_ptr != nullptr;
+}
+
+void PNG_Encoder::setCompression(const PNG_Compression &compression) {
+    this->compression = compression;
+}
+
+PNG_Info PNG_Encoder::getInfo() const noexcept {
+    return selfInfo;
+}
+
+void PNG_Encoder::writeRow(const RGB_Pixel *row) {
+    if (selfInfo.colorType != PNG_ColorType::RGB_truecolor)
+        throw std::runtime_error("Attempted to write an RGB row to a non-RGB image");
+
+    // Transfer the row into the LibPNG format.
+    {
+        DitherStats::Timer timer(DitherStage::conversion);
+        png_byte *ptr = rowBuffer.data();
+        for (unsigned long int x = 0; x < selfInfo.width; x++) {
+            for (unsigned int i = 0; i < nBytesPerColor; i++)
+                ptr[(0 * nBytesPerColor) + i] = (row[x].red >> (((nBytesPerColor - 1) - i) * 8)) & (unsigned int) 0xFF;
+
+            for (unsigned int i = 0; i < nBytesPerColor; i++)
+                ptr[(1 * nBytesPerColor) + i] =
+                        (row[x].green >> (((nBytesPerColor - 1) - i) * 8)) & (unsigned int) 0xFF;
+
+            for (unsigned int i = 0; i < nBytesPerColor; i++)
+                ptr[(2 * nBytesPerColor) + i] = (row[x].blue >> (((nBytesPerColor - 1) - i) * 8)) & (unsigned int) 0xFF;
+
+            ptr += 3 * nBytesPerColor;
+        }
+    }
+
+    writeRawRow(rowBuffer.data());
+}
+
+void PNG_Encoder::writeRow(const GreyPixel *row) {
+    if (selfInfo.colorType != PNG_ColorType::grayscale)
+        throw std::runtime_error("Attempted to write a greyscale row to a non-greyscale image");
+
+    {
+        DitherStats::Timer timer(DitherStage::conversion);
+        if (selfInfo.colorDepth >= 8) {
+            // Transfer the row into the LibPNG format, most significant byte first.
+            png_byte *ptr = rowBuffer.data();
+            for (unsigned long int x = 0; x < selfInfo.width; x++) {
+                for (unsigned int i = 0; i < nBytesPerColor; i++)
+                    ptr[i] = (row[x] >> (((nBytesPerColor - 1) - i) * 8)) & (unsigned int) 0xFF;
+                ptr += nBytesPerColor;
+            }
+        } else {
+            PNG_Loader::packRow(row, rowBuffer.data(), selfInfo.width, selfInfo.colorDepth);
+        }
+    }
+
+    writeRawRow(rowBuffer.data());
+}
+
+void PNG_Encoder::writeRow(const uint8_t *row) {
+    if (selfInfo.colorType != PNG_ColorType::indexed)
+        throw std::runtime_error("Attempted to write an indexed row to a non-indexed image");
+
+    if (selfInfo.colorDepth == 8)
+        writeRawRow(row);
+    else {
+        {
+            DitherStats::Timer timer(DitherStage::conversion);
+            PNG_Loader::packRow(row, rowBuffer.data(), selfInfo.width, selfInfo.colorDepth);
+        }
+        writeRawRow(rowBuffer.data());
+    }
+}
+
+void PNG_Encoder::writeRawRow(png_const_bytep row) {
+    if (!isOpen())
+        throw std::runtime_error("Attempted to write to an encoder with no file open");
+    if (nextRow >= selfInfo.height)
+        throw std::runtime_error("Attempted to write past the last row");
+
+    DitherStats::Timer timer(DitherStage::encode);
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        throw std::runtime_error(errorMessage);
+    }
+    png_write_row(png_ptr, row);
+    nextRow++;
+}
+
+std::size_t PNG_Encoder::getRowBytes() const noexcept {
+    return rowBuffer.size();
+}
+
+void PNG_Encoder::finish() {
+    if (!isOpen())
+        throw std::runtime_error("Attempted to finish an encoder with no file open");
+    if (nextRow != selfInfo.height)
+        throw std::runtime_error("Attempted to finish an image before every row was written");
+
+    DitherStats::Timer timer(DitherStage::encode);
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        throw std::runtime_error(errorMessage);
+    }
+    png_write_end(png_ptr, nullptr);
+
+    // Finish the destination before resetting, so that a failure to write it can be reported.
+    try {
+        output.finish();
+    } catch (...) {
+        reset();
+        throw;
+    }
+    DitherStats::addOutput((std::uint64_t) getRowBytes() * selfInfo.height, output.getBytesWritten());
+    reset();
+}
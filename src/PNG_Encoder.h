@@ -0,0 +1,106 @@
+#ifndef DITHER_PNG_ENCODER_H
+#define DITHER_PNG_ENCODER_H
+
+#include <png.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PNG_Compression.h"
+#include "PNG_IO.h"
+#include "PNG_Loader.h"
+#include "PNG_structs.h"
+
+/* Encodes a PNG one row at a time. Rows are handed to LibPNG as soon as they are
+ *   supplied, so only a single row is ever held in memory. Supports RGB and RGBA output,
+ *   greyscale output of any bit depth and indexed output, including packed 1, 2 and 4 bit rows.
+ *   Output goes to a file, standard output or a buffer. An encoder is a session that can be
+ *   reused: open() starts a new image, and finish() completes and closes it. The encoder owns
+ *   its destination and LibPNG structs, and frees them when it is finished, reset or destroyed.
+ *   LibPNG errors are thrown as std::runtime_error, holding LibPNG's message. */
+class PNG_Encoder {
+public:
+    // Creates an encoder with no file open.
+    PNG_Encoder() = default;
+
+    // Sets up RGB, RGBA or greyscale output with the supplied compression, as open() does.
+    PNG_Encoder(const PNG_Destination &destination, unsigned long int width, unsigned long int height,
+                unsigned int colorDepth, PNG_ColorType colorType, const PNG_Compression &compression = {});
+
+    // Sets up indexed output with the supplied compression, as open() does.
+    PNG_Encoder(const PNG_Destination &destination, unsigned long int width, unsigned long int height,
+                const std::vector<RGB_Pixel> &palette, const PNG_Compression &compression = {},
+                const std::vector<uint8_t> &alphas = {});
+
+    ~PNG_Encoder();
+
+    PNG_Encoder(const PNG_Encoder &) = delete;
+
+    PNG_Encoder &operator=(const PNG_Encoder &) = delete;
+
+    /* Opens the destination and writes the header of RGB, RGBA or greyscale output, abandoning
+     *   any image that is already open. Throws BadPath if the file can not be created. */
+    void open(const PNG_Destination &destination, unsigned long int width, unsigned long int height,
+              unsigned int colorDepth, PNG_ColorType colorType);
+
+    /* Opens the destination and writes the header of indexed output with the supplied palette of
+     *   8 bit colors, abandoning any image that is already open. The bit depth is the smallest that can
+     *   index the palette. If there are alphas, they are written as a tRNS chunk, giving the alpha of
+     *   the first alphas.size() entries, the rest being opaque. Throws BadPath if the file can not be
+     *   created, and std::invalid_argument if there are more alphas than entries. */
+    void open(const PNG_Destination &destination, unsigned long int width, unsigned long int height,
+              const std::vector<RGB_Pixel> &palette, const std::vector<uint8_t> &alphas = {});
+
+    /* Closes the destination, if one is open, without finishing it, and frees LibPNG's structs.
+     *   The encoder can then be opened again. */
+    void reset() noexcept;
+
+    [[nodiscard]] bool isOpen() const noexcept;
+
+    /* Sets how the images opened after this call are compressed. The
+     *   setting is kept for every later image, until it is set again. */
+    void setCompression(const PNG_Compression &compression);
+
+    /* Returns the a struct containing
+     *   the properties of the image. */
+    [[nodiscard]] PNG_Info getInfo() const noexcept;
+
+    // Encodes the next row of an RGB image. The row must hold getInfo().width pixels.
+    void writeRow(const RGB_Pixel *row);
+
+    // Encodes the next row of a greyscale image. The row must hold getInfo().width pixels.
+    void writeRow(const GreyPixel *row);
+
+    // Encodes the next row of an indexed image. The row must hold getInfo().width palette indices.
+    void writeRow(const uint8_t *row);
+
+    /* Encodes the next row from an array in the LibPNG format, with 16 bit samples most
+     *   significant byte first and sub-byte samples packed. The array must hold getRowBytes() bytes. */
+    void writeRawRow(png_const_bytep row);
+
+    // Returns the number of bytes in a row in the LibPNG format.
+    [[nodiscard]] std::size_t getRowBytes() const noexcept;
+
+    /* Finishes and closes the image. Must be called once every row has been written.
+     *   Throws std::runtime_error if it could not be written. */
+    void finish();
+
+private:
+    /* Opens the destination and writes the header of the image described by selfInfo.
+     *   The palette and its alphas are only used for indexed output. */
+    void start(const PNG_Destination &destination, const std::vector<RGB_Pixel> &palette,
+               const std::vector<uint8_t> &alphas);
+
+    png_structp png_ptr = nullptr;
+    png_infop info_ptr = nullptr;
+    PNG_OutputStream output;
+    PNG_Compression compression;
+    std::string errorMessage; // The last LibPNG error, set by PNG_Loader::handleError.
+
+    PNG_Info selfInfo{};  // Image properties.
+    unsigned int nBytesPerColor = 1;
+    unsigned long int nextRow = 0;
+    std::vector<png_byte> rowBuffer; // Raw LibPNG data for the current row.
+};
+
+
+#endif //DITHER_PNG_ENCODER_H
@@ -0,0 +1,191 @@
+#include "PNG_IO.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "PNG_structs.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DITHER_HAS_MMAP 1
+#else
+#define DITHER_HAS_MMAP 0
+#endif
+
+// The number of bytes in the PNG signature.
+static const std::size_t signatureLength = 8;
+
+PNG_InputStream::~PNG_InputStream() {
+    close();
+}
+
+void PNG_InputStream::open(const PNG_Source &source) {
+    close();
+
+    if (source.data) {
+        data = source.data;
+        size = source.size;
+    } else if (source.filePath == standardStreamPath) {
+        fp = stdin;
+    } else {
+#if DITHER_HAS_MMAP
+        /* Map regular files. Anything else, such as a named pipe, is read through stdio from the
+         *   same descriptor, as opening a pipe again could miss what was written to it. */
+        int fd = ::open(source.filePath.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw BadPath();
+        struct stat status{};
+        if ((fstat(fd, &status) == 0) && S_ISREG(status.st_mode) && (status.st_size > 0)) {
+            void *address = mmap(nullptr, (std::size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                madvise(address, (std::size_t) status.st_size, MADV_SEQUENTIAL);
+                mapping = address;
+                mappingSize = (std::size_t) status.st_size;
+                data = static_cast<const png_byte *>(address);
+                size = mappingSize;
+            }
+        }
+        if (data)
+            ::close(fd);
+        else if ((fp = fdopen(fd, "rb")) == nullptr) {
+            ::close(fd);
+            throw BadPath();
+        }
+#else
+        fp = fopen(source.filePath.c_str(), "rb");
+        if (fp == nullptr)
+            throw BadPath();
+#endif
+        ownsFile = (fp != nullptr);
+    }
+
+    // If the source is not a PNG, throw.
+    png_byte signature[signatureLength];
+    if (!read(signature, signatureLength) || png_sig_cmp(signature, 0, signatureLength)) {
+        close();
+        throw NotPNG();
+    }
+}
+
+void PNG_InputStream::close() noexcept {
+#if DITHER_HAS_MMAP
+    if (mapping)
+        munmap(mapping, mappingSize);
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+    data = nullptr;
+    size = 0;
+    position = 0;
+    if (fp && ownsFile)
+        fclose(fp);
+    fp = nullptr;
+    ownsFile = false;
+}
+
+void PNG_InputStream::attach(png_structp pngStructp) {
+    // Files are read through the callback too, rather than by LibPNG itself, so that the bytes are counted.
+    png_set_read_fn(pngStructp, this, readFromSource);
+    png_set_sig_bytes(pngStructp, signatureLength);
+}
+
+std::uint64_t PNG_InputStream::getBytesRead() const noexcept {
+    return position;
+}
+
+void PNG_InputStream::readFromSource(png_structp pngStructp, png_bytep output, png_size_t length) {
+    auto stream = static_cast<PNG_InputStream *>(png_get_io_ptr(pngStructp));
+    if (!stream->read(output, length))
+        png_error(pngStructp, "Read Error");
+}
+
+bool PNG_InputStream::read(png_bytep output, std::size_t length) {
+    if (!data) {
+        std::size_t nRead = fread(output, 1, length, fp);
+        position += nRead;
+        return nRead == length;
+    }
+
+    if (length > size - position)
+        return false;
+    std::memcpy(output, data + position, length);
+    position += length;
+    return true;
+}
+
+PNG_OutputStream::~PNG_OutputStream() {
+    close();
+}
+
+void PNG_OutputStream::open(const PNG_Destination &destination) {
+    close();
+    bytesWritten = 0;
+
+    if (destination.buffer) {
+        buffer = destination.buffer;
+    } else if (destination.filePath == standardStreamPath) {
+        fp = stdout;
+    } else {
+        fp = fopen(destination.filePath.c_str(), "wb");
+        if (fp == nullptr)
+            throw BadPath();
+        ownsFile = true;
+    }
+}
+
+void PNG_OutputStream::close() noexcept {
+    buffer = nullptr;
+    if (fp && ownsFile)
+        fclose(fp);
+    fp = nullptr;
+    ownsFile = false;
+}
+
+void PNG_OutputStream::finish() {
+    // Close the file here rather than in close(), so that a failure to write it can be reported.
+    std::FILE *file = fp;
+    bool closeFile = ownsFile;
+    fp = nullptr;
+    close();
+    if (file && ((closeFile ? fclose(file) : fflush(file)) != 0))
+        throw std::runtime_error("Could not create image");
+}
+
+void PNG_OutputStream::attach(png_structp pngStructp) {
+    // Files are written through the callback too, rather than by LibPNG itself, so that the bytes are counted.
+    png_set_write_fn(pngStructp, this, writeToDestination, flushDestination);
+}
+
+std::uint64_t PNG_OutputStream::getBytesWritten() const noexcept {
+    return bytesWritten;
+}
+
+void PNG_OutputStream::writeToDestination(png_structp pngStructp, png_bytep input, png_size_t length) {
+    auto stream = static_cast<PNG_OutputStream *>(png_get_io_ptr(pngStructp));
+    if (!stream->write(input, length))
+        png_error(pngStructp, "Write Error");
+}
+
+void PNG_OutputStream::flushDestination(png_structp pngStructp) {
+    auto stream = static_cast<PNG_OutputStream *>(png_get_io_ptr(pngStructp));
+    if (stream->fp)
+        fflush(stream->fp);
+}
+
+bool PNG_OutputStream::write(png_const_bytep input, std::size_t length) noexcept {
+    if (fp) {
+        if (fwrite(input, 1, length, fp) != length)
+            return false;
+    } else {
+        // Growing the buffer may throw, which must not pass through LibPNG, so it is reported as a failed write.
+        try {
+            buffer->insert(buffer->end(), input, input + length);
+        } catch (...) {
+            return false;
+        }
+    }
+    bytesWritten += length;
+    return true;
+}
@@ -0,0 +1,129 @@
+#ifndef DITHER_PNG_IO_H
+#define DITHER_PNG_IO_H
+
+#include <png.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// The path that stands for standard input when reading, and standard output when writing.
+constexpr const char *standardStreamPath = "-";
+
+/* Where a PNG is read from: the file at a path, standard input if the path is "-", or a
+ *   buffer supplied by the caller. Buffers are read in place, so they must outlive the read. */
+struct PNG_Source {
+    PNG_Source(const std::string &filePath) : filePath(filePath) {}
+
+    PNG_Source(const char *filePath) : filePath(filePath) {}
+
+    PNG_Source(const png_byte *data, std::size_t size) : data(data), size(size) {}
+
+    std::string filePath;
+    const png_byte *data = nullptr; // Set for buffers only.
+    std::size_t size = 0;
+};
+
+/* Where a PNG is written to: the file at a path, standard output if the path is "-", or
+ *   the end of a buffer supplied by the caller. */
+struct PNG_Destination {
+    PNG_Destination(const std::string &filePath) : filePath(filePath) {}
+
+    PNG_Destination(const char *filePath) : filePath(filePath) {}
+
+    PNG_Destination(std::vector<png_byte> &buffer) : buffer(&buffer) {}
+
+    std::string filePath;
+    std::vector<png_byte> *buffer = nullptr; // Set for buffers only.
+};
+
+/* Feeds a PNG_Source to LibPNG. Files are memory mapped where the platform allows it and read
+ *   through LibPNG's read callback, so that no copy of them passes through stdio buffers.
+ *   Standard input, and files that can not be mapped, are read through stdio. */
+class PNG_InputStream {
+public:
+    PNG_InputStream() = default;
+
+    ~PNG_InputStream();
+
+    PNG_InputStream(const PNG_InputStream &) = delete;
+
+    PNG_InputStream &operator=(const PNG_InputStream &) = delete;
+
+    /* Opens the source, closing any source that is already open, and reads the PNG signature.
+     *   Throws BadPath if the source can not be opened and NotPNG if it does not start with the signature. */
+    void open(const PNG_Source &source);
+
+    // Closes the source, if one is open. Standard input is left open.
+    void close() noexcept;
+
+    // Makes LibPNG read the rest of the source, after the signature.
+    void attach(png_structp pngStructp);
+
+    // Returns the number of bytes read from the source since it was opened, including the signature.
+    [[nodiscard]] std::uint64_t getBytesRead() const noexcept;
+
+private:
+    // LibPNG read callback, for every kind of source.
+    static void readFromSource(png_structp pngStructp, png_bytep output, png_size_t length);
+
+    // Reads length bytes into output, from memory or the file. Returns false if the source ends first.
+    bool read(png_bytep output, std::size_t length);
+
+    const png_byte *data = nullptr; // The mapped file or buffer, if reading from memory.
+    std::size_t size = 0;
+    std::size_t position = 0; // Bytes read, from memory or the file.
+    void *mapping = nullptr; // The mapping of a memory mapped file, which must be unmapped.
+    std::size_t mappingSize = 0;
+    std::FILE *fp = nullptr;
+    bool ownsFile = false; // False for standard input.
+};
+
+/* Takes the output of LibPNG to a PNG_Destination. Files and standard output are written
+ *   through stdio, and buffers are appended to. */
+class PNG_OutputStream {
+public:
+    PNG_OutputStream() = default;
+
+    ~PNG_OutputStream();
+
+    PNG_OutputStream(const PNG_OutputStream &) = delete;
+
+    PNG_OutputStream &operator=(const PNG_OutputStream &) = delete;
+
+    /* Opens the destination, closing any destination that is already open. Throws BadPath if
+     *   the file can not be created. */
+    void open(const PNG_Destination &destination);
+
+    // Closes the destination, if one is open, without checking that it was written. Standard output is left open.
+    void close() noexcept;
+
+    /* Flushes and closes the destination. Throws std::runtime_error if the
+     *   file could not be written. */
+    void finish();
+
+    // Makes LibPNG write to the destination.
+    void attach(png_structp pngStructp);
+
+    // Returns the number of bytes written to the destination since it was opened.
+    [[nodiscard]] std::uint64_t getBytesWritten() const noexcept;
+
+private:
+    // LibPNG write callback, for every kind of destination.
+    static void writeToDestination(png_structp pngStructp, png_bytep input, png_size_t length);
+
+    // LibPNG flush callback. Buffers have nothing to flush.
+    static void flushDestination(png_structp pngStructp);
+
+    // Writes length bytes to the file or buffer. Returns false if they could not all be written.
+    bool write(png_const_bytep input, std::size_t length) noexcept;
+
+    std::vector<png_byte> *buffer = nullptr;
+    std::uint64_t bytesWritten = 0;
+    std::FILE *fp = nullptr;
+    bool ownsFile = false; // False for standard output.
+};
+
+
+#endif //DITHER_PNG_IO_H
@@ -0,0 +1,84 @@
+#include "PNG_Indexed.h"
+#include <algorithm>
+#include <stdexcept>
+#include "PNG_Encoder.h"
+
+PNG_Indexed::PNG_Indexed() : PNG_Indexed(5, 5, {RGB_Pixel{0, 0, 0}, RGB_Pixel{0xFF, 0xFF, 0xFF}}) {
+}
+
+PNG_Indexed::PNG_Indexed(unsigned long int width, unsigned long int height, const std::vector<RGB_Pixel> &palette,
+                         const std::vector<uint8_t> &alphas)
+        : palette(palette), alphas(alphas) {
+    if (alphas.size() > palette.size())
+        throw std::invalid_argument("A palette can not have more alphas than colors");
+    selfInfo.colorDepth = getDepthForColors(palette.size());
+    selfInfo.colorType = PNG_ColorType::indexed;
+    selfInfo.width = width;
+    selfInfo.height = height;
+    selfInfo.numberOfPasses = 1;
+
+    unsigned long long int nPixels = (unsigned long long int) height * (unsigned long long int) width;
+    pngData = PNG_Data_Array<uint8_t>(nPixels, selfInfo.colorDepth);
+    std::fill(pngData.data(), pngData.data() + nPixels, 0);
+}
+
+std::optional<uint8_t> PNG_Indexed::getPixel(unsigned long int x, unsigned long int y) const noexcept {
+    // If x or y are outside the image bounds, return nothing.
+    if ((x >= selfInfo.width) || (y >= selfInfo.height))
+        return std::nullopt;
+
+    // Return the pixel.
+    return pngData.atC(getIndex(x, y, selfInfo.width));
+}
+
+bool PNG_Indexed::setPixel(unsigned long int x, unsigned long int y, uint8_t index) {
+    // If x or y are outside the image bounds, or the index is not in the palette, return false.
+    if ((x >= selfInfo.width) || (y >= selfInfo.height) || (index >= palette.size()))
+        return false;
+
+    // Set the pixel to the supplied index.
+    pngData.at(getIndex(x, y, selfInfo.width)) = index;
+    return true;
+}
+
+uint8_t *PNG_Indexed::getRow(unsigned long int y) noexcept {
+    return pngData.data() + getIndex(0, y, selfInfo.width);
+}
+
+const uint8_t *PNG_Indexed::getRow(unsigned long int y) const noexcept {
+    return pngData.data() + getIndex(0, y, selfInfo.width);
+}
+
+const std::vector<RGB_Pixel> &PNG_Indexed::getPalette() const noexcept {
+    return palette;
+}
+
+const std::vector<uint8_t> &PNG_Indexed::getAlphas() const noexcept {
+    return alphas;
+}
+
+PNG_Info PNG_Indexed::getInfo() const noexcept {
+    return selfInfo;
+}
+
+void PNG_Indexed::write_png_file(const PNG_Destination &destination, const PNG_Compression &compression) {
+    // The rows are already in memory, so they are packed and handed to LibPNG one at a time.
+    PNG_Encoder encoder(destination, selfInfo.width, selfInfo.height, palette, compression, alphas);
+    for (unsigned long int y = 0; y < selfInfo.height; y++)
+        encoder.writeRow(getRow(y));
+    encoder.finish();
+}
+
+unsigned int PNG_Indexed::getDepthForColors(std::size_t nColors) {
+    if ((nColors == 0) || (nColors > 256))
+        throw std::invalid_argument("Palettes must hold between 1 and 256 colors");
+
+    unsigned int depth = 1;
+    while ((1UL << depth) < nColors)
+        depth *= 2;
+    return depth;
+}
+
+unsigned long int PNG_Indexed::getIndex(unsigned long x, unsigned long y, unsigned long width) {
+    return x + (y * width);
+}
@@ -0,0 +1,78 @@
+#ifndef DITHER_PNG_INDEXED_H
+#define DITHER_PNG_INDEXED_H
+
+#include <cstdint>
+#include <string>
+#include <optional>
+#include <vector>
+#include "PNG_Compression.h"
+#include "PNG_IO.h"
+#include "PNG_structs.h"
+#include "PNG_Data_Array.h"
+
+/* An image of indices into a palette of at most 256 colors. Written as an indexed PNG
+ *   with a PLTE chunk, using the smallest bit depth of 1, 2, 4 or 8 that can hold every
+ *   index, so each pixel takes at most a byte on disk instead of 3 or 6. Palette channels
+ *   are 8 bit. The palette may have alphas, written as a tRNS chunk, for its first entries. */
+class PNG_Indexed {
+public:
+    PNG_Indexed();
+
+    /* Creates an image of index 0 everywhere. The alphas are those of the first alphas.size()
+     *   palette entries, the rest being opaque. Throws std::invalid_argument if the palette is
+     *   empty, holds more than 256 colors, or has fewer colors than alphas. */
+    PNG_Indexed(unsigned long int width, unsigned long int height, const std::vector<RGB_Pixel> &palette,
+                const std::vector<uint8_t> &alphas = {});
+
+    ~PNG_Indexed() = default;
+
+    PNG_Indexed(const PNG_Indexed &) = default;
+
+    PNG_Indexed(PNG_Indexed &&) noexcept = default;
+
+    PNG_Indexed &operator=(const PNG_Indexed &) = default;
+
+    // Moving an image hands over its pixels without copying them.
+    PNG_Indexed &operator=(PNG_Indexed &&) noexcept = default;
+
+    /* Returns the palette index of the indicated pixel. Returns nothing if pixel is
+     *   outside the bounds of the image. */
+    [[nodiscard]] std::optional<uint8_t> getPixel(unsigned long int x, unsigned long int y) const noexcept;
+
+    /* Sets the pixel at x and y to the indicated palette index. Returns true if successful.
+     *   Returns false if x or y are outside the bounds of the image, or the index is not in the palette. */
+    bool setPixel(unsigned long int x, unsigned long int y, uint8_t index);
+
+    /* Returns the first index of row y. The row holds getInfo().width indices,
+     *   one byte each, stored contiguously. Does not check that y is in bounds. */
+    uint8_t *getRow(unsigned long int y) noexcept;
+
+    [[nodiscard]] const uint8_t *getRow(unsigned long int y) const noexcept;
+
+    [[nodiscard]] const std::vector<RGB_Pixel> &getPalette() const noexcept;
+
+    [[nodiscard]] const std::vector<uint8_t> &getAlphas() const noexcept;
+
+    /* Returns the a struct containing
+     *   the properties of the image. */
+    [[nodiscard]] PNG_Info getInfo() const noexcept;
+
+    // Writes the PNG to the supplied file, standard output if the path is "-", or buffer.
+    void write_png_file(const PNG_Destination &destination, const PNG_Compression &compression = {});
+
+    /* Returns the smallest bit depth able to index a palette of nColors colors.
+     *   Throws std::invalid_argument if nColors is 0 or more than 256. */
+    static unsigned int getDepthForColors(std::size_t nColors);
+
+private:
+    // Gets the index for a 1-D index array for a given x and y.
+    static unsigned long int getIndex(unsigned long int x, unsigned long int y, unsigned long width);
+
+    PNG_Info selfInfo{};  // Image properties.
+    std::vector<RGB_Pixel> palette;
+    std::vector<uint8_t> alphas; // The alphas of the first palette entries, written as a tRNS chunk.
+    PNG_Data_Array<uint8_t> pngData = PNG_Data_Array<uint8_t>(0, 0); // 1-D array, the image's palette indices.
+};
+
+
+#endif //DITHER_PNG_INDEXED_H
@@ -1,82 +1,15 @@
 #include "PNG_Loader.h"
+#include <cstring>
 #include <stdexcept>
 #include <cstdio>
 #include <png.h>
+#include "PNG_Decoder.h"
 #include "PNG_structs.h"
 
 PNG_Info PNG_Loader::IdentifyPNG(const std::string &filePath) {
-        // Setup LibPNG's PNG and INFO structs. If a problem is encountered, throw.
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-                                                 (png_voidp) nullptr/*user_error_ptr*/,
-                                                 nullptr/*user_error_fn*/,
-                                                 nullptr/*user_warning_fn*/);
-    if (!png_ptr) {
-        throw std::runtime_error("Internal Error: Could not create PNG object");
-    }
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        png_destroy_read_struct(&png_ptr, (png_infopp) nullptr, (png_infopp) nullptr);
-        throw std::runtime_error("Internal Error: Could not create info object");
-    }
-    png_infop end_info = png_create_info_struct(png_ptr);
-    if (!end_info) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) nullptr);
-        throw std::runtime_error("Internal Error: Could not create end info object");
-    }
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-        throw std::runtime_error("Exception: jumped");
-    }
-
-    PNG_Info result{};
-
-    // Open stream at file path.
-    std::FILE *fp = fopen(filePath.c_str(), "rb");
-
-    /* If file path does not point to a valid
-     *   file or could not be opened, throw. */
-    if (fp == nullptr) {
-        throw BadPath();
-    }
-
-    // If the file is not a PNG, throw.
-    if (!fileIsPNG(fp)) {
-        fclose(fp);
-        throw NotPNG();
-    }
-
-    // Load the image's properties.
-    png_init_io(png_ptr, fp);
-    png_set_sig_bytes(png_ptr, 0);
-    png_read_info(png_ptr, info_ptr);
-    result.width = png_get_image_width(png_ptr, info_ptr);
-    result.height = png_get_image_height(png_ptr, info_ptr);
-    result.colorDepth = png_get_bit_depth(png_ptr, info_ptr);
-    result.numberOfPasses = (unsigned long int) png_set_interlace_handling(png_ptr);
-    png_read_update_info(png_ptr, info_ptr);
-    switch (png_get_color_type(png_ptr, info_ptr)) {
-        case 0:
-            result.colorType = PNG_ColorType::grayscale;
-            break;
-        case 2:
-            result.colorType = PNG_ColorType::RGB_truecolor;
-            break;
-        case 3:
-            result.colorType = PNG_ColorType::indexed;
-            break;
-        case 4:
-            result.colorType = PNG_ColorType::grayscale_alpha;
-            break;
-        case 6:
-            result.colorType = PNG_ColorType::RGBA;
-            break;
-        default:
-            fclose(fp);
-            throw UnsupportedColorMode();
-    }
-    fclose(fp);
-
-    return result;
+    // Open the file without transforming it, so that the properties are those of the file itself.
+    PNG_Decoder decoder(filePath, &readInfo);
+    return decoder.getInfo();
 }
 
 bool PNG_Loader::fileIsPNG(std::FILE *file_pointer) {
@@ -100,9 +33,12 @@ PNG_Info PNG_Loader::getPNGInfo(png_structp pngStructp, png_infop infoPtr) {
     PNG_Info result{};
     result.width = png_get_image_width(pngStructp, infoPtr);
     result.height = png_get_image_height(pngStructp, infoPtr);
-    result.colorDepth = png_get_bit_depth(pngStructp, infoPtr);
     result.numberOfPasses = (unsigned long int) png_set_interlace_handling(pngStructp);
     png_read_update_info(pngStructp, infoPtr);
+
+    /* Read after png_read_update_info so that the depth includes any transformations,
+     *   such as low bit depth greyscale being expanded to 8 bit. */
+    result.colorDepth = png_get_bit_depth(pngStructp, infoPtr);
     switch (png_get_color_type(pngStructp, infoPtr)) {
         case PNG_COLOR_TYPE_GRAY:
             result.colorType = PNG_ColorType::grayscale;
@@ -126,57 +62,22 @@ PNG_Info PNG_Loader::getPNGInfo(png_structp pngStructp, png_infop infoPtr) {
     return result;
 }
 
-png_bytepp PNG_Loader::makeRowPointers(PNG_Info &info, png_structp pngStructp, png_infop infoPtr) {
-    // Prepare a 2-D array for LibPNG to load the image data into.
-    png_bytepp rowPointers = (png_bytep *) malloc(sizeof(png_bytep) * info.height);
-    for (unsigned long int y = 0; y < info.height; y++)
-        rowPointers[y] = (png_byte *) malloc(png_get_rowbytes(pngStructp, infoPtr));
-
-    return rowPointers;
+void PNG_Loader::readInfo(png_structp pngStructp, png_infop infoPtr) {
+    png_read_info(pngStructp, infoPtr);
 }
 
-png_bytepp PNG_Loader::loadPNGIntoRowPointers(PNG_Info &info, png_structp pngStructp, png_infop infoPtr) {
-    // Prepare a 2-D array for LibPNG to load the image data into.
-    png_bytepp rowPointers = makeRowPointers(info, pngStructp, infoPtr);
-
-    // Load image data.
-    png_read_image(pngStructp, rowPointers);
-
-    return rowPointers;
-}
-
-void PNG_Loader::FreeRowPointers(png_bytepp rowPointers, PNG_Info &info) {
-    // Free 2-D array.
-    for (unsigned long int y = 0; y < info.height; y++)
-        free(rowPointers[y]);
-    free(rowPointers);
-}
-
-std::pair<png_structp, png_infop> PNG_Loader::getLibPNGReadStructs() {
-    // Setup LibPNG's PNG and INFO structs. If a problem is encountered, throw.
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-                                                 (png_voidp) nullptr/*user_error_ptr*/,
-                                                 nullptr/*user_error_fn*/,
-                                                 nullptr/*user_warning_fn*/);
-    if (!png_ptr)
-        throw std::runtime_error("Internal Error: Could not create PNG object");
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        png_destroy_read_struct(&png_ptr, (png_infopp) nullptr, (png_infopp) nullptr);
-        throw std::runtime_error("Internal Error: Could not create info object");
-    }
-    png_infop end_info = png_create_info_struct(png_ptr);
-    if (!end_info) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) nullptr);
-        throw std::runtime_error("Internal Error: Could not create end info object");
-    }
-
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-        throw std::runtime_error("Exception: jumped");
+void PNG_Loader::handleError(png_structp pngStructp, png_const_charp message) {
+    // Keep the message if there is room for it. Either way, never return to LibPNG.
+    try {
+        *static_cast<std::string *>(png_get_error_ptr(pngStructp)) = message;
+    } catch (...) {
     }
+    png_longjmp(pngStructp, 1);
+}
 
-    return std::pair<png_structp, png_infop>(png_ptr, info_ptr);
+void PNG_Loader::handleWarning(png_structp, png_const_charp message) {
+    // Printed as LibPNG's default handler prints them.
+    std::fprintf(stderr, "libpng warning: %s\n", message);
 }
 
 unsigned int PNG_Loader::getBytesPerPixel(PNG_Info &pngInfo) noexcept {
@@ -192,21 +93,92 @@ unsigned int PNG_Loader::getBytesPerPixel(PNG_Info &pngInfo) noexcept {
     return nBytesPerPixel;
 }
 
-std::pair<png_structp, png_infop> PNG_Loader::getLibPNGWriteStructs() {
-    // Setup LibPNG's PNG and INFO structs. If a problem is encountered, throw.
-    auto png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png_ptr) {
-        throw std::runtime_error("Internal Error: Could not create PNG object");
+std::size_t PNG_Loader::getPackedRowBytes(unsigned long int width, unsigned int colorDepth) noexcept {
+    return (((std::size_t) width * colorDepth) + 7) / 8;
+}
+
+/* Unpacks n samples of Depth bits(1, 2 or 4), the first in the most significant bits of its
+ *   byte. Whole bytes are unpacked with a loop that the compiler unrolls. */
+template<unsigned int Depth, typename Channel>
+static void unpackBits(png_const_bytep input, Channel *output, std::size_t n) noexcept {
+    constexpr unsigned int nSamplesInByte = 8 / Depth;
+    constexpr unsigned int mask = (1U << Depth) - 1U;
+    std::size_t i = 0;
+    for (; i + nSamplesInByte <= n; i += nSamplesInByte) {
+        unsigned int byte = input[i / nSamplesInByte];
+        for (unsigned int j = 0; j < nSamplesInByte; j++)
+            output[i + j] = (Channel) ((byte >> (8 - (Depth * (j + 1)))) & mask);
     }
-    auto info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-        throw std::runtime_error("Internal Error: Could not create info object");
+    for (; i < n; i++)
+        output[i] = (Channel) ((input[i / nSamplesInByte] >> (8 - (Depth * ((i % nSamplesInByte) + 1)))) & mask);
+}
+
+// Widens samples of any depth into Channels of at least 16 bits.
+template<typename Channel>
+static void widenSamples(png_const_bytep input, Channel *output, std::size_t n, unsigned int colorDepth) noexcept {
+    switch (colorDepth) {
+        case 1:
+            unpackBits<1>(input, output, n);
+            break;
+        case 2:
+            unpackBits<2>(input, output, n);
+            break;
+        case 4:
+            unpackBits<4>(input, output, n);
+            break;
+        case 16:
+            for (std::size_t i = 0; i < n; i++)
+                output[i] = (Channel) (((unsigned int) input[2 * i] << 8U) | input[(2 * i) + 1]);
+            break;
+        default:
+            for (std::size_t i = 0; i < n; i++)
+                output[i] = input[i];
+            break;
     }
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        throw std::runtime_error("Exception: jumped");
+}
+
+// Narrows Channels of at least 16 bits into samples of any depth.
+template<typename Channel>
+static void narrowSamples(const Channel *input, png_bytep output, std::size_t n, unsigned int colorDepth) noexcept {
+    if (colorDepth == 16) {
+        for (std::size_t i = 0; i < n; i++) {
+            output[2 * i] = (png_byte) (input[i] >> 8U);
+            output[(2 * i) + 1] = (png_byte) (input[i] & 0xFFU);
+        }
+    } else if (colorDepth < 8)
+        PNG_Loader::packRow(input, output, n, colorDepth);
+    else {
+        for (std::size_t i = 0; i < n; i++)
+            output[i] = (png_byte) input[i];
     }
+}
 
-    return std::pair<png_structp, png_infop>(png_ptr, info_ptr);
+void PNG_Loader::unpackSamples(png_const_bytep input, uint8_t *output, std::size_t n,
+                               unsigned int colorDepth) noexcept {
+    if (input != output)
+        std::memcpy(output, input, getPackedRowBytes(n, colorDepth));
 }
 
+void PNG_Loader::unpackSamples(png_const_bytep input, uint16_t *output, std::size_t n,
+                               unsigned int colorDepth) noexcept {
+    widenSamples(input, output, n, colorDepth);
+}
+
+void PNG_Loader::unpackSamples(png_const_bytep input, unsigned int *output, std::size_t n,
+                               unsigned int colorDepth) noexcept {
+    widenSamples(input, output, n, colorDepth);
+}
+
+void PNG_Loader::packSamples(const uint8_t *input, png_bytep output, std::size_t n, unsigned int colorDepth) noexcept {
+    if (input != output)
+        std::memcpy(output, input, getPackedRowBytes(n, colorDepth));
+}
+
+void PNG_Loader::packSamples(const uint16_t *input, png_bytep output, std::size_t n, unsigned int colorDepth) noexcept {
+    narrowSamples(input, output, n, colorDepth);
+}
 
+void PNG_Loader::packSamples(const unsigned int *input, png_bytep output, std::size_t n,
+                             unsigned int colorDepth) noexcept {
+    narrowSamples(input, output, n, colorDepth);
+}
@@ -1,6 +1,8 @@
 #ifndef DITHER_PNG_LOADER_H
 #define DITHER_PNG_LOADER_H
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <cstdio>
 #include <png.h>
@@ -17,17 +19,65 @@ public:
 
     static PNG_Info getPNGInfo(png_structp pngStructp, png_infop infoPtr);
 
-    static png_bytepp makeRowPointers(PNG_Info &info, png_structp pngStructp, png_infop infoPtr);
+    /* Reads the properties of the PNG, without setting up any transformations.
+     *   The transformations of each image type start with this. */
+    static void readInfo(png_structp pngStructp, png_infop infoPtr);
 
-    static png_bytepp loadPNGIntoRowPointers(PNG_Info &info, png_structp pngStructp, png_infop infoPtr);
+    static unsigned int getBytesPerPixel(PNG_Info &pngInfo) noexcept;
 
-    static void FreeRowPointers(png_bytepp rowPointers, PNG_Info &info);
+    /* The error callback installed in every LibPNG struct. Stores LibPNG's message in the
+     *   std::string given to LibPNG as the error pointer, then jumps back to the setjmp armed
+     *   by the function that called LibPNG, which throws it as a std::runtime_error. */
+    static void handleError(png_structp pngStructp, png_const_charp message);
 
-    static std::pair<png_structp, png_infop> getLibPNGReadStructs();
+    /* The warning callback installed in every LibPNG struct. Warnings, such as those for
+     *   incorrect color profiles, do not stop the image being read, so they are printed to
+     *   standard error and LibPNG carries on. */
+    static void handleWarning(png_structp pngStructp, png_const_charp message);
 
-    static unsigned int getBytesPerPixel(PNG_Info &pngInfo) noexcept;
+    /* Packs width samples of a 1, 2 or 4 bit image into bytes, leftmost sample in the most
+     *   significant bits, as in a LibPNG row. Each byte is assembled in a register and stored once. */
+    template<typename T>
+    static void packRow(const T *row, png_byte *output, unsigned long int width, unsigned int colorDepth) {
+        unsigned int nColorsInByte = 8U / colorDepth;
+        unsigned int mask = (1U << colorDepth) - 1U;
+        unsigned long int nBytes = (width + nColorsInByte - 1) / nColorsInByte;
+        for (unsigned long int byte = 0; byte < nBytes; byte++) {
+            unsigned long int first = byte * nColorsInByte;
+            unsigned long int last = std::min<unsigned long int>(first + nColorsInByte, width);
+            unsigned int packed = 0;
+            for (unsigned long int x = first; x < last; x++) {
+                unsigned int loc = (nColorsInByte - 1) - (x - first);
+                packed |= (row[x] & mask) << (loc * colorDepth);
+            }
+            output[byte] = (png_byte) packed;
+        }
+    }
+
+    // Returns the number of bytes in a row of width samples of colorDepth bits each.
+    static std::size_t getPackedRowBytes(unsigned long int width, unsigned int colorDepth) noexcept;
+
+    /* Converts n samples of a raw LibPNG row, of colorDepth bits each, into the samples of an
+     *   image row. The overload for the channel type picks the conversion at compile time: bytes
+     *   are copied as they are, including rows of packed samples of 1, 2 or 4 bits, 16 bit
+     *   samples have their bytes swapped from most significant first, and other depths are
+     *   widened or unpacked. The input may be the output itself if each sample takes as many
+     *   bytes in both, as 16 bit rows decoded in place do. */
+    static void unpackSamples(png_const_bytep input, uint8_t *output, std::size_t n, unsigned int colorDepth) noexcept;
+
+    static void unpackSamples(png_const_bytep input, uint16_t *output, std::size_t n, unsigned int colorDepth) noexcept;
+
+    static void unpackSamples(png_const_bytep input, unsigned int *output, std::size_t n,
+                              unsigned int colorDepth) noexcept;
+
+    /* Converts n samples of an image row into a raw LibPNG row of colorDepth bits each, the
+     *   reverse of unpackSamples. The output must hold getPackedRowBytes(n, colorDepth) bytes. */
+    static void packSamples(const uint8_t *input, png_bytep output, std::size_t n, unsigned int colorDepth) noexcept;
+
+    static void packSamples(const uint16_t *input, png_bytep output, std::size_t n, unsigned int colorDepth) noexcept;
 
-    static std::pair<png_structp, png_infop> getLibPNGWriteStructs();
+    static void packSamples(const unsigned int *input, png_bytep output, std::size_t n,
+                            unsigned int colorDepth) noexcept;
 };
 
 
@@ -1,6 +1,7 @@
 #ifndef DITHER_PNG_STRUCTS_H
 #define DITHER_PNG_STRUCTS_H
 
+#include <cstdint>
 #include <exception>
 
 enum class PNG_ColorType {
@@ -18,14 +19,30 @@ struct PNG_Info {
 
 };
 
-struct RGBA_Pixel {
-    unsigned int red, green, blue, alpha;
+/* Pixels are templated on the type of each channel, so that images can be held in as
+ *   few bytes as their bit depth needs. The unsigned int pixels can hold any depth. */
+template<typename Channel>
+struct BasicRGBA_Pixel {
+    Channel red, green, blue, alpha;
 };
 
-struct RGB_Pixel {
-    unsigned int red, green, blue;
+template<typename Channel>
+struct BasicRGB_Pixel {
+    Channel red, green, blue;
 };
 
+typedef BasicRGBA_Pixel<unsigned int> RGBA_Pixel;
+typedef BasicRGB_Pixel<unsigned int> RGB_Pixel;
+typedef BasicRGB_Pixel<uint8_t> RGB8_Pixel;
+typedef BasicRGB_Pixel<uint16_t> RGB16_Pixel;
+typedef BasicRGBA_Pixel<uint8_t> RGBA8_Pixel;
+typedef BasicRGBA_Pixel<uint16_t> RGBA16_Pixel;
+
+static_assert(sizeof(RGB8_Pixel) == 3, "RGB8_Pixel must be 3 packed channels");
+static_assert(sizeof(RGB16_Pixel) == 6, "RGB16_Pixel must be 3 packed channels");
+static_assert(sizeof(RGBA8_Pixel) == 4, "RGBA8_Pixel must be 4 packed channels");
+static_assert(sizeof(RGBA16_Pixel) == 8, "RGBA16_Pixel must be 4 packed channels");
+
 typedef unsigned int GreyPixel;
 
 struct HSV_Color {
@@ -56,5 +73,13 @@ struct UnsupportedColorMode : public std::exception
     }
 };
 
+struct InterlacedPNG : public std::exception
+{
+    [[nodiscard]] const char * what () const noexcept override
+    {
+        return "Interlaced PNGs can not be streamed";
+    }
+};
+
 
 #endif //DITHER_PNG_STRUCTS_H
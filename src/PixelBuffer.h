@@ -0,0 +1,32 @@
+#ifndef DITHER_PIXELBUFFER_H
+#define DITHER_PIXELBUFFER_H
+
+#include <cstddef>
+
+/* Pixels held by the caller, one row after another. Rows are stride bytes apart, so they may
+ *   be padded or be part of a larger image. Each pixel holds channels samples of depth bits:
+ *   8 bit samples are bytes, 16 bit samples are uint16_t in the byte order of the machine,
+ *   and 1 bit samples are packed into bytes leftmost first, as in a PNG row. */
+struct ConstPixelBuffer {
+    const void *pixels;
+    unsigned long int width, height;
+    std::size_t stride;
+    unsigned int depth;
+    unsigned int channels; // 1 for grey or palette indices, 3 for RGB and 4 for RGBA.
+};
+
+// A PixelBuffer the library writes into.
+struct PixelBuffer {
+    void *pixels;
+    unsigned long int width, height;
+    std::size_t stride;
+    unsigned int depth;
+    unsigned int channels;
+
+    operator ConstPixelBuffer() const noexcept {
+        return ConstPixelBuffer{pixels, width, height, stride, depth, channels};
+    }
+};
+
+
+#endif //DITHER_PIXELBUFFER_H
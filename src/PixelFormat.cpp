@@ -0,0 +1,78 @@
+#include "PixelFormat.h"
+#include "PNG_Loader.h"
+
+void RGB_Format::transform(png_structp pngStructp, png_infop infoPtr) {
+    /* Load the image's properties. These will
+     *   be used to identify any transformation
+     *   that need to be applied to the image */
+    PNG_Loader::readInfo(pngStructp, infoPtr);
+
+    // If the file is greyscale, with or without alpha, convert to RGB.
+    if ((png_get_color_type(pngStructp, infoPtr) == PNG_COLOR_TYPE_GRAY) ||
+        (png_get_color_type(pngStructp, infoPtr) == PNG_COLOR_TYPE_GRAY_ALPHA)) {
+        png_set_gray_to_rgb(pngStructp);
+    }
+
+    // If the image has an alpha channel, remove it.
+    if ((png_get_color_type(pngStructp, infoPtr) == PNG_COLOR_TYPE_RGBA) ||
+        (png_get_color_type(pngStructp, infoPtr) == PNG_COLOR_TYPE_GRAY_ALPHA)) {
+        png_set_strip_alpha(pngStructp);
+    }
+
+    // If the file is a palette image, convert to RGB
+    if (png_get_color_type(pngStructp, infoPtr) == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(pngStructp);
+        png_set_strip_alpha(pngStructp);
+    }
+}
+
+void RGBA_Format::transform(png_structp pngStructp, png_infop infoPtr) {
+    /* Load the image's properties. These will
+     *   be used to identify any transformation
+     *   that need to be applied to the image */
+    PNG_Loader::readInfo(pngStructp, infoPtr);
+    png_byte colorType = png_get_color_type(pngStructp, infoPtr);
+    bool hasTransparency = png_get_valid(pngStructp, infoPtr, PNG_INFO_tRNS) != 0;
+
+    // If the file is greyscale, convert to RGB.
+    if ((colorType == PNG_COLOR_TYPE_GRAY) || (colorType == PNG_COLOR_TYPE_GRAY_ALPHA))
+        png_set_gray_to_rgb(pngStructp);
+
+    // If the file is a palette image, convert to RGB.
+    if (colorType == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(pngStructp);
+
+    /* If the image lacks an alpha channel, add one, from the tRNS chunk if there is one. The
+     *   filler is the whole of a 16 bit sample, and only its low byte is used for 8 bit samples. */
+    if ((colorType == PNG_COLOR_TYPE_RGB) || (colorType == PNG_COLOR_TYPE_GRAY) ||
+        (colorType == PNG_COLOR_TYPE_PALETTE)) {
+        if (hasTransparency)
+            png_set_tRNS_to_alpha(pngStructp);
+        else
+            png_set_add_alpha(pngStructp, 0xFFFF, PNG_FILLER_AFTER);
+    }
+}
+
+void Grey_Format::transform(png_structp pngStructp, png_infop infoPtr) {
+    /* Load the image's properties. These will
+     *   be used to identify any transformation
+     *   that need to be applied to the image */
+    PNG_Loader::readInfo(pngStructp, infoPtr);
+
+    // If the file is a palette image, convert to RGB
+    if (png_get_color_type(pngStructp, infoPtr) == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(pngStructp);
+        png_set_strip_alpha(pngStructp);
+    }
+
+    // If the image has an alpha channel, remove it.
+    if ((png_get_color_type(pngStructp, infoPtr) == PNG_COLOR_TYPE_RGBA) ||
+        (png_get_color_type(pngStructp, infoPtr) == PNG_COLOR_TYPE_GRAY_ALPHA)) {
+        png_set_strip_alpha(pngStructp);
+    }
+
+    // If the file is RGB, convert to greyscale.
+    if ((png_get_color_type(pngStructp, infoPtr) != PNG_COLOR_TYPE_GRAY)) {
+        png_set_rgb_to_gray(pngStructp, 1, -1, -1);
+    }
+}
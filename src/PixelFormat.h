@@ -0,0 +1,84 @@
+#ifndef DITHER_PIXELFORMAT_H
+#define DITHER_PIXELFORMAT_H
+
+#include <png.h>
+#include "PNG_structs.h"
+
+/* The pixel formats of Image. Each names the pixels an image holds, as the Pixel of a Channel
+ *   type, the wide pixels it hands out a pixel at a time, and the LibPNG transformations that
+ *   convert any supported PNG into it. Pixels are nChannels packed Channels, so that a row is
+ *   also an array of samples. */
+struct RGB_Format {
+    static constexpr unsigned int nChannels = 3;
+    static constexpr PNG_ColorType colorType = PNG_ColorType::RGB_truecolor;
+
+    template<typename Channel>
+    using Pixel = BasicRGB_Pixel<Channel>;
+
+    typedef RGB_Pixel WidePixel;
+
+    static WidePixel fromSamples(const unsigned int *samples) noexcept {
+        return {samples[0], samples[1], samples[2]};
+    }
+
+    static void toSamples(const WidePixel &pixel, unsigned int *samples) noexcept {
+        samples[0] = pixel.red;
+        samples[1] = pixel.green;
+        samples[2] = pixel.blue;
+    }
+
+    /* Opens the stream and sets up the LibPNG transformations that convert
+     *   any supported PNG into 8 or 16 bit RGB. */
+    static void transform(png_structp pngStructp, png_infop infoPtr);
+};
+
+struct RGBA_Format {
+    static constexpr unsigned int nChannels = 4;
+    static constexpr PNG_ColorType colorType = PNG_ColorType::RGBA;
+
+    template<typename Channel>
+    using Pixel = BasicRGBA_Pixel<Channel>;
+
+    typedef RGBA_Pixel WidePixel;
+
+    static WidePixel fromSamples(const unsigned int *samples) noexcept {
+        return {samples[0], samples[1], samples[2], samples[3]};
+    }
+
+    static void toSamples(const WidePixel &pixel, unsigned int *samples) noexcept {
+        samples[0] = pixel.red;
+        samples[1] = pixel.green;
+        samples[2] = pixel.blue;
+        samples[3] = pixel.alpha;
+    }
+
+    /* Opens the stream and sets up the LibPNG transformations that convert any supported PNG
+     *   into 8 or 16 bit RGBA. Images without an alpha channel are opaque, except for the
+     *   colors of a tRNS chunk, which are transparent. */
+    static void transform(png_structp pngStructp, png_infop infoPtr);
+};
+
+struct Grey_Format {
+    static constexpr unsigned int nChannels = 1;
+    static constexpr PNG_ColorType colorType = PNG_ColorType::grayscale;
+
+    template<typename Channel>
+    using Pixel = Channel;
+
+    typedef GreyPixel WidePixel;
+
+    static WidePixel fromSamples(const unsigned int *samples) noexcept {
+        return samples[0];
+    }
+
+    static void toSamples(const WidePixel &pixel, unsigned int *samples) noexcept {
+        samples[0] = pixel;
+    }
+
+    /* Opens the stream and sets up the LibPNG transformations that convert any supported PNG
+     *   into greyscale, keeping the depth of greyscale PNGs. */
+    static void transform(png_structp pngStructp, png_infop infoPtr);
+};
+
+
+#endif //DITHER_PIXELFORMAT_H
@@ -0,0 +1,79 @@
+#ifndef DITHER_PLANARRGB_H
+#define DITHER_PLANARRGB_H
+
+#include <cstddef>
+#include "ImageView.h"
+#include "PNG_Data_Array.h"
+#include "PNG_structs.h"
+#include "ThreadPool.h"
+
+/* An RGB image held as three separate planes, one per channel, rather than as
+ *   interleaved pixels. Suits kernels that work on one channel at a time, as each
+ *   plane is a plain contiguous array of samples that can be processed on its own. */
+template<typename Channel>
+class PlanarRGB {
+public:
+    static const unsigned int nPlanes = 3;
+
+    PlanarRGB(unsigned long int width, unsigned long int height, unsigned int colorDepth)
+            : width(width), height(height) {
+        for (auto &plane : planes)
+            plane = PNG_Data_Array<Channel>((unsigned long long int) width * height, colorDepth);
+    }
+
+    /* Splits an interleaved image into planes of the full depth of a Channel. The rows are split
+     *   into bands across the threads of the pool. */
+    PlanarRGB(ImageView<const BasicRGB_Pixel<Channel>> image, ThreadPool &pool)
+            : PlanarRGB(image.getWidth(), image.getHeight(), 8 * sizeof(Channel)) {
+        pool.parallelFor(0, height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+            for (unsigned long int y = firstRow; y < lastRow; y++) {
+                const BasicRGB_Pixel<Channel> *row = image.getRow(y);
+                Channel *red = getRow(0, y), *green = getRow(1, y), *blue = getRow(2, y);
+                for (unsigned long int x = 0; x < width; x++) {
+                    red[x] = row[x].red;
+                    green[x] = row[x].green;
+                    blue[x] = row[x].blue;
+                }
+            }
+        });
+    }
+
+    /* Interleaves the planes back into an image of the same size, overwriting its pixels.
+     *   The rows are split into bands across the threads of the pool. */
+    void interleaveInto(ImageView<BasicRGB_Pixel<Channel>> image, ThreadPool &pool) const {
+        pool.parallelFor(0, height, [&](unsigned long int firstRow, unsigned long int lastRow) {
+            for (unsigned long int y = firstRow; y < lastRow; y++) {
+                BasicRGB_Pixel<Channel> *row = image.getRow(y);
+                const Channel *red = getRow(0, y), *green = getRow(1, y), *blue = getRow(2, y);
+                for (unsigned long int x = 0; x < width; x++)
+                    row[x] = BasicRGB_Pixel<Channel>{red[x], green[x], blue[x]};
+            }
+        });
+    }
+
+    /* Returns the first sample of row y of the plane of the supplied channel, 0 for red, 1 for
+     *   green and 2 for blue. The row holds getWidth() samples. Does not check that y is in bounds. */
+    Channel *getRow(unsigned int channel, unsigned long int y) noexcept {
+        return planes[channel].data() + (y * width);
+    }
+
+    [[nodiscard]] const Channel *getRow(unsigned int channel, unsigned long int y) const noexcept {
+        return planes[channel].data() + (y * width);
+    }
+
+    [[nodiscard]] unsigned long int getWidth() const noexcept {
+        return width;
+    }
+
+    [[nodiscard]] unsigned long int getHeight() const noexcept {
+        return height;
+    }
+
+private:
+    unsigned long int width, height;
+    PNG_Data_Array<Channel> planes[nPlanes] = {PNG_Data_Array<Channel>(0, 0), PNG_Data_Array<Channel>(0, 0),
+                                               PNG_Data_Array<Channel>(0, 0)};
+};
+
+
+#endif //DITHER_PLANARRGB_H
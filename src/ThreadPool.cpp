@@ -0,0 +1,132 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <exception>
+
+ThreadPool::ThreadPool(unsigned int nThreads) : nThreads(std::max(nThreads, 1U)) {
+    for (unsigned int i = 1; i < this->nThreads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        stopping = true;
+    }
+    tasksAvailable.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+unsigned int ThreadPool::getThreadCount() const noexcept {
+    return nThreads;
+}
+
+void ThreadPool::parallelFor(unsigned long int begin, unsigned long int end,
+                             const std::function<void(unsigned long int, unsigned long int)> &body) {
+    if (end <= begin)
+        return;
+
+    // Never make more bands than there are items.
+    unsigned long int nBands = std::min<unsigned long int>(nThreads, end - begin);
+    if (nBands == 1) {
+        body(begin, end);
+        return;
+    }
+
+    // State shared between the bands. It lives until every band has finished.
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    unsigned long int remaining = nBands;
+    std::exception_ptr firstException = nullptr;
+
+    auto runBand = [&](unsigned long int band) {
+        // Spread the remainder over the first bands so that no band is more than one item larger.
+        unsigned long int count = end - begin;
+        unsigned long int bandBegin = begin + (count * band) / nBands;
+        unsigned long int bandEnd = begin + (count * (band + 1)) / nBands;
+
+        std::exception_ptr exception = nullptr;
+        try {
+            body(bandBegin, bandEnd);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (exception && !firstException)
+            firstException = exception;
+        remaining--;
+        doneCondition.notify_all();
+    };
+
+    // Queue every band but the first, which is run on the calling thread.
+    for (unsigned long int band = 1; band < nBands; band++)
+        submit([&runBand, band]() { runBand(band); });
+    runBand(0);
+
+    /* Help with queued work while waiting, rather than blocking. This keeps nested
+     *   calls from deadlocking when every worker is itself waiting inside parallelFor. */
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (remaining == 0)
+                break;
+        }
+        if (!runPendingTask()) {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneCondition.wait(lock, [&]() { return remaining == 0; });
+            break;
+        }
+    }
+
+    if (firstException)
+        std::rethrow_exception(firstException);
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    // Without workers, the task is run immediately.
+    if (workers.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        tasks.push_back(std::move(task));
+    }
+    tasksAvailable.notify_one();
+}
+
+unsigned int ThreadPool::getDefaultThreadCount() noexcept {
+    unsigned int count = std::thread::hardware_concurrency();
+    return (count == 0) ? 1 : count;
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(tasksMutex);
+            tasksAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+bool ThreadPool::runPendingTask() {
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        if (tasks.empty())
+            return false;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+    task();
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef DITHER_THREADPOOL_H
+#define DITHER_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A fixed set of worker threads that execute queued tasks. The pool is created
+ *   once and reused, so splitting work across it costs no thread creation. */
+class ThreadPool {
+public:
+    /* Creates a pool that runs work on nThreads threads in total. The thread that
+     *   calls parallelFor counts as one of them, so nThreads - 1 workers are started. */
+    explicit ThreadPool(unsigned int nThreads);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Returns the number of threads that work is split across.
+    [[nodiscard]] unsigned int getThreadCount() const noexcept;
+
+    /* Splits [begin, end) into contiguous bands, one per thread, and calls body(bandBegin, bandEnd)
+     *   for each band. Returns once every band is done. If a band throws, the first
+     *   exception is rethrown here. Safe to call from within a task of the same pool. */
+    void parallelFor(unsigned long int begin, unsigned long int end,
+                     const std::function<void(unsigned long int, unsigned long int)> &body);
+
+    // Queues a task to be run by one of the workers.
+    void submit(std::function<void()> task);
+
+    // Returns the number of threads the hardware supports, or 1 if it is unknown.
+    static unsigned int getDefaultThreadCount() noexcept;
+
+private:
+    void workerLoop();
+
+    // Runs one queued task on the calling thread. Returns false if the queue was empty.
+    bool runPendingTask();
+
+    unsigned int nThreads;
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex tasksMutex;
+    std::condition_variable tasksAvailable;
+    bool stopping = false;
+};
+
+
+#endif //DITHER_THREADPOOL_H
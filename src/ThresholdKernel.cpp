@@ -0,0 +1,594 @@
+#include "ThresholdKernel.h"
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DITHER_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Samples in the widest vector register that a kernel uses, 32 bytes for AVX2.
+static const std::size_t maxVectorBytes = 32;
+
+static InstructionSet activeInstructionSet = ThresholdKernel::detectInstructionSet();
+
+/* Reverses the bits of each byte. Vector compares give the result of the first sample in
+ *   the least significant bit, but LibPNG rows hold it in the most significant bit. */
+static constexpr std::array<uint8_t, 256> makeBitReversal() {
+    std::array<uint8_t, 256> result{};
+    for (unsigned int i = 0; i < 256; i++) {
+        unsigned int reversed = 0;
+        for (unsigned int bit = 0; bit < 8; bit++)
+            reversed |= ((i >> bit) & 1U) << (7 - bit);
+        result[i] = (uint8_t) reversed;
+    }
+    return result;
+}
+
+static constexpr std::array<uint8_t, 256> bitReversal = makeBitReversal();
+
+/* Scalar kernels. These are used on CPUs without SIMD support, and
+ *   for the samples left over after the last whole vector. */
+
+static void threshold8Scalar(const uint8_t *input, const uint8_t *thresholds, uint8_t *output, std::size_t n,
+                             uint8_t onValue) {
+    for (std::size_t i = 0; i < n; i++)
+        output[i] = (input[i] > thresholds[i]) ? onValue : 0;
+}
+
+static void threshold16BEScalar(const uint8_t *input, const uint16_t *thresholds, uint8_t *output, std::size_t n,
+                                uint16_t onValue) {
+    for (std::size_t i = 0; i < n; i++) {
+        unsigned int value = ((unsigned int) input[2 * i] << 8U) | input[(2 * i) + 1];
+        unsigned int result = (value > thresholds[i]) ? onValue : 0;
+        output[2 * i] = (uint8_t) (result >> 8U);
+        output[(2 * i) + 1] = (uint8_t) (result & 0xFFU);
+    }
+}
+
+static void threshold16Scalar(const uint16_t *input, const uint16_t *thresholds, uint16_t *output, std::size_t n,
+                              uint16_t onValue) {
+    for (std::size_t i = 0; i < n; i++)
+        output[i] = (input[i] > thresholds[i]) ? onValue : 0;
+}
+
+static void threshold32Scalar(const unsigned int *input, const unsigned int *thresholds, unsigned int *output,
+                              std::size_t n, unsigned int onValue) {
+    for (std::size_t i = 0; i < n; i++)
+        output[i] = (input[i] > thresholds[i]) ? onValue : 0;
+}
+
+static void threshold8KeepScalar(const uint8_t *input, const uint8_t *thresholds, const uint8_t *keep, uint8_t *output,
+                                 std::size_t n, uint8_t onValue) {
+    for (std::size_t i = 0; i < n; i++)
+        output[i] = keep[i] ? input[i] : ((input[i] > thresholds[i]) ? onValue : 0);
+}
+
+static void threshold16BEKeepScalar(const uint8_t *input, const uint16_t *thresholds, const uint16_t *keep,
+                                    uint8_t *output, std::size_t n, uint16_t onValue) {
+    for (std::size_t i = 0; i < n; i++) {
+        unsigned int value = ((unsigned int) input[2 * i] << 8U) | input[(2 * i) + 1];
+        unsigned int result = keep[i] ? value : ((value > thresholds[i]) ? onValue : 0);
+        output[2 * i] = (uint8_t) (result >> 8U);
+        output[(2 * i) + 1] = (uint8_t) (result & 0xFFU);
+    }
+}
+
+static void threshold16KeepScalar(const uint16_t *input, const uint16_t *thresholds, const uint16_t *keep,
+                                  uint16_t *output, std::size_t n, uint16_t onValue) {
+    for (std::size_t i = 0; i < n; i++)
+        output[i] = keep[i] ? input[i] : ((input[i] > thresholds[i]) ? onValue : 0);
+}
+
+static void threshold32KeepScalar(const unsigned int *input, const unsigned int *thresholds, const unsigned int *keep,
+                                  unsigned int *output, std::size_t n, unsigned int onValue) {
+    for (std::size_t i = 0; i < n; i++)
+        output[i] = keep[i] ? input[i] : ((input[i] > thresholds[i]) ? onValue : 0);
+}
+
+static void threshold32BitsScalar(const unsigned int *input, const unsigned int *thresholds, uint8_t *output,
+                                  std::size_t n) {
+    for (std::size_t i = 0; i < n; i += 8) {
+        std::size_t end = std::min<std::size_t>(i + 8, n);
+        unsigned int packed = 0;
+        for (std::size_t j = i; j < end; j++)
+            packed |= (unsigned int) (input[j] > thresholds[j]) << (7 - (j - i));
+        output[i / 8] = (uint8_t) packed;
+    }
+}
+
+#ifdef DITHER_X86_SIMD
+
+/* SSE2 kernels, 16 bytes at a time. SSE2 has no unsigned compare, so a > b is
+ *   computed as a saturating subtract a - b that is non-zero only when a > b. */
+
+__attribute__((target("sse2")))
+static void threshold8SSE2(const uint8_t *input, const uint8_t *thresholds, uint8_t *output, std::size_t n,
+                           uint8_t onValue) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i on = _mm_set1_epi8((char) onValue);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i value = _mm_loadu_si128((const __m128i *) (input + i));
+        __m128i threshold = _mm_loadu_si128((const __m128i *) (thresholds + i));
+        __m128i notAbove = _mm_cmpeq_epi8(_mm_subs_epu8(value, threshold), zero);
+        _mm_storeu_si128((__m128i *) (output + i), _mm_andnot_si128(notAbove, on));
+    }
+    threshold8Scalar(input + i, thresholds + i, output + i, n - i, onValue);
+}
+
+__attribute__((target("sse2")))
+static void threshold16BESSE2(const uint8_t *input, const uint16_t *thresholds, uint8_t *output, std::size_t n,
+                              uint16_t onValue) {
+    const __m128i zero = _mm_setzero_si128();
+    const uint16_t onValueBE = (uint16_t) ((onValue >> 8U) | (onValue << 8U));
+    const __m128i on = _mm_set1_epi16((short) onValueBE);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i raw = _mm_loadu_si128((const __m128i *) (input + (2 * i)));
+        __m128i value = _mm_or_si128(_mm_slli_epi16(raw, 8), _mm_srli_epi16(raw, 8));
+        __m128i threshold = _mm_loadu_si128((const __m128i *) (thresholds + i));
+        __m128i notAbove = _mm_cmpeq_epi16(_mm_subs_epu16(value, threshold), zero);
+        _mm_storeu_si128((__m128i *) (output + (2 * i)), _mm_andnot_si128(notAbove, on));
+    }
+    threshold16BEScalar(input + (2 * i), thresholds + i, output + (2 * i), n - i, onValue);
+}
+
+__attribute__((target("sse2")))
+static void threshold16SSE2(const uint16_t *input, const uint16_t *thresholds, uint16_t *output, std::size_t n,
+                            uint16_t onValue) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i on = _mm_set1_epi16((short) onValue);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i value = _mm_loadu_si128((const __m128i *) (input + i));
+        __m128i threshold = _mm_loadu_si128((const __m128i *) (thresholds + i));
+        __m128i notAbove = _mm_cmpeq_epi16(_mm_subs_epu16(value, threshold), zero);
+        _mm_storeu_si128((__m128i *) (output + i), _mm_andnot_si128(notAbove, on));
+    }
+    threshold16Scalar(input + i, thresholds + i, output + i, n - i, onValue);
+}
+
+// Samples never exceed 16 bits, so the signed 32 bit compare is safe.
+__attribute__((target("sse2")))
+static void threshold32SSE2(const unsigned int *input, const unsigned int *thresholds, unsigned int *output,
+                            std::size_t n, unsigned int onValue) {
+    const __m128i on = _mm_set1_epi32((int) onValue);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i value = _mm_loadu_si128((const __m128i *) (input + i));
+        __m128i threshold = _mm_loadu_si128((const __m128i *) (thresholds + i));
+        _mm_storeu_si128((__m128i *) (output + i), _mm_and_si128(_mm_cmpgt_epi32(value, threshold), on));
+    }
+    threshold32Scalar(input + i, thresholds + i, output + i, n - i, onValue);
+}
+
+/* Samples that are kept never exceed their threshold, so they can be merged into the
+ *   thresholded samples with an or. */
+__attribute__((target("sse2")))
+static void threshold8KeepSSE2(const uint8_t *input, const uint8_t *thresholds, const uint8_t *keep, uint8_t *output,
+                               std::size_t n, uint8_t onValue) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i on = _mm_set1_epi8((char) onValue);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i value = _mm_loadu_si128((const __m128i *) (input + i));
+        __m128i threshold = _mm_loadu_si128((const __m128i *) (thresholds + i));
+        __m128i kept = _mm_and_si128(value, _mm_loadu_si128((const __m128i *) (keep + i)));
+        __m128i notAbove = _mm_cmpeq_epi8(_mm_subs_epu8(value, threshold), zero);
+        _mm_storeu_si128((__m128i *) (output + i), _mm_or_si128(_mm_andnot_si128(notAbove, on), kept));
+    }
+    threshold8KeepScalar(input + i, thresholds + i, keep + i, output + i, n - i, onValue);
+}
+
+// The keep mask is the same in either byte order, so kept samples are passed through without being swapped.
+__attribute__((target("sse2")))
+static void threshold16BEKeepSSE2(const uint8_t *input, const uint16_t *thresholds, const uint16_t *keep,
+                                  uint8_t *output, std::size_t n, uint16_t onValue) {
+    const __m128i zero = _mm_setzero_si128();
+    const uint16_t onValueBE = (uint16_t) ((onValue >> 8U) | (onValue << 8U));
+    const __m128i on = _mm_set1_epi16((short) onValueBE);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i raw = _mm_loadu_si128((const __m128i *) (input + (2 * i)));
+        __m128i value = _mm_or_si128(_mm_slli_epi16(raw, 8), _mm_srli_epi16(raw, 8));
+        __m128i threshold = _mm_loadu_si128((const __m128i *) (thresholds + i));
+        __m128i kept = _mm_and_si128(raw, _mm_loadu_si128((const __m128i *) (keep + i)));
+        __m128i notAbove = _mm_cmpeq_epi16(_mm_subs_epu16(value, threshold), zero);
+        _mm_storeu_si128((__m128i *) (output + (2 * i)), _mm_or_si128(_mm_andnot_si128(notAbove, on), kept));
+    }
+    threshold16BEKeepScalar(input + (2 * i), thresholds + i, keep + i, output + (2 * i), n - i, onValue);
+}
+
+__attribute__((target("sse2")))
+static void threshold16KeepSSE2(const uint16_t *input, const uint16_t *thresholds, const uint16_t *keep,
+                                uint16_t *output, std::size_t n, uint16_t onValue) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i on = _mm_set1_epi16((short) onValue);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i value = _mm_loadu_si128((const __m128i *) (input + i));
+        __m128i threshold = _mm_loadu_si128((const __m128i *) (thresholds + i));
+        __m128i kept = _mm_and_si128(value, _mm_loadu_si128((const __m128i *) (keep + i)));
+        __m128i notAbove = _mm_cmpeq_epi16(_mm_subs_epu16(value, threshold), zero);
+        _mm_storeu_si128((__m128i *) (output + i), _mm_or_si128(_mm_andnot_si128(notAbove, on), kept));
+    }
+    threshold16KeepScalar(input + i, thresholds + i, keep + i, output + i, n - i, onValue);
+}
+
+__attribute__((target("sse2")))
+static void threshold32KeepSSE2(const unsigned int *input, const unsigned int *thresholds, const unsigned int *keep,
+                                unsigned int *output, std::size_t n, unsigned int onValue) {
+    const __m128i on = _mm_set1_epi32((int) onValue);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i value = _mm_loadu_si128((const __m128i *) (input + i));
+        __m128i threshold = _mm_loadu_si128((const __m128i *) (thresholds + i));
+        __m128i kept = _mm_and_si128(value, _mm_loadu_si128((const __m128i *) (keep + i)));
+        __m128i result = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi32(value, threshold), on), kept);
+        _mm_storeu_si128((__m128i *) (output + i), result);
+    }
+    threshold32KeepScalar(input + i, thresholds + i, keep + i, output + i, n - i, onValue);
+}
+
+// Packs the compare results of 8 samples into a byte with movemask.
+__attribute__((target("sse2")))
+static void threshold32BitsSSE2(const unsigned int *input, const unsigned int *thresholds, uint8_t *output,
+                                std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i low = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *) (input + i)),
+                                      _mm_loadu_si128((const __m128i *) (thresholds + i)));
+        __m128i high = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *) (input + i + 4)),
+                                       _mm_loadu_si128((const __m128i *) (thresholds + i + 4)));
+        unsigned int mask = (unsigned int) _mm_movemask_ps(_mm_castsi128_ps(low)) |
+                            ((unsigned int) _mm_movemask_ps(_mm_castsi128_ps(high)) << 4U);
+        output[i / 8] = bitReversal[mask];
+    }
+    threshold32BitsScalar(input + i, thresholds + i, output + (i / 8), n - i);
+}
+
+// AVX2 kernels. The same as the SSE2 kernels, but 32 bytes at a time.
+
+__attribute__((target("avx2")))
+static void threshold8AVX2(const uint8_t *input, const uint8_t *thresholds, uint8_t *output, std::size_t n,
+                           uint8_t onValue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i on = _mm256_set1_epi8((char) onValue);
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i value = _mm256_loadu_si256((const __m256i *) (input + i));
+        __m256i threshold = _mm256_loadu_si256((const __m256i *) (thresholds + i));
+        __m256i notAbove = _mm256_cmpeq_epi8(_mm256_subs_epu8(value, threshold), zero);
+        _mm256_storeu_si256((__m256i *) (output + i), _mm256_andnot_si256(notAbove, on));
+    }
+    threshold8Scalar(input + i, thresholds + i, output + i, n - i, onValue);
+}
+
+__attribute__((target("avx2")))
+static void threshold16BEAVX2(const uint8_t *input, const uint16_t *thresholds, uint8_t *output, std::size_t n,
+                              uint16_t onValue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const uint16_t onValueBE = (uint16_t) ((onValue >> 8U) | (onValue << 8U));
+    const __m256i on = _mm256_set1_epi16((short) onValueBE);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i raw = _mm256_loadu_si256((const __m256i *) (input + (2 * i)));
+        __m256i value = _mm256_or_si256(_mm256_slli_epi16(raw, 8), _mm256_srli_epi16(raw, 8));
+        __m256i threshold = _mm256_loadu_si256((const __m256i *) (thresholds + i));
+        __m256i notAbove = _mm256_cmpeq_epi16(_mm256_subs_epu16(value, threshold), zero);
+        _mm256_storeu_si256((__m256i *) (output + (2 * i)), _mm256_andnot_si256(notAbove, on));
+    }
+    threshold16BEScalar(input + (2 * i), thresholds + i, output + (2 * i), n - i, onValue);
+}
+
+__attribute__((target("avx2")))
+static void threshold16AVX2(const uint16_t *input, const uint16_t *thresholds, uint16_t *output, std::size_t n,
+                            uint16_t onValue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i on = _mm256_set1_epi16((short) onValue);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i value = _mm256_loadu_si256((const __m256i *) (input + i));
+        __m256i threshold = _mm256_loadu_si256((const __m256i *) (thresholds + i));
+        __m256i notAbove = _mm256_cmpeq_epi16(_mm256_subs_epu16(value, threshold), zero);
+        _mm256_storeu_si256((__m256i *) (output + i), _mm256_andnot_si256(notAbove, on));
+    }
+    threshold16Scalar(input + i, thresholds + i, output + i, n - i, onValue);
+}
+
+__attribute__((target("avx2")))
+static void threshold32AVX2(const unsigned int *input, const unsigned int *thresholds, unsigned int *output,
+                            std::size_t n, unsigned int onValue) {
+    const __m256i on = _mm256_set1_epi32((int) onValue);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i value = _mm256_loadu_si256((const __m256i *) (input + i));
+        __m256i threshold = _mm256_loadu_si256((const __m256i *) (thresholds + i));
+        _mm256_storeu_si256((__m256i *) (output + i), _mm256_and_si256(_mm256_cmpgt_epi32(value, threshold), on));
+    }
+    threshold32Scalar(input + i, thresholds + i, output + i, n - i, onValue);
+}
+
+__attribute__((target("avx2")))
+static void threshold8KeepAVX2(const uint8_t *input, const uint8_t *thresholds, const uint8_t *keep, uint8_t *output,
+                               std::size_t n, uint8_t onValue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i on = _mm256_set1_epi8((char) onValue);
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i value = _mm256_loadu_si256((const __m256i *) (input + i));
+        __m256i threshold = _mm256_loadu_si256((const __m256i *) (thresholds + i));
+        __m256i kept = _mm256_and_si256(value, _mm256_loadu_si256((const __m256i *) (keep + i)));
+        __m256i notAbove = _mm256_cmpeq_epi8(_mm256_subs_epu8(value, threshold), zero);
+        _mm256_storeu_si256((__m256i *) (output + i), _mm256_or_si256(_mm256_andnot_si256(notAbove, on), kept));
+    }
+    threshold8KeepScalar(input + i, thresholds + i, keep + i, output + i, n - i, onValue);
+}
+
+__attribute__((target("avx2")))
+static void threshold16BEKeepAVX2(const uint8_t *input, const uint16_t *thresholds, const uint16_t *keep,
+                                  uint8_t *output, std::size_t n, uint16_t onValue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const uint16_t onValueBE = (uint16_t) ((onValue >> 8U) | (onValue << 8U));
+    const __m256i on = _mm256_set1_epi16((short) onValueBE);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i raw = _mm256_loadu_si256((const __m256i *) (input + (2 * i)));
+        __m256i value = _mm256_or_si256(_mm256_slli_epi16(raw, 8), _mm256_srli_epi16(raw, 8));
+        __m256i threshold = _mm256_loadu_si256((const __m256i *) (thresholds + i));
+        __m256i kept = _mm256_and_si256(raw, _mm256_loadu_si256((const __m256i *) (keep + i)));
+        __m256i notAbove = _mm256_cmpeq_epi16(_mm256_subs_epu16(value, threshold), zero);
+        _mm256_storeu_si256((__m256i *) (output + (2 * i)), _mm256_or_si256(_mm256_andnot_si256(notAbove, on), kept));
+    }
+    threshold16BEKeepScalar(input + (2 * i), thresholds + i, keep + i, output + (2 * i), n - i, onValue);
+}
+
+__attribute__((target("avx2")))
+static void threshold16KeepAVX2(const uint16_t *input, const uint16_t *thresholds, const uint16_t *keep,
+                                uint16_t *output, std::size_t n, uint16_t onValue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i on = _mm256_set1_epi16((short) onValue);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i value = _mm256_loadu_si256((const __m256i *) (input + i));
+        __m256i threshold = _mm256_loadu_si256((const __m256i *) (thresholds + i));
+        __m256i kept = _mm256_and_si256(value, _mm256_loadu_si256((const __m256i *) (keep + i)));
+        __m256i notAbove = _mm256_cmpeq_epi16(_mm256_subs_epu16(value, threshold), zero);
+        _mm256_storeu_si256((__m256i *) (output + i), _mm256_or_si256(_mm256_andnot_si256(notAbove, on), kept));
+    }
+    threshold16KeepScalar(input + i, thresholds + i, keep + i, output + i, n - i, onValue);
+}
+
+__attribute__((target("avx2")))
+static void threshold32KeepAVX2(const unsigned int *input, const unsigned int *thresholds, const unsigned int *keep,
+                                unsigned int *output, std::size_t n, unsigned int onValue) {
+    const __m256i on = _mm256_set1_epi32((int) onValue);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i value = _mm256_loadu_si256((const __m256i *) (input + i));
+        __m256i threshold = _mm256_loadu_si256((const __m256i *) (thresholds + i));
+        __m256i kept = _mm256_and_si256(value, _mm256_loadu_si256((const __m256i *) (keep + i)));
+        __m256i result = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi32(value, threshold), on), kept);
+        _mm256_storeu_si256((__m256i *) (output + i), result);
+    }
+    threshold32KeepScalar(input + i, thresholds + i, keep + i, output + i, n - i, onValue);
+}
+
+__attribute__((target("avx2")))
+static void threshold32BitsAVX2(const unsigned int *input, const unsigned int *thresholds, uint8_t *output,
+                                std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i above = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *) (input + i)),
+                                           _mm256_loadu_si256((const __m256i *) (thresholds + i)));
+        output[i / 8] = bitReversal[(unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(above))];
+    }
+    threshold32BitsScalar(input + i, thresholds + i, output + (i / 8), n - i);
+}
+
+#endif
+
+void ThresholdKernel::allocatePatterns(unsigned int nRows, std::size_t nSamplesPerPeriod) {
+    patternLength = std::lcm<std::size_t>(nSamplesPerPeriod, maxVectorBytes);
+    patterns8.assign(nRows, std::vector<uint8_t>(patternLength));
+    patterns16.assign(nRows, std::vector<uint16_t>(patternLength));
+    patterns32.assign(nRows, std::vector<unsigned int>(patternLength));
+}
+
+void ThresholdKernel::setThreshold(unsigned int row, std::size_t i, unsigned int threshold) {
+    patterns8[row][i] = (uint8_t) std::min(threshold, 0xFFU);
+    patterns16[row][i] = (uint16_t) std::min(threshold, 0xFFFFU);
+    patterns32[row][i] = threshold;
+}
+
+void ThresholdKernel::applyToRow(const uint8_t *input, uint8_t *output, std::size_t n, unsigned long int y) const {
+    if (!keepMask8.empty()) {
+        applyToRowKeeping(input, output, n, y);
+        return;
+    }
+
+    auto kernel = threshold8Scalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold8AVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold8SSE2;
+#endif
+
+    const std::vector<uint8_t> &pattern = patterns8[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + start, pattern.data(), output + start, std::min(patternLength, n - start), onValue);
+}
+
+void
+ThresholdKernel::applyToRow16BE(const uint8_t *input, uint8_t *output, std::size_t n, unsigned long int y) const {
+    if (!keepMask16.empty()) {
+        applyToRowKeeping16BE(input, output, n, y);
+        return;
+    }
+
+    auto kernel = threshold16BEScalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold16BEAVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold16BESSE2;
+#endif
+
+    const std::vector<uint16_t> &pattern = patterns16[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + (2 * start), pattern.data(), output + (2 * start), std::min(patternLength, n - start),
+               onValue);
+}
+
+void ThresholdKernel::applyToRow(const uint16_t *input, uint16_t *output, std::size_t n,
+                                 unsigned long int y) const {
+    if (!keepMask16.empty()) {
+        applyToRowKeeping(input, output, n, y);
+        return;
+    }
+
+    auto kernel = threshold16Scalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold16AVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold16SSE2;
+#endif
+
+    const std::vector<uint16_t> &pattern = patterns16[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + start, pattern.data(), output + start, std::min(patternLength, n - start), onValue);
+}
+
+void ThresholdKernel::applyToRow(const unsigned int *input, unsigned int *output, std::size_t n,
+                                 unsigned long int y) const {
+    if (!keepMask32.empty()) {
+        applyToRowKeeping(input, output, n, y);
+        return;
+    }
+
+    auto kernel = threshold32Scalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold32AVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold32SSE2;
+#endif
+
+    const std::vector<unsigned int> &pattern = patterns32[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + start, pattern.data(), output + start, std::min(patternLength, n - start), onValue);
+}
+
+void ThresholdKernel::applyToRowKeeping(const uint8_t *input, uint8_t *output, std::size_t n,
+                                        unsigned long int y) const {
+    auto kernel = threshold8KeepScalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold8KeepAVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold8KeepSSE2;
+#endif
+
+    const std::vector<uint8_t> &pattern = patterns8[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + start, pattern.data(), keepMask8.data(), output + start, std::min(patternLength, n - start),
+               onValue);
+}
+
+void ThresholdKernel::applyToRowKeeping16BE(const uint8_t *input, uint8_t *output, std::size_t n,
+                                            unsigned long int y) const {
+    auto kernel = threshold16BEKeepScalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold16BEKeepAVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold16BEKeepSSE2;
+#endif
+
+    const std::vector<uint16_t> &pattern = patterns16[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + (2 * start), pattern.data(), keepMask16.data(), output + (2 * start),
+               std::min(patternLength, n - start), onValue);
+}
+
+void ThresholdKernel::applyToRowKeeping(const uint16_t *input, uint16_t *output, std::size_t n,
+                                        unsigned long int y) const {
+    auto kernel = threshold16KeepScalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold16KeepAVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold16KeepSSE2;
+#endif
+
+    const std::vector<uint16_t> &pattern = patterns16[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + start, pattern.data(), keepMask16.data(), output + start, std::min(patternLength, n - start),
+               onValue);
+}
+
+void ThresholdKernel::applyToRowKeeping(const unsigned int *input, unsigned int *output, std::size_t n,
+                                        unsigned long int y) const {
+    auto kernel = threshold32KeepScalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold32KeepAVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold32KeepSSE2;
+#endif
+
+    const std::vector<unsigned int> &pattern = patterns32[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + start, pattern.data(), keepMask32.data(), output + start, std::min(patternLength, n - start),
+               onValue);
+}
+
+void ThresholdKernel::applyToRow32Bits(const unsigned int *input, uint8_t *output, std::size_t n,
+                                       unsigned long int y) const {
+    auto kernel = threshold32BitsScalar;
+#ifdef DITHER_X86_SIMD
+    if (activeInstructionSet == InstructionSet::AVX2)
+        kernel = threshold32BitsAVX2;
+    else if (activeInstructionSet == InstructionSet::SSE2)
+        kernel = threshold32BitsSSE2;
+#endif
+
+    // Patterns are a multiple of 32 samples long, so every pattern starts on a whole byte.
+    const std::vector<unsigned int> &pattern = patterns32[y & rowMask];
+    for (std::size_t start = 0; start < n; start += patternLength)
+        kernel(input + start, pattern.data(), output + (start / 8), std::min(patternLength, n - start));
+}
+
+InstructionSet ThresholdKernel::getInstructionSet() noexcept {
+    return activeInstructionSet;
+}
+
+void ThresholdKernel::setInstructionSet(InstructionSet instructionSet) noexcept {
+    activeInstructionSet = std::min(instructionSet, detectInstructionSet());
+}
+
+InstructionSet ThresholdKernel::detectInstructionSet() noexcept {
+#ifdef DITHER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return InstructionSet::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return InstructionSet::SSE2;
+#endif
+    return InstructionSet::scalar;
+}
+
+std::string ThresholdKernel::getInstructionSetName(InstructionSet instructionSet) {
+    switch (instructionSet) {
+        case InstructionSet::SSE2:
+            return "sse2";
+        case InstructionSet::AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
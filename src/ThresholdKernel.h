@@ -0,0 +1,130 @@
+#ifndef DITHER_THRESHOLDKERNEL_H
+#define DITHER_THRESHOLDKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BayerMatrix.h"
+
+enum class InstructionSet {
+    scalar,
+    SSE2,
+    AVX2,
+};
+
+/* Integer ordered dithering thresholds, precomputed once per matrix and bit depth.
+ *   value / maxValue > t / (N * N) holds exactly when value > floor(t * maxValue / (N * N)),
+ *   so every matrix entry becomes a single integer and no division is left per pixel.
+ *   The thresholds for one row are laid out as a pattern of whole vector registers
+ *   that repeats across the row, so that the kernels can compare channels 4 to 32
+ *   at a time. Rows are arrays of samples, nChannels samples per pixel. */
+class ThresholdKernel {
+public:
+    /* Sets up the thresholds of an N x N matrix for samples in [0, maxValue]. Samples
+     *   that exceed their threshold become onValue. */
+    template<unsigned int N>
+    ThresholdKernel(BayerMatrix<N> map, unsigned int maxValue, unsigned int onValue, unsigned int nChannels)
+            : onValue(onValue), rowMask(BayerMatrix<N>::mask) {
+        // The threshold of each level of the matrix. The divisor is a compile time constant.
+        unsigned int levels[BayerMatrix<N>::nLevels];
+        for (unsigned int t = 0; t < BayerMatrix<N>::nLevels; t++)
+            levels[t] = (unsigned int) (((unsigned long long int) t * maxValue) / BayerMatrix<N>::nLevels);
+
+        allocatePatterns(N, N * nChannels);
+        for (unsigned int row = 0; row < N; row++) {
+            // The threshold for the channel at i is that of the pixel at x = i / nChannels.
+            for (std::size_t i = 0; i < patternLength; i++)
+                setThreshold(row, i, levels[map.at(i / nChannels, row)]);
+        }
+    }
+
+    /* Sets up the thresholds of an N x N matrix for rows of RGBA samples in [0, maxValue]. The
+     *   colors are thresholded as by the constructor. If keepAlpha is set, alpha is passed
+     *   through as it is. Otherwise alpha is thresholded at half of maxValue, without the
+     *   matrix, so that every pixel is either transparent or opaque. */
+    template<unsigned int N>
+    static ThresholdKernel forRGBA(BayerMatrix<N> map, unsigned int maxValue, bool keepAlpha) {
+        ThresholdKernel result(map, maxValue, maxValue, 4);
+        if (keepAlpha) {
+            result.keepMask8.assign(result.patternLength, 0);
+            result.keepMask16.assign(result.patternLength, 0);
+            result.keepMask32.assign(result.patternLength, 0);
+        }
+
+        // Patterns are a multiple of 4 samples long, so every pattern starts on a red sample.
+        for (std::size_t i = 3; i < result.patternLength; i += 4) {
+            for (unsigned int row = 0; row < N; row++)
+                result.setThreshold(row, i, keepAlpha ? maxValue : maxValue / 2);
+            if (keepAlpha) {
+                result.keepMask8[i] = 0xFFU;
+                result.keepMask16[i] = 0xFFFFU;
+                result.keepMask32[i] = ~0U;
+            }
+        }
+        return result;
+    }
+
+    /* Each of these thresholds the n samples of row y, writing onValue where a sample
+     *   exceeds its threshold and 0 elsewhere. The input and output may be the same array. */
+
+    // For rows of 8 bit samples, such as the channels of RGB8_Pixel or raw LibPNG rows of 8 bit images.
+    void applyToRow(const uint8_t *input, uint8_t *output, std::size_t n, unsigned long int y) const;
+
+    // For rows of 16 bit samples, such as the channels of RGB16_Pixel.
+    void applyToRow(const uint16_t *input, uint16_t *output, std::size_t n, unsigned long int y) const;
+
+    // For rows of unsigned int samples, such as the channels of RGB_Pixel and RGBA_Pixel.
+    void applyToRow(const unsigned int *input, unsigned int *output, std::size_t n, unsigned long int y) const;
+
+    // For raw LibPNG rows of 16 bit samples, which are stored most significant byte first.
+    void applyToRow16BE(const uint8_t *input, uint8_t *output, std::size_t n, unsigned long int y) const;
+
+    /* For rows of unsigned int samples thresholded to 1 bit. Writes one bit per sample,
+     *   set where the sample exceeds its threshold, packed 8 to a byte with the first
+     *   sample in the most significant bit, as in a 1 bit LibPNG row. Unused bits of the
+     *   last byte are cleared. The output must hold (n + 7) / 8 bytes. */
+    void applyToRow32Bits(const unsigned int *input, uint8_t *output, std::size_t n, unsigned long int y) const;
+
+    // Returns the instruction set that the kernels use.
+    static InstructionSet getInstructionSet() noexcept;
+
+    /* Restricts the kernels to the supplied instruction set. If the CPU does not
+     *   support it, the best supported instruction set below it is used instead. */
+    static void setInstructionSet(InstructionSet instructionSet) noexcept;
+
+    // Returns the best instruction set supported by the CPU.
+    static InstructionSet detectInstructionSet() noexcept;
+
+    static std::string getInstructionSetName(InstructionSet instructionSet);
+
+private:
+    /* Allocates one pattern per row of the matrix. Patterns are a multiple of both the widest
+     *   vector and the samples in one period of the matrix. */
+    void allocatePatterns(unsigned int nRows, std::size_t nSamplesPerPeriod);
+
+    void setThreshold(unsigned int row, std::size_t i, unsigned int threshold);
+
+    // Each of these is as applyToRow or applyToRow16BE, but passes through the samples in the keep masks.
+
+    void applyToRowKeeping(const uint8_t *input, uint8_t *output, std::size_t n, unsigned long int y) const;
+
+    void applyToRowKeeping(const uint16_t *input, uint16_t *output, std::size_t n, unsigned long int y) const;
+
+    void applyToRowKeeping(const unsigned int *input, unsigned int *output, std::size_t n, unsigned long int y) const;
+
+    void applyToRowKeeping16BE(const uint8_t *input, uint8_t *output, std::size_t n, unsigned long int y) const;
+
+    unsigned int onValue;
+    unsigned long int rowMask;
+    std::size_t patternLength = 0;
+    std::vector<std::vector<uint8_t>> patterns8; // One pattern per row of the matrix.
+    std::vector<std::vector<uint16_t>> patterns16;
+    std::vector<std::vector<unsigned int>> patterns32;
+    std::vector<uint8_t> keepMask8; // All ones at samples passed through, if there are any.
+    std::vector<uint16_t> keepMask16;
+    std::vector<unsigned int> keepMask32;
+};
+
+
+#endif //DITHER_THRESHOLDKERNEL_H
@@ -1,180 +1,179 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 #include <png.h>
 #include <cmath>
+#include "PNG_Compression.h"
+#include "PNG_IO.h"
 #include "PNG_Loader.h"
-#include "PNG_RGB.h"
-#include "PNG_RGBA.h"
-#include "PNG_Grey.h"
 #include "PNG_structs.h"
-
-const double bayer4X4[4][4] = {{0,  8,  2,  10},
-                               {12, 4,  14, 6},
-                               {3,  11, 1,  9},
-                               {15, 7,  13, 5}};
-
-PNG_RGB bayerRGB(PNG_RGB &input, const double map[][4], unsigned int maxValue);
-
-PNG_Grey bayerGrey(PNG_RGB &input, const double map[][4], unsigned int maxValue);
-
-bool exceedsThreshold(double value, double maxValue, double threshold, double thresholdDivisor);
-
-template<typename T>
-T pixelToGrey(T red, T blue, T green);
-
-HSV_Color RGB_PixelToHSV_Color(RGB_Pixel rgb);
-
-void
-processInputArgs(int argc, char *argv[], std::string &inputFilePath, std::string &outputFilePath, bool &using3Bit);
-
-int main(int argc, char *argv[]) {
+#include "Batch.h"
+#include "BufferPool.h"
+#include "Ditherer.h"
+#include "DitherServer.h"
+#include "DitherStats.h"
+#include "ErrorDiffusion.h"
+#include "ThreadPool.h"
+#include "ThresholdKernel.h"
+
+// Settings supplied on the command line.
+struct DitherOptions {
     std::string inputFilePath;
     std::string outputFilePath;
     bool using3Bit = false;
+    InstructionSet instructionSet = ThresholdKernel::detectInstructionSet();
+    unsigned int nThreads = ThreadPool::getDefaultThreadCount();
+    DitherSettings settings; // How each file is dithered.
+    std::string batchPath; // A manifest or directory of files to dither, if set.
+    std::string batchOutputDirectory; // Where a directory of files is written.
+    std::string serveSocketPath; // The socket to serve requests on, if set.
+    unsigned int concurrency = 0; // Requests served at once. Defaults to the number of threads.
+    unsigned int queueLength = 16; // Connections waiting to be served before clients are pushed back.
+    bool reportingStats = false;
+    bool statsAsJSON = false;
+};
 
-    processInputArgs(argc, argv, inputFilePath, outputFilePath, using3Bit);
+HSV_Color RGB_PixelToHSV_Color(RGB_Pixel rgb);
 
+void processInputArgs(int argc, char *argv[], DitherOptions &options);
 
-    // Load the PNG. If the format or bit depth is not supported, exit.
-    PNG_Info fileInfo{};
-    try {
-        fileInfo = PNG_Loader::IdentifyPNG(inputFilePath);
-    } catch (BadPath &e) {
-        std::cout << "Could not load file at source. Aborting." << std::endl;
-        exit(1);
-    } catch (NotPNG &e) {
-        std::cout << "File is not a PNG. Aborting" << std::endl;
-        exit(1);
-    } catch (std::runtime_error &e) {
-        std::cout << "Fatal error. Program threw the following exception: " << e.what() << std::endl;
-        exit(1);
-    } catch (UnsupportedColorMode &e) {
-        std::cout << "File color mode not supported. Aborting." << std::endl;
-        exit(1);
-    }
+std::string getOptionArgument(int argc, char *argv[], int i);
 
-    PNG_RGB png;
-    try {
-        png = PNG_RGB(inputFilePath);
-    } catch (BadPath &e) {
-        std::cout << "Could not load file at source. Aborting." << std::endl;
-        exit(1);
-    } catch (NotPNG &e) {
-        std::cout << "File is not a PNG. Aborting" << std::endl;
-        exit(1);
-    } catch (std::runtime_error &e) {
-        std::cout << "Fatal error. Program threw the following exception: " << e.what() << std::endl;
-        exit(1);
-    } catch (UnsupportedColorMode &e) {
-        std::cout << "File color mode not supported. Aborting." << std::endl;
-        exit(1);
-    }
+unsigned int getCountArgument(int argc, char *argv[], int i, const std::string &description);
 
-    // Perform Bayer Dithering on the image using the color mode specified.
-    if (using3Bit) {
-        png = bayerRGB(png, bayer4X4, pow(2, png.getInfo().colorDepth) - 1);
+std::vector<DitherOutput> toDitherOutputs(const std::vector<BatchOutput> &outputs);
 
-        // Write the resultant PNG.
-        try {
-            png.write_png_file(outputFilePath);
-        } catch (BadPath &e) {
-            std::cout << "Could not create file at destination. Aborting." << std::endl;
-            exit(1);
-        } catch (std::runtime_error &e) {
-            std::cout << "Fatal error. Program threw the following exception: " << e.what() << std::endl;
-            exit(1);
-        }
-    } else {
-        PNG_Grey pngGrey = bayerGrey(png, bayer4X4, pow(2, png.getInfo().colorDepth) - 1);
+int runBatchMode(const DitherOptions &options);
 
-        // Write the resultant PNG.
+int runServeMode(const DitherOptions &options);
+
+int main(int argc, char *argv[]) {
+    DitherOptions options;
+    processInputArgs(argc, argv, options);
+    ThresholdKernel::setInstructionSet(options.instructionSet);
+    if (options.reportingStats)
+        DitherStats::enable();
+
+    int exitStatus = 0;
+    if (!options.batchPath.empty())
+        exitStatus = runBatchMode(options);
+    else if (!options.serveSocketPath.empty())
+        exitStatus = runServeMode(options);
+    else {
+        ThreadPool pool(options.nThreads);
+        Ditherer ditherer(options.settings, pool);
         try {
-            pngGrey.write_png_file(outputFilePath);
-        } catch (BadPath &e) {
-            std::cout << "Could not create file at destination. Aborting." << std::endl;
-            exit(1);
-        } catch (std::runtime_error &e) {
-            std::cout << "Fatal error. Program threw the following exception: " << e.what() << std::endl;
-            exit(1);
+            ditherer.ditherPNG(options.inputFilePath, {DitherOutput{options.outputFilePath, options.using3Bit}});
+        } catch (DitherFailed &e) {
+            // If the image is being written to standard output, keep the message out of it.
+            (options.outputFilePath == standardStreamPath ? std::cerr : std::cout) << e.what() << std::endl;
+            exitStatus = 1;
         }
     }
 
-    return 0;
+    /* Stats are reported whether or not the files could be dithered, on standard error so that
+     *   they never mix with an image. */
+    if (options.reportingStats)
+        DitherStats::print(std::cerr, options.statsAsJSON, options.settings.compression.describe());
+    return exitStatus;
 }
 
-PNG_RGB bayerRGB(PNG_RGB &input, const double map[][4], unsigned int maxValue) {
-    PNG_RGB resultPNG = input;
-
-    // Scan through every pixel in the image.
-    for (png_uint_32 y = 0; y < resultPNG.getInfo().height; y++) {
-        for (png_uint_32 x = 0; x < resultPNG.getInfo().width; x++) {
-            // Get the pixel at the calculated location.
-            RGB_Pixel pixel = input.getPixel(x, y).value();
-
-            // The default value of the result is a black pixel.
-            auto resultPixel = RGB_Pixel{0x00, 0x00, 0x00};
-
-            // If the color red exceeds the threshold, fill it in.
-            if (exceedsThreshold(pixel.red, maxValue, map[x % 4][y % 4], 16.0))
-                resultPixel.red = maxValue;
-
-            // If the color blue exceeds the threshold, fill it in.
-            if (exceedsThreshold(pixel.blue, maxValue, map[x % 4][y % 4], 16.0))
-                resultPixel.blue = maxValue;
-
-            // If the color green exceeds the threshold, fill it in.
-            if (exceedsThreshold(pixel.green, maxValue, map[x % 4][y % 4], 16.0))
-                resultPixel.green = maxValue;
-
-            // Save the resultant pixel to the output PNG.
-            resultPNG.setPixel(x, y, resultPixel);
-        }
+/* Serves requests on the socket until the process is interrupted or terminated.
+ *   Returns the exit status of the program. */
+int runServeMode(const DitherOptions &options) {
+    unsigned int concurrency = (options.concurrency > 0) ? options.concurrency : options.nThreads;
+    DitherServer server(options.serveSocketPath, options.settings, options.using3Bit, options.nThreads, concurrency,
+                        options.queueLength);
+    BufferPool::enable(BufferPool::defaultRetainedBytes); // Requests reuse the buffers of those before them.
+    try {
+        server.run();
+    } catch (BadPath &e) {
+        std::cout << "Could not create socket at \"" << options.serveSocketPath << "\". Aborting." << std::endl;
+        return 1;
+    } catch (std::runtime_error &e) {
+        std::cout << e.what() << ". Aborting." << std::endl;
+        return 1;
     }
-
-    return resultPNG;
+    return 0;
 }
 
-PNG_Grey bayerGrey(PNG_RGB &input, const double map[][4], unsigned int maxValue) {
-    unsigned int bitDepth = 1;
-    unsigned int onColor = pow(2, bitDepth) - 1;
-    PNG_Grey resultPNG = PNG_Grey(input.getInfo().width, input.getInfo().height, bitDepth);
-
-    // Scan through every pixel in the image.
-    for (png_uint_32 y = 0; y < resultPNG.getInfo().height; y++) {
-        for (png_uint_32 x = 0; x < resultPNG.getInfo().width; x++) {
-            // Get the pixel at the calculated location.
-            RGB_Pixel pixel = input.getPixel(x, y).value();
-
-            // The default value of the result is a black pixel.
-            GreyPixel resultPixel = 0;
-
-            // If using 3Bit color mode.
-            // Convert the pixel to greyscale.
-            GreyPixel grey = pixelToGrey(pixel.red, pixel.blue, pixel.green);
-
-            // If the pixel's value exceeds the threshold, fill it in.
-            if (exceedsThreshold(grey, maxValue, map[x % 4][y % 4], 16.0))
-                resultPixel = onColor;
+// Converts the outputs of a batch job to the outputs of a Ditherer.
+std::vector<DitherOutput> toDitherOutputs(const std::vector<BatchOutput> &outputs) {
+    std::vector<DitherOutput> ditherOutputs;
+    for (const BatchOutput &output : outputs)
+        ditherOutputs.push_back(DitherOutput{output.filePath, output.using3Bit});
+    return ditherOutputs;
+}
 
-            // Save the resultant pixel to the output PNG.
-            resultPNG.setPixel(x, y, resultPixel);
+/* Dithers every job of the batch, spread over the threads. Failed jobs are reported and
+ *   skipped, and the rest of the batch carries on. Returns the exit status of the program. */
+int runBatchMode(const DitherOptions &options) {
+    std::vector<BatchJob> jobs;
+    try {
+        if (std::filesystem::is_directory(options.batchPath)) {
+            if (options.batchOutputDirectory.empty()) {
+                std::cout << "Missing output directory\nTry 'dither --help' for more information.\n";
+                return 1;
+            }
+            jobs = listBatchDirectory(options.batchPath, options.batchOutputDirectory, options.using3Bit);
+        } else {
+            if (!options.batchOutputDirectory.empty()) {
+                std::cout << "Too many operands provided\nTry 'dither --help' for more information.\n";
+                return 1;
+            }
+            jobs = readBatchManifest(options.batchPath, options.using3Bit);
         }
+    } catch (BadPath &e) {
+        std::cout << "Could not open batch at \"" << options.batchPath << "\". Aborting." << std::endl;
+        return 1;
+    } catch (std::invalid_argument &e) {
+        std::cout << e.what() << ". Aborting." << std::endl;
+        return 1;
+    } catch (std::filesystem::filesystem_error &e) {
+        std::cout << "Could not open batch at \"" << options.batchPath << "\". Aborting." << std::endl;
+        return 1;
+    }
+    if (jobs.empty())
+        return 0;
+    BufferPool::enable(BufferPool::defaultRetainedBytes); // Files reuse the buffers of those before them.
+
+    /* Files are dithered side by side, one per thread, as that keeps every thread busy
+     *   without the cost of splitting each image. If there are fewer files than threads,
+     *   the spare threads are shared out to split the images instead. Each thread keeps a
+     *   Ditherer of its own, so that its buffers are reused from one file to the next. */
+    auto nWorkers = (unsigned int) std::min<std::size_t>(options.nThreads, jobs.size());
+    ThreadPool pool(nWorkers);
+    std::vector<std::unique_ptr<ThreadPool>> workerPools;
+    std::vector<std::unique_ptr<Ditherer>> workerDitherers;
+    for (unsigned int i = 0; i < nWorkers; i++) {
+        workerPools.push_back(std::make_unique<ThreadPool>(options.nThreads / nWorkers));
+        workerDitherers.push_back(std::make_unique<Ditherer>(options.settings, *workerPools.back()));
     }
 
-    return resultPNG;
-}
+    std::vector<std::string> errors = runBatch(jobs, pool, [&](const BatchJob &job, unsigned int worker) {
+        workerDitherers.at(worker)->ditherPNG(job.inputFilePath, toDitherOutputs(job.outputs));
+    });
 
-bool exceedsThreshold(double value, double maxValue, double threshold, double thresholdDivisor) {
-    return (value / maxValue) > (threshold / thresholdDivisor);
-}
+    // Report every failure, then how many there were.
+    std::size_t nFailed = 0;
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+        if (errors.at(i).empty())
+            continue;
+        std::cout << jobs.at(i).inputFilePath << ": " << errors.at(i) << std::endl;
+        nFailed++;
+    }
+    if (nFailed > 0) {
+        std::cout << nFailed << " of " << jobs.size() << " files could not be dithered." << std::endl;
+        return 1;
+    }
 
-/* Converts a color pixel to greyscale.
- *   Colors are weighted by luminosity */
-template<typename T>
-T pixelToGrey(T red, T blue, T green) {
-    return ((0.21 * (double) red) + (0.72 * (double) green) + (0.07 * (double) blue));
+    return 0;
 }
 
 // Converts a RGB pixel to a HSV pixel.
@@ -218,10 +217,19 @@ HSV_Color RGB_PixelToHSV_Color(RGB_Pixel rgb) {
     return HSV_Color{h, s, v};
 }
 
-void processInputArgs(int argc, char *argv[], std::string &inputFilePath,
-                      std::string &outputFilePath, bool &using3Bit) {
+void processInputArgs(int argc, char *argv[], DitherOptions &options) {
     //Process the input arguments
+    std::string &inputFilePath = options.inputFilePath;
+    std::string &outputFilePath = options.outputFilePath;
     bool modeSet = false;
+    bool threadsSet = false;
+    bool matrixSet = false;
+    bool depthSet = false;
+    bool alphaSet = false;
+    bool algorithmSet = false;
+    bool compressionSet = false;
+    // Explicit compression settings, which override those of the profile, wherever they are given.
+    PNG_Compression overrides;
     bool skip = false;
     for (int i = 1; i < argc; i++) {
         // Skip this argument if necessary.
@@ -235,42 +243,324 @@ void processInputArgs(int argc, char *argv[], std::string &inputFilePath,
         // If the argument was "--help", print the help screen and exit.
         if (argument == "--help") {
             std::cout << "Usage : dither [Input Path]... [Output Path]... [Options]...\n"
-                      << "Dithers a PNG file\n"
+                      << "   or : dither --batch [Manifest Path]... [Options]...\n"
+                      << "   or : dither --batch [Input Directory]... [Output Directory]... [Options]...\n"
+                      << "Dithers a PNG file. An input path of - reads standard input, and an output path of -\n"
+                      << "writes standard output\n"
                       << "\n"
-                      << "  -m                    sets the dithering color mode(greyscale or 3bit). Default is greyscale\n";
+                      << "  -m                    sets the dithering color mode(greyscale or 3bit). Default is\n"
+                      << "                          greyscale\n"
+                      << "  -d                    sets the dithering algorithm(bayer, floyd-steinberg, atkinson,\n"
+                      << "                          jarvis, stucki or sierra). Default is bayer\n"
+                      << "  --serpentine          scans every other row right to left when error diffusing. Rows\n"
+                      << "                          are then processed on a single thread\n"
+                      << "  --matrix              sets the size of the Bayer matrix(2, 4, 8 or 16). Larger matrices\n"
+                      << "                          give more shades. Default is 4\n"
+                      << "  --depth               sets the bits per pixel of greyscale output(1, 2, 4 or 8). Depths\n"
+                      << "                          above 1 give that many grey levels, and need Bayer dithering.\n"
+                      << "                          Default is 1\n"
+                      << "  --alpha               keeps the transparency of 3bit output(keep or threshold). keep\n"
+                      << "                          passes alpha through, and threshold makes every pixel either\n"
+                      << "                          transparent or opaque. The output is indexed with a tRNS chunk\n"
+                      << "                          if it fits, and RGBA otherwise. Default is to discard alpha\n"
+                      << "  -j                    sets the number of threads used for dithering. Default is the\n"
+                      << "                          number of hardware threads\n"
+                      << "  --simd                restricts the instruction set used for dithering(scalar, sse2 or\n"
+                      << "                          avx2). Default is the best one supported by the CPU\n"
+                      << "  --compression         sets how the output is compressed(fast, balanced or small).\n"
+                      << "                          Default is balanced\n"
+                      << "  --compression-level   overrides the zlib level of the profile(0 to 9)\n"
+                      << "  --compression-strategy\n"
+                      << "                        overrides the zlib strategy of the profile(default, filtered,\n"
+                      << "                          huffman, rle or fixed)\n"
+                      << "  --compression-filter  overrides the PNG row filter of the profile(none, sub, up,\n"
+                      << "                          average, paeth or all)\n"
+                      << "  --stats               reports, on standard error, the time spent decoding, converting,\n"
+                      << "                          dithering and encoding, the throughput, the bytes read and\n"
+                      << "                          written, the image allocations and the peak memory use.\n"
+                      << "                          --stats=json reports them as a single line of JSON\n"
+                      << "  --crop                crops the image to \"x,y,width,height\" before dithering it.\n"
+                      << "                          Only the rows of the crop are converted\n"
+                      << "  --resize              resizes the image, after any crop, to \"WIDTHxHEIGHT\" by area\n"
+                      << "                          averaging as its rows are decoded, so that it is never held\n"
+                      << "                          at full size. Leaving out a side keeps the aspect ratio\n"
+                      << "  --stream              decodes, dithers and encodes one row at a time, using memory\n"
+                      << "                          proportional to the width of the image only\n"
+                      << "  --batch               dithers many files in one run, side by side across the threads.\n"
+                      << "                          Takes a manifest, holding an \"input output [mode]\" line per\n"
+                      << "                          file, or a directory, whose PNGs are written to the directory\n"
+                      << "                          given as the only operand. Files that fail are reported and\n"
+                      << "                          skipped\n"
+                      << "  --serve               serves requests on a UNIX socket until interrupted. Each request\n"
+                      << "                          holds options and a PNG, and is answered with the dithered PNG.\n"
+                      << "                          See DitherServer.h for the framing\n"
+                      << "  --concurrency         sets the number of requests served at once. Default is the\n"
+                      << "                          number of threads\n"
+                      << "  --queue               sets the number of connections that wait to be served before\n"
+                      << "                          further clients are held back. Default is 16\n";
             exit(0);
         }
 
-        // If the argument was "-m", ensure that the mode has not already been set. If not, exit.
-        if (argument == "-m") {
-            if (modeSet) {
-                std::cout << "Operation \"-m\" cannot be defined twice.\nTry 'dither --help' for more information.\n";
+        // If the argument was "--stats" or "--stats=json", report what was done once the files are dithered.
+        if ((argument == "--stats") || (argument == "--stats=json")) {
+            options.reportingStats = true;
+            options.statsAsJSON = argument == "--stats=json";
+            continue;
+        }
+
+        // If the argument was "--stream", process the image one row at a time.
+        if (argument == "--stream") {
+            options.settings.streaming = true;
+            continue;
+        }
+
+        // If the argument was "--compression", load the settings of the compression profile.
+        if (argument == "--compression") {
+            if (compressionSet) {
+                std::cout << "Operation \"--compression\" cannot be defined twice.\n"
+                          << "Try 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            try {
+                options.settings.compression = PNG_Compression::fromProfile(argument2);
+            } catch (std::invalid_argument &e) {
+                std::cout << e.what() << ".\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+            compressionSet = true;
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--compression-level", load the zlib level. It must be from 0 to 9.
+        if (argument == "--compression-level") {
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            if ((argument2.size() != 1) || (argument2.find_first_not_of("0123456789") != std::string::npos)) {
+                std::cout << '\"' << argument2
+                          << "\" is not a valid compression level.\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+            overrides.level = std::stoi(argument2);
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--compression-strategy" or "--compression-filter", load the setting.
+        if ((argument == "--compression-strategy") || (argument == "--compression-filter")) {
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            try {
+                if (argument == "--compression-strategy")
+                    overrides.strategy = PNG_Compression::parseStrategy(argument2);
+                else
+                    overrides.filters = PNG_Compression::parseFilters(argument2);
+            } catch (std::invalid_argument &e) {
+                std::cout << e.what() << ".\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--batch", load the manifest or directory of files to dither.
+        if (argument == "--batch") {
+            if (!options.batchPath.empty()) {
+                std::cout << "Operation \"--batch\" cannot be defined twice.\n"
+                          << "Try 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            options.batchPath = getOptionArgument(argc, argv, i);
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--crop" or "--resize", load the region or size of the image to dither.
+        if ((argument == "--crop") || (argument == "--resize")) {
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            try {
+                if (argument == "--crop")
+                    options.settings.geometry.parseCrop(argument2);
+                else
+                    options.settings.geometry.parseSize(argument2);
+            } catch (std::invalid_argument &e) {
+                std::cout << e.what() << ".\nTry 'dither --help' for more information.\n";
                 exit(1);
             }
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--serve", load the path of the socket to serve requests on.
+        if (argument == "--serve") {
+            if (!options.serveSocketPath.empty()) {
+                std::cout << "Operation \"--serve\" cannot be defined twice.\n"
+                          << "Try 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            options.serveSocketPath = getOptionArgument(argc, argv, i);
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--concurrency" or "--queue", load the limit. It must be a positive integer.
+        if (argument == "--concurrency") {
+            options.concurrency = getCountArgument(argc, argv, i, "number of requests");
+            skip = true;
+            continue;
+        }
+        if (argument == "--queue") {
+            options.queueLength = getCountArgument(argc, argv, i, "queue length");
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--serpentine", alternate the direction of error diffusion.
+        if (argument == "--serpentine") {
+            options.settings.serpentine = true;
+            continue;
+        }
+
+        // If the argument was "-d", load the dithering algorithm.
+        if (argument == "-d") {
+            if (algorithmSet) {
+                std::cout << "Operation \"-d\" cannot be defined twice.\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            if (argument2 != "bayer") {
+                try {
+                    options.settings.diffusionKernel = &DiffusionKernel::fromName(argument2);
+                } catch (std::invalid_argument &e) {
+                    std::cout << '\"' << argument2
+                              << "\" not recognized as an algorithm.\nTry 'dither --help' for more information.\n";
+                    exit(1);
+                }
+            }
+
+            algorithmSet = true;
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--simd", restrict the instruction set of the dithering kernels.
+        if (argument == "--simd") {
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            if (argument2 == "scalar")
+                options.instructionSet = InstructionSet::scalar;
+            else if (argument2 == "sse2")
+                options.instructionSet = InstructionSet::SSE2;
+            else if (argument2 == "avx2")
+                options.instructionSet = InstructionSet::AVX2;
+            else {
+                std::cout << '\"' << argument2
+                          << "\" not recognized as an instruction set.\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--matrix", load the size of the Bayer matrix.
+        if (argument == "--matrix") {
+            if (matrixSet) {
+                std::cout << "Operation \"--matrix\" cannot be defined twice.\n"
+                          << "Try 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            if ((argument2 != "2") && (argument2 != "4") && (argument2 != "8") && (argument2 != "16")) {
+                std::cout << '\"' << argument2
+                          << "\" is not a valid matrix size.\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            options.settings.matrixSize = std::stoul(argument2);
+            matrixSet = true;
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "--depth", load the bit depth of greyscale output.
+        if (argument == "--depth") {
+            if (depthSet) {
+                std::cout << "Operation \"--depth\" cannot be defined twice.\n"
+                          << "Try 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            if ((argument2 != "1") && (argument2 != "2") && (argument2 != "4") && (argument2 != "8")) {
+                std::cout << '\"' << argument2
+                          << "\" is not a valid grey depth.\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            options.settings.greyDepth = std::stoul(argument2);
+            depthSet = true;
+            skip = true;
+            continue;
+        }
 
-            // Ensure that there is an argument following "-m". If not, exit.
-            if (i == (argc - 1)) {
-                std::cout << "Operation \"-m\" requires argument.\nTry 'dither --help' for more information.\n";
+        // If the argument was "--alpha", load what becomes of the alpha of 3 bit output.
+        if (argument == "--alpha") {
+            if (alphaSet) {
+                std::cout << "Operation \"--alpha\" cannot be defined twice.\n"
+                          << "Try 'dither --help' for more information.\n";
                 exit(1);
             }
 
-            // If the argument following "-m" is another command argument, exit.
-            std::string argument2 = std::string(argv[i + 1]);
-            if (argument2.at(0) == '-') {
-                std::cout << "Operation \"-m\" requires argument.\nTry 'dither --help' for more information.\n";
+            std::string argument2 = getOptionArgument(argc, argv, i);
+            if (argument2 == "keep")
+                options.settings.alpha = AlphaMode::keep;
+            else if (argument2 == "threshold")
+                options.settings.alpha = AlphaMode::threshold;
+            else {
+                std::cout << '\"' << argument2
+                          << "\" is not a valid alpha mode.\nTry 'dither --help' for more information.\n";
                 exit(1);
             }
+            alphaSet = true;
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "-j", load the number of threads. It must be a positive integer.
+        if (argument == "-j") {
+            if (threadsSet) {
+                std::cout << "Operation \"-j\" cannot be defined twice.\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            options.nThreads = getCountArgument(argc, argv, i, "number of threads");
+            threadsSet = true;
+            skip = true;
+            continue;
+        }
+
+        // If the argument was "-m", ensure that the mode has not already been set. If not, exit.
+        if (argument == "-m") {
+            if (modeSet) {
+                std::cout << "Operation \"-m\" cannot be defined twice.\nTry 'dither --help' for more information.\n";
+                exit(1);
+            }
+
+            std::string argument2 = getOptionArgument(argc, argv, i);
 
             /* If all the previous checks has been passed, check if the supplied argument is
              *   one of the valid argument. If so, load. If not, exit. */
             if (argument2 == "3bit") {
                 modeSet = true;
-                using3Bit = true;
+                options.using3Bit = true;
                 skip = true;
                 continue;
             } else if (argument2 == "greyscale") {
                 modeSet = true;
-                using3Bit = false;
+                options.using3Bit = false;
                 skip = true;
                 continue;
             } else {
@@ -301,6 +591,48 @@ void processInputArgs(int argc, char *argv[], std::string &inputFilePath,
         }
     }
 
+    if (overrides.level != PNG_Compression::useLibPNGDefault)
+        options.settings.compression.level = overrides.level;
+    if (overrides.strategy != PNG_Compression::useLibPNGDefault)
+        options.settings.compression.strategy = overrides.strategy;
+    if (overrides.filters != PNG_Compression::useLibPNGDefault)
+        options.settings.compression.filters = overrides.filters;
+
+    // Error diffusion only makes black and white, so more grey levels need Bayer dithering.
+    if (options.settings.diffusionKernel && (options.settings.greyDepth != 1)) {
+        std::cout << "Operation \"--depth\" above 1 requires Bayer dithering.\n"
+                  << "Try 'dither --help' for more information.\n";
+        exit(1);
+    }
+
+    // The image is resampled as it is decoded, which only keeps its colors.
+    if (alphaSet && options.settings.geometry.isSet()) {
+        std::cout << "Operation \"--alpha\" cannot be combined with \"--crop\" or \"--resize\".\n"
+                  << "Try 'dither --help' for more information.\n";
+        exit(1);
+    }
+
+    // A server is sent its images, so it takes no paths.
+    if (!options.serveSocketPath.empty()) {
+        if (!options.batchPath.empty() || !inputFilePath.empty()) {
+            std::cout << "Too many operands provided\nTry 'dither --help' for more information.\n";
+            exit(1);
+        }
+        return;
+    }
+
+    /* A batch names its own input and output files, so it takes no paths, except for
+     *   the output directory of a directory batch. */
+    if (!options.batchPath.empty()) {
+        if (!outputFilePath.empty()) {
+            std::cout << "Too many operands provided\nTry 'dither --help' for more information.\n";
+            exit(1);
+        }
+        options.batchOutputDirectory = inputFilePath;
+        inputFilePath.clear();
+        return;
+    }
+
     // Ensure that both the input and output paths have been set.
     if (inputFilePath.empty()) {
         std::cout << "Missing input file path\nTry 'dither --help' for more information.\n";
@@ -310,4 +642,44 @@ void processInputArgs(int argc, char *argv[], std::string &inputFilePath,
         std::cout << "Missing output file path\nTry 'dither --help' for more information.\n";
         exit(1);
     }
-}
\ No newline at end of file
+
+    // Greyscale output has no alpha. The modes of a batch are given per file, so only a single file is checked.
+    if (alphaSet && !options.using3Bit) {
+        std::cout << "Operation \"--alpha\" requires 3bit mode.\nTry 'dither --help' for more information.\n";
+        exit(1);
+    }
+}
+
+/* Returns the argument following the option at argv[i]. Exits if there is no
+ *   argument, or if the next argument is another option. */
+std::string getOptionArgument(int argc, char *argv[], int i) {
+    std::string option = std::string(argv[i]);
+
+    // Ensure that there is an argument following the option. If not, exit.
+    if (i == (argc - 1)) {
+        std::cout << "Operation \"" << option << "\" requires argument.\nTry 'dither --help' for more information.\n";
+        exit(1);
+    }
+
+    // If the argument following the option is another command argument, exit.
+    std::string argument = std::string(argv[i + 1]);
+    if (argument.empty() || (argument.at(0) == '-')) {
+        std::cout << "Operation \"" << option << "\" requires argument.\nTry 'dither --help' for more information.\n";
+        exit(1);
+    }
+
+    return argument;
+}
+
+/* Returns the positive integer following the option at argv[i]. Exits, saying that it is not a
+ *   valid description, if it is not a number of up to 4 digits. */
+unsigned int getCountArgument(int argc, char *argv[], int i, const std::string &description) {
+    std::string argument = getOptionArgument(argc, argv, i);
+    if ((argument.find_first_not_of("0123456789") != std::string::npos) || (argument.size() > 4) ||
+        (std::stoul(argument) == 0)) {
+        std::cout << '\"' << argument << "\" is not a valid " << description
+                  << ".\nTry 'dither --help' for more information.\n";
+        exit(1);
+    }
+    return std::stoul(argument);
+}
@@ -0,0 +1,45 @@
+#ifndef DITHER_TESTCHECK_H
+#define DITHER_TESTCHECK_H
+
+#include <iostream>
+
+/* The checks of the test programs. A failed check is reported with its line, and the program
+ *   carries on, so that a single run shows every failure. Each program returns
+ *   reportChecks(), which is non-zero if any check failed, so that ctest marks it as failed. */
+
+inline unsigned int nChecks = 0, nFailedChecks = 0;
+
+inline void checkThat(bool passed, const char *text, const char *file, int line) {
+    nChecks++;
+    if (!passed) {
+        nFailedChecks++;
+        std::cerr << file << ':' << line << ": check failed: " << text << std::endl;
+    }
+}
+
+// Returns true if calling function throws an Exception.
+template<typename Exception, typename Function>
+bool throws(Function function) {
+    try {
+        function();
+    } catch (Exception &e) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+    return false;
+}
+
+#define CHECK(condition) checkThat((condition), #condition, __FILE__, __LINE__)
+
+#define CHECK_THROWS(Exception, expression) \
+    checkThat(throws<Exception>([&]() { (void) (expression); }), #expression " throws " #Exception, __FILE__, __LINE__)
+
+// Prints how many checks failed, and returns the exit status of the test program.
+inline int reportChecks() {
+    std::cout << (nChecks - nFailedChecks) << " of " << nChecks << " checks passed" << std::endl;
+    return (nFailedChecks == 0) ? 0 : 1;
+}
+
+
+#endif //DITHER_TESTCHECK_H
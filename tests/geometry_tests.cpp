@@ -0,0 +1,221 @@
+// Tests parsing --crop and --resize, and cropping and resizing by AreaResampler.
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "AreaResampler.h"
+#include "ImageGeometry.h"
+#include "TestCheck.h"
+
+static void testParseSize() {
+    ImageGeometry geometry;
+    geometry.parseSize("640x480");
+    CHECK((geometry.width == 640) && (geometry.height == 480));
+    CHECK(geometry.isSet());
+
+    // A missing side keeps the aspect ratio.
+    geometry.parseSize("10x");
+    CHECK((geometry.width == 10) && (geometry.height == 0));
+    geometry.parseSize("x5");
+    CHECK((geometry.width == 0) && (geometry.height == 5));
+
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize(""));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("x"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("10"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("0x5"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("10x0"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("10x5x"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("10xx5"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("-10x5"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("10 x5"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("10x5a"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseSize("99999999999999999999x5"));
+
+    CHECK(!ImageGeometry().isSet());
+}
+
+static void testParseCrop() {
+    ImageGeometry geometry;
+    geometry.parseCrop("1,2,3,4");
+    CHECK(geometry.cropping);
+    CHECK((geometry.crop.x == 1) && (geometry.crop.y == 2) && (geometry.crop.width == 3) &&
+          (geometry.crop.height == 4));
+
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop(""));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("1,2,3"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("1,2,3,4,"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("1,2,3,4,5"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("1,2,0,4"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("1,2,3,0"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("1,2,3,"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("a,2,3,4"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("1x2,3,4"));
+    CHECK_THROWS(std::invalid_argument, geometry.parseCrop("1000000000,2,3,4"));
+
+    // Empty fields before the size are 0.
+    geometry.parseCrop(",,3,4");
+    CHECK((geometry.crop.x == 0) && (geometry.crop.y == 0) && (geometry.crop.width == 3) &&
+          (geometry.crop.height == 4));
+}
+
+static void testGetCrop() {
+    ImageGeometry geometry;
+    PixelRect whole = geometry.getCrop(7, 5);
+    CHECK((whole.x == 0) && (whole.y == 0) && (whole.width == 7) && (whole.height == 5));
+
+    geometry.parseCrop("2,1,5,4");
+    PixelRect crop = geometry.getCrop(7, 5);
+    CHECK((crop.x == 2) && (crop.y == 1) && (crop.width == 5) && (crop.height == 4));
+
+    // Crops reaching past the right or bottom edge.
+    CHECK_THROWS(std::invalid_argument, geometry.getCrop(6, 5));
+    CHECK_THROWS(std::invalid_argument, geometry.getCrop(7, 4));
+    geometry.parseCrop("7,0,1,1");
+    CHECK_THROWS(std::invalid_argument, geometry.getCrop(7, 5));
+    geometry.parseCrop("999999999,0,2,1");
+    CHECK_THROWS(std::invalid_argument, geometry.getCrop(7, 5));
+}
+
+static void testGetOutputSize() {
+    PixelRect keptRect{0, 0, 200, 100};
+    unsigned long int width, height;
+
+    ImageGeometry geometry;
+    geometry.getOutputSize(keptRect, width, height);
+    CHECK((width == 200) && (height == 100));
+
+    geometry.parseSize("50x");
+    geometry.getOutputSize(keptRect, width, height);
+    CHECK((width == 50) && (height == 25));
+
+    geometry.parseSize("x300");
+    geometry.getOutputSize(keptRect, width, height);
+    CHECK((width == 600) && (height == 300));
+
+    geometry.parseSize("30x40");
+    geometry.getOutputSize(keptRect, width, height);
+    CHECK((width == 30) && (height == 40));
+
+    // A side that rounds to nothing is kept at one pixel.
+    geometry.parseSize("1x");
+    geometry.getOutputSize(keptRect, width, height);
+    CHECK((width == 1) && (height >= 1));
+}
+
+/* The sample of channel c of the pixel at x and y of the test images. Varied enough that every
+ *   weight shows in the output, and covering the whole range of the depth. */
+static unsigned int getSample(unsigned long int x, unsigned long int y, unsigned int c, unsigned int maxValue) {
+    return static_cast<unsigned int>((x * 37 + y * 101 + c * 53 + x * y * 7) % (maxValue + 1));
+}
+
+// Returns row y of the test image, in the LibPNG format.
+static std::vector<png_byte> makeRow(unsigned long int imageWidth, unsigned long int y, unsigned int nBytesPerColor) {
+    unsigned int maxValue = (nBytesPerColor == 1) ? 0xFFU : 0xFFFFU;
+    std::vector<png_byte> row(imageWidth * 3 * nBytesPerColor);
+    for (unsigned long int x = 0; x < imageWidth; x++)
+        for (unsigned int c = 0; c < 3; c++) {
+            unsigned int sample = getSample(x, y, c, maxValue);
+            png_bytep bytes = &row[(x * 3 + c) * nBytesPerColor];
+            if (nBytesPerColor == 1) {
+                bytes[0] = static_cast<png_byte>(sample);
+            } else {
+                bytes[0] = static_cast<png_byte>(sample >> 8U);
+                bytes[1] = static_cast<png_byte>(sample);
+            }
+        }
+    return row;
+}
+
+// Returns how much of [start1, end1) overlaps [start2, end2).
+static std::uint64_t getOverlap(std::uint64_t start1, std::uint64_t end1, std::uint64_t start2, std::uint64_t end2) {
+    std::uint64_t start = std::max(start1, start2), end = std::min(end1, end2);
+    return (end > start) ? (end - start) : 0;
+}
+
+/* Returns channel c of output pixel x, y of keptRect resized to width x height, summing the
+ *   overlap of every source pixel of the crop with it, rather than the spans that AreaResampler
+ *   works out. In units where a source pixel is width by height, an output pixel is
+ *   keptRect.width by keptRect.height. */
+static unsigned int getExpectedSample(const PixelRect &keptRect, unsigned long int width, unsigned long int height,
+                                      unsigned long int x, unsigned long int y, unsigned int c, unsigned int maxValue) {
+    std::uint64_t sum = 0;
+    for (unsigned long int sourceY = 0; sourceY < keptRect.height; sourceY++) {
+        std::uint64_t rowWeight = getOverlap(sourceY * height, (sourceY + 1) * height,
+                                             y * keptRect.height, (y + 1) * keptRect.height);
+        for (unsigned long int sourceX = 0; sourceX < keptRect.width; sourceX++) {
+            std::uint64_t weight = rowWeight * getOverlap(sourceX * width, (sourceX + 1) * width,
+                                                          x * keptRect.width, (x + 1) * keptRect.width);
+            sum += weight * getSample(keptRect.x + sourceX, keptRect.y + sourceY, c, maxValue);
+        }
+    }
+    std::uint64_t area = std::uint64_t(keptRect.width) * keptRect.height;
+    return static_cast<unsigned int>((sum + area / 2) / area);
+}
+
+/* Resamples keptRect of an imageWidth x imageHeight test image to width x height, and checks
+ *   every sample against getExpectedSample(), and that no rows are needed past the crop. */
+template<typename Channel>
+static void checkResample(unsigned long int imageWidth, unsigned long int imageHeight, const PixelRect &keptRect,
+                          unsigned long int width, unsigned long int height) {
+    unsigned int nBytesPerColor = sizeof(Channel);
+    unsigned int maxValue = (nBytesPerColor == 1) ? 0xFFU : 0xFFFFU;
+    BasicPNG_RGB<Channel> output(width, height, nBytesPerColor * 8);
+    AreaResampler resampler(keptRect, width, height);
+
+    unsigned long int nRowsAdded = 0;
+    while (!resampler.isComplete() && (nRowsAdded < imageHeight)) {
+        std::vector<png_byte> row = makeRow(imageWidth, nRowsAdded, nBytesPerColor);
+        resampler.addRow(row.data(), nBytesPerColor, output);
+        nRowsAdded++;
+    }
+    CHECK(resampler.isComplete());
+    CHECK(nRowsAdded == keptRect.y + keptRect.height);
+
+    bool matches = true;
+    for (unsigned long int y = 0; y < height; y++) {
+        const auto *outputRow = output.getRow(y);
+        for (unsigned long int x = 0; x < width; x++) {
+            const auto &pixel = outputRow[x];
+            unsigned int samples[3] = {pixel.red, pixel.green, pixel.blue};
+            for (unsigned int c = 0; c < 3; c++)
+                if (samples[c] != getExpectedSample(keptRect, width, height, x, y, c, maxValue))
+                    matches = false;
+        }
+    }
+    checkThat(matches, "resampled samples match their exact area averages", __FILE__, __LINE__);
+}
+
+static void testAreaResampler() {
+    // Copying a crop unchanged.
+    checkResample<uint8_t>(9, 7, {2, 3, 5, 4}, 5, 4);
+    checkResample<uint16_t>(9, 7, {0, 0, 9, 7}, 9, 7);
+
+    // Shrinking, where each output pixel covers fractions of source pixels: 3 -> 2 weights them 2:1 and 1:2.
+    checkResample<uint8_t>(3, 3, {0, 0, 3, 3}, 2, 2);
+    checkResample<uint8_t>(17, 13, {1, 2, 15, 10}, 4, 3);
+    checkResample<uint16_t>(17, 13, {1, 2, 15, 10}, 7, 6);
+    checkResample<uint8_t>(10, 10, {0, 0, 10, 10}, 1, 1);
+
+    // Enlarging, where each source row is spread over several output rows held in the ring of open rows.
+    checkResample<uint8_t>(2, 2, {0, 0, 2, 2}, 5, 5);
+    checkResample<uint8_t>(4, 3, {1, 1, 3, 2}, 10, 7);
+    checkResample<uint16_t>(3, 4, {0, 0, 3, 4}, 11, 13);
+    checkResample<uint8_t>(1, 1, {0, 0, 1, 1}, 3, 9);
+
+    // Shrinking one side while enlarging the other.
+    checkResample<uint8_t>(12, 3, {0, 0, 12, 3}, 5, 8);
+    checkResample<uint16_t>(3, 12, {0, 0, 3, 12}, 8, 5);
+
+    // Rows below the crop are never needed, rows above it are skipped.
+    checkResample<uint8_t>(6, 20, {0, 15, 6, 2}, 3, 1);
+}
+
+int main() {
+    testParseSize();
+    testParseCrop();
+    testGetCrop();
+    testGetOutputSize();
+    testAreaResampler();
+    return reportChecks();
+}
@@ -0,0 +1,234 @@
+// Tests the options and framing of the requests of --serve mode.
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "DitherServer.h"
+#include "PNG_RGB.h"
+#include "TestCheck.h"
+#include "ThreadPool.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define DITHER_HAS_UNIX_SOCKETS 1
+#else
+#define DITHER_HAS_UNIX_SOCKETS 0
+#endif
+
+static void testParseRequestOptions() {
+    DitherSettings settings;
+    bool using3Bit = false;
+
+    DitherServer::parseRequestOptions("", settings, using3Bit);
+    CHECK(!using3Bit && (settings.matrixSize == 4) && (settings.diffusionKernel == nullptr));
+
+    DitherServer::parseRequestOptions("  -m   3bit  --matrix 8 --depth 2 --serpentine ", settings, using3Bit);
+    CHECK(using3Bit && (settings.matrixSize == 8) && (settings.greyDepth == 2) && settings.serpentine);
+    DitherServer::parseRequestOptions("-m greyscale", settings, using3Bit);
+    CHECK(!using3Bit);
+
+    DitherServer::parseRequestOptions("-m 3bit -d floyd-steinberg --alpha keep", settings, using3Bit);
+    CHECK((settings.diffusionKernel == &DiffusionKernel::fromName("floyd-steinberg")) &&
+          (settings.alpha == AlphaMode::keep));
+    DitherServer::parseRequestOptions("-d bayer --alpha threshold", settings, using3Bit);
+    CHECK((settings.diffusionKernel == nullptr) && (settings.alpha == AlphaMode::threshold));
+
+    // Greyscale output has no alpha, whether the mode is given by the request or was already set.
+    CHECK_THROWS(std::invalid_argument,
+                 DitherServer::parseRequestOptions("-m greyscale --alpha keep", settings, using3Bit));
+    using3Bit = false;
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("--alpha threshold", settings, using3Bit));
+    DitherServer::parseRequestOptions("-m greyscale", settings, using3Bit);
+    CHECK(!using3Bit);
+
+    DitherServer::parseRequestOptions("--crop 1,2,3,4 --resize 10x", settings, using3Bit);
+    CHECK(settings.geometry.cropping && (settings.geometry.crop.width == 3) && (settings.geometry.width == 10) &&
+          (settings.geometry.height == 0));
+
+    // Explicit compression settings override the profile, whichever comes first.
+    DitherServer::parseRequestOptions("--compression-level 3 --compression small", settings, using3Bit);
+    PNG_Compression small = PNG_Compression::fromProfile("small");
+    CHECK((settings.compression.level == 3) && (settings.compression.strategy == small.strategy) &&
+          (settings.compression.profileName == "small"));
+    DitherServer::parseRequestOptions("--compression fast --compression-filter paeth", settings, using3Bit);
+    CHECK((settings.compression.level == PNG_Compression::fromProfile("fast").level) &&
+          (settings.compression.filters == PNG_Compression::parseFilters("paeth")));
+
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("-m", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("-m --serpentine", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("-m purple", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("-d", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("-d sierra-9", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("--matrix 3", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("--depth 16", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("--alpha discard", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("--crop 1,2,3", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("--resize 0x5", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("--compression huge", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument,
+                 DitherServer::parseRequestOptions("--compression-level 10", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("--stream", settings, using3Bit));
+    CHECK_THROWS(std::invalid_argument, DitherServer::parseRequestOptions("3bit", settings, using3Bit));
+}
+
+#if DITHER_HAS_UNIX_SOCKETS
+
+// Returns a small 8 bit RGB PNG, with a gradient for the dithering to break up.
+static std::vector<png_byte> makePNG() {
+    PNG_RGB8 image(24, 16, 8);
+    for (unsigned long int y = 0; y < image.getInfo().height; y++)
+        for (unsigned long int x = 0; x < image.getInfo().width; x++)
+            image.getRow(y)[x] = RGB8_Pixel{(uint8_t) (x * 10), (uint8_t) (y * 15), (uint8_t) (x * y)};
+    std::vector<png_byte> png;
+    image.write_png_file(PNG_Destination(png));
+    return png;
+}
+
+static void appendLength(std::string &message, std::uint32_t length) {
+    message += (char) (length >> 24U);
+    message += (char) (length >> 16U);
+    message += (char) (length >> 8U);
+    message += (char) length;
+}
+
+// Returns a request, framed as the server reads it.
+static std::string makeRequest(const std::string &options, const std::vector<png_byte> &png) {
+    std::string request;
+    appendLength(request, (std::uint32_t) options.size());
+    request += options;
+    appendLength(request, (std::uint32_t) png.size());
+    request.append(png.begin(), png.end());
+    return request;
+}
+
+// Connects to the socket, retrying while the server starts. Returns -1 if it never listens.
+static int connectTo(const std::string &socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    for (unsigned int attempt = 0; attempt < 500; attempt++) {
+        int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(connection, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0) {
+            // A test should fail, not hang, if the server never answers.
+            timeval timeout{10, 0};
+            setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            return connection;
+        }
+        close(connection);
+        usleep(10000);
+    }
+    return -1;
+}
+
+// Reads exactly size bytes. Returns false if the connection was closed or timed out first.
+static bool readFully(int connection, void *data, std::size_t size) {
+    auto bytes = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t nRead = read(connection, bytes, size);
+        if (nRead <= 0)
+            return false;
+        bytes += nRead;
+        size -= nRead;
+    }
+    return true;
+}
+
+// Sends a request and reads its response. Returns false if no whole response came back.
+static bool sendRequest(int connection, const std::string &request, unsigned char &status, std::string &body) {
+    if (write(connection, request.data(), request.size()) != (ssize_t) request.size())
+        return false;
+    unsigned char header[5];
+    if (!readFully(connection, header, sizeof(header)))
+        return false;
+    status = header[0];
+    std::uint32_t length = ((std::uint32_t) header[1] << 24U) | ((std::uint32_t) header[2] << 16U) |
+                           ((std::uint32_t) header[3] << 8U) | header[4];
+    body.resize(length);
+    return readFully(connection, &body[0], length);
+}
+
+// Returns the PNG that a Ditherer with the settings makes in process, which the server must match.
+static std::string ditherInProcess(const std::vector<png_byte> &png, const DitherSettings &settings, bool using3Bit) {
+    ThreadPool pool(1);
+    Ditherer ditherer(settings, pool);
+    std::vector<png_byte> output;
+    ditherer.ditherPNG(PNG_Source(png.data(), png.size()), {DitherOutput{output, using3Bit}});
+    return std::string(output.begin(), output.end());
+}
+
+static void testServer() {
+    char directory[] = "/tmp/dither_tests_XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        CHECK(!"a temporary directory for the socket can be made");
+        return;
+    }
+    std::string socketPath = std::string(directory) + "/server.sock";
+
+    DitherSettings settings;
+    DitherServer server(socketPath, settings, false, 2, 2, 4);
+    std::thread serverThread([&]() { server.run(); });
+
+    std::vector<png_byte> png = makePNG();
+    unsigned char status = 0xFF;
+    std::string body;
+    int connection = connectTo(socketPath);
+    CHECK(connection >= 0);
+
+    // Several requests on one connection, each answered before the next is read.
+    CHECK(sendRequest(connection, makeRequest("", png), status, body));
+    CHECK((status == 0) && (body == ditherInProcess(png, settings, false)));
+    DitherSettings requestSettings = settings;
+    bool requestUsing3Bit = false;
+    DitherServer::parseRequestOptions("-m 3bit --matrix 8", requestSettings, requestUsing3Bit);
+    CHECK(sendRequest(connection, makeRequest("-m 3bit --matrix 8", png), status, body));
+    CHECK((status == 0) && (body == ditherInProcess(png, requestSettings, requestUsing3Bit)));
+
+    // A request that can not be dithered is answered with why, and the connection carries on.
+    CHECK(sendRequest(connection, makeRequest("-m purple", png), status, body));
+    CHECK((status == 1) && (body.find("purple") != std::string::npos));
+    CHECK(sendRequest(connection, makeRequest("", std::vector<png_byte>(100, 7)), status, body));
+    CHECK((status == 1) && !body.empty());
+    CHECK(sendRequest(connection, makeRequest("", png), status, body));
+    CHECK(status == 0);
+
+    // Options over the limit are refused before they are read, and the connection is closed.
+    std::string tooLong;
+    appendLength(tooLong, DitherServer::maxOptionsLength + 1);
+    CHECK(sendRequest(connection, tooLong, status, body));
+    CHECK((status == 1) && (body == "Request options are too long"));
+    char byte;
+    CHECK(read(connection, &byte, 1) == 0);
+    close(connection);
+
+    // A PNG over the limit is refused in the same way.
+    connection = connectTo(socketPath);
+    std::string tooLarge;
+    appendLength(tooLarge, 0);
+    appendLength(tooLarge, DitherServer::maxPNGLength + 1);
+    CHECK(sendRequest(connection, tooLarge, status, body));
+    CHECK((status == 1) && (body == "PNG is too large"));
+    close(connection);
+
+    // A request answered above means the server is handling SIGINT, which stops it and removes the socket.
+    std::raise(SIGINT);
+    serverThread.join();
+    CHECK(access(socketPath.c_str(), F_OK) != 0);
+    rmdir(directory);
+}
+
+#endif
+
+int main() {
+    testParseRequestOptions();
+#if DITHER_HAS_UNIX_SOCKETS
+    testServer();
+#endif
+    return reportChecks();
+}